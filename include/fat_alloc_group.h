@@ -0,0 +1,45 @@
+#ifndef FAT_ALLOC_GROUP_H
+#define FAT_ALLOC_GROUP_H
+
+#include "fat_types.h"
+#include "fat_volume.h"
+
+/* allocation groups
+ * - the data clusters are split into groups of FAT_ALLOC_GROUP_CLUSTERS,
+ *   each with a free count and a next-fit hint, built from the FAT cache on
+ *   first use and kept current by fat_write_entry()
+ * - a new chain starts in the group with the most free clusters, so files
+ *   written at the same time land in different groups
+ * - a growing chain takes the next free cluster after its goal (its current
+ *   last cluster) and spills to the following group only when its own is full
+ */
+
+#define FAT_ALLOC_GROUP_CLUSTERS 4096
+
+typedef struct {
+    uint32_t free;                  // free clusters in the group
+    cluster_t next;                 // next-fit hint, inside the group
+} fat_alloc_group_t;
+
+typedef struct fat_alloc_groups {
+    uint32_t count;
+    uint32_t rotor;                 // group after the last new chain
+    fat_alloc_group_t *groups;
+} fat_alloc_groups_t;
+
+fat_error_t fat_alloc_groups_build(fat_volume_t *volume);
+
+void fat_alloc_groups_free(fat_volume_t *volume);
+
+// keep the free counts current, called for every FAT entry change
+void fat_alloc_groups_update(fat_volume_t *volume, 
+                             cluster_t cluster, 
+                             uint32_t old_value, 
+                             uint32_t new_value);
+
+// free cluster near goal (0: start a new chain), not yet marked allocated
+fat_error_t fat_alloc_groups_find(fat_volume_t *volume, 
+                                  cluster_t goal, 
+                                  cluster_t *cluster);
+
+#endif
@@ -0,0 +1,35 @@
+#ifndef FAT_ALLOC_POLICY_H
+#define FAT_ALLOC_POLICY_H
+
+#include "fat_types.h"
+#include "fat_volume.h"
+
+/* cluster allocation policy, chosen per volume
+ *
+ * every policy first extends a chain in place (the cluster right after the
+ * goal), it only decides where to go when that one is taken or the chain
+ * is new
+ */
+
+typedef enum {
+    FAT_ALLOC_GROUPS,       // default - emptiest group per new chain (fat_alloc_group.h)
+    FAT_ALLOC_NEXT_FIT,     // rotating cursor, suits append-only logs
+    FAT_ALLOC_BEST_FIT,     // smallest free run holding the request, suits media
+                            // files - scans the whole FAT when it has to move
+    FAT_ALLOC_PARENT        // new chains right after their directory's cluster
+} fat_alloc_policy_t;
+
+typedef struct {
+    cluster_t goal;         // place after this cluster - the chain's last (0: none)
+    cluster_t parent;       // directory of a new chain (0: root / unknown)
+    uint32_t count;         // clusters about to be needed, run size for best-fit
+} fat_alloc_hint_t;
+
+fat_error_t fat_set_alloc_policy(fat_volume_t *volume, fat_alloc_policy_t policy);
+
+// free cluster picked by the volume's policy, not yet marked allocated
+fat_error_t fat_alloc_find(fat_volume_t *volume, 
+                           const fat_alloc_hint_t *hint, 
+                           cluster_t *cluster);
+
+#endif
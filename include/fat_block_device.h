@@ -2,6 +2,13 @@
 #define FAT_BLOCK_DEVICE_H
 
 #include <stdint.h>
+#include <stddef.h>
+
+// one buffer of a scatter-gather list
+typedef struct {
+    void *base;
+    size_t length;
+} fat_iovec_t;
 
 // block device interface: abstraction from underlying storage device
 
@@ -12,6 +19,18 @@ typedef struct {
                         const void *buffer);
     int (*get_sector_count)(void *device, uint32_t *sector_count);
     int (*get_sector_size)(void *device, uint32_t *sector_size);
+    // optional (NULL: not supported) - sectors no longer hold data
+    int (*discard_sectors)(void *device, uint32_t sector, uint32_t count);
+    // optional (NULL: not supported) - count sectors scattered over / gathered
+    // from iovcnt buffers, buffer lengths add up to count sectors
+    int (*readv_sectors)(void *device, uint32_t sector, uint32_t count, 
+                         const fat_iovec_t *iov, int iovcnt);
+    int (*writev_sectors)(void *device, uint32_t sector, uint32_t count, 
+                          const fat_iovec_t *iov, int iovcnt);
+    // optional (NULL: not supported) - count sectors from source to target
+    // inside the device, ranges do not overlap
+    int (*copy_sectors)(void *device, uint32_t source, uint32_t target, 
+                        uint32_t count);
     void *device_data;
 } fat_block_device_t;
 
@@ -4,6 +4,7 @@
 #include <stdint.h>
 #include "fat_types.h"
 #include "fat_volume.h"
+#include "fat_alloc_policy.h"
 
 fat_error_t fat_get_next_cluster(fat_volume_t *volume, 
                                  cluster_t cluster, 
@@ -11,8 +12,36 @@ fat_error_t fat_get_next_cluster(fat_volume_t *volume,
 
 bool fat_is_eoc(fat_volume_t *volume, uint32_t value);
 bool fat_is_bad(fat_volume_t *volume, uint32_t value);
-fat_error_t fat_allocate_cluster(fat_volume_t *volume, cluster_t *cluster);
+uint32_t fat_get_eoc_marker(fat_volume_t *volume);
+
+// clusters physically following cluster in its chain, itself included, at
+// most max_clusters
+fat_error_t fat_contiguous_clusters(fat_volume_t *volume, 
+                                    cluster_t cluster, 
+                                    uint32_t max_clusters, 
+                                    uint32_t *count);
+
+// goal: cluster to grow after (0: new chain), placement per fat_alloc_policy.h
+fat_error_t fat_allocate_cluster(fat_volume_t *volume, 
+                                 cluster_t goal, 
+                                 cluster_t *cluster);
+fat_error_t fat_allocate_cluster_hint(fat_volume_t *volume, 
+                                      const fat_alloc_hint_t *hint, 
+                                      cluster_t *cluster);
+fat_error_t fat_allocate_chain(fat_volume_t *volume, 
+                               cluster_t goal, 
+                               uint32_t count, 
+                               cluster_t *first_cluster);
 fat_error_t fat_free_chain(fat_volume_t *volume, cluster_t start_cluster);
+
+// free a chain in one pass over the FAT, clusters_freed may be NULL.
+// discard: also discard the freed clusters on the device (write-through mode
+// and devices with discard_sectors only) - nothing on disk may reference the
+// chain's data any more, i.e. the directory entry is written already
+fat_error_t fat_release_chain(fat_volume_t *volume, 
+                              cluster_t start_cluster, 
+                              bool discard, 
+                              uint32_t *clusters_freed);
 fat_error_t fat_validate_chain(fat_volume_t *volume, cluster_t start_cluster);
 
 #endif
@@ -0,0 +1,79 @@
+#ifndef FAT_COMMIT_H
+#define FAT_COMMIT_H
+
+#include "fat_types.h"
+#include "fat_volume.h"
+
+/* group commit of metadata changes
+ *
+ * by default every metadata operation (close, mkdir, rmdir, unlink, ...)
+ * writes its directory sectors through and flushes the FAT before returning.
+ * with group commit enabled directory sector writes, cluster frees and
+ * chain cuts are kept in memory and written together by fat_sync(), or once
+ * a threshold below is reached at the end of an operation.
+ *
+ * fat_sync() writes in this order:
+ *  1. dirty FAT sectors - new allocations and chain links, chains cut since
+ *     the last sync still carry their old link on disk
+ *  2. pending directory sectors, ascending
+ *  3. chain cuts and deferred frees, then the FAT sectors they touched
+ * a crash between the steps leaves allocated clusters nobody references
+ * (lost clusters) but never a reference to a cluster that is free on disk,
+ * so nothing can be allocated twice (cross-linked) after a remount.
+ * with an intent log (fat_intent.h) all three go out as one transaction.
+ *
+ * file data is still written straight to the device. clusters freed since
+ * the last sync count as used until the sync completes.
+ */
+
+typedef struct {
+    uint32_t max_dirty_sectors;         // sync at this many pending sectors (0: no limit)
+    uint32_t max_age_seconds;           // sync when changes are this old (0: no limit)
+} fat_commit_params_t;
+
+fat_error_t fat_enable_group_commit(fat_volume_t *volume,
+                                    const fat_commit_params_t *params);
+
+// syncs pending changes, then returns to write-through mode
+fat_error_t fat_disable_group_commit(fat_volume_t *volume);
+
+// write all pending metadata in the order documented above
+fat_error_t fat_sync(fat_volume_t *volume);
+
+// end of a metadata operation - flush now or when a threshold is reached
+fat_error_t fat_commit(fat_volume_t *volume);
+
+// true if pending changes reach one of the limits (also starts the age clock)
+bool fat_commit_due(fat_volume_t *volume, const fat_commit_params_t *limits);
+
+// dirty FAT sectors plus pending directory sectors
+uint32_t fat_commit_pending_sectors(fat_volume_t *volume);
+
+// directory sector I/O, sees and queues pending sectors in group commit mode
+fat_error_t fat_meta_read(fat_volume_t *volume,
+                          uint32_t sector,
+                          uint32_t count,
+                          void *buffer);
+
+fat_error_t fat_meta_write(fat_volume_t *volume,
+                           uint32_t sector,
+                           uint32_t count,
+                           const void *buffer);
+
+/* queue a cluster free until the next sync, sets deferred to false if the
+ * free has to be applied right away (write-through mode or during a sync)
+ */
+fat_error_t fat_commit_defer_free(fat_volume_t *volume,
+                                  cluster_t cluster,
+                                  bool *deferred);
+
+/* end the chain at cluster (EOC). the cache has the EOC at once, in group
+ * commit mode the disk keeps the old link until step 3 of the next sync -
+ * the clusters behind it must be freed (deferred) by the same operation
+ */
+fat_error_t fat_commit_cut_chain(fat_volume_t *volume, cluster_t cluster);
+
+// drop pending state without writing it (unmount after a failed sync)
+void fat_commit_release(fat_volume_t *volume);
+
+#endif
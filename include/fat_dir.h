@@ -100,6 +100,18 @@ typedef struct __attribute__((packed)){
     uint8_t name3[4];
 } fat_lfn_entry_t;
 
+// UTF-8 bytes of the longest long name (255 UTF-16 units, up to 3 bytes
+// each) plus the NUL
+#define FAT_LFN_UTF8_MAX 766
+
+// physical location of a directory entry
+typedef struct {
+    cluster_t cluster;      // cluster holding the entry (0: FAT12/16 root)
+    uint32_t sector;        // absolute sector (0: location unknown)
+    uint32_t offset;        // byte offset within the sector
+    uint32_t index;         // linear entry index within the directory
+} fat_dir_loc_t;
+
 fat_error_t fat_read_dir_entry (fat_volume_t *volume, 
                                 uint32_t sector, 
                                 uint32_t offset, 
@@ -110,6 +122,36 @@ fat_error_t fat_write_dir_entry(fat_volume_t *volume,
                                 uint32_t offset, 
                                 const fat_dir_entry_t *entry);
 
+fat_error_t fat_dir_loc_from_index(fat_volume_t *volume, 
+                                   cluster_t dir_cluster, 
+                                   uint32_t entry_index, 
+                                   fat_dir_loc_t *loc);
+
+fat_error_t fat_dir_loc_next(fat_volume_t *volume, fat_dir_loc_t *loc);
+
+fat_error_t fat_dir_loc_prev(fat_volume_t *volume, 
+                             cluster_t dir_cluster, 
+                             fat_dir_loc_t *loc);
+
+/* write count consecutive entries starting at loc, each sector is read and
+ * written once - on success loc points at the last entry written
+ */
+fat_error_t fat_write_dir_entries(fat_volume_t *volume, 
+                                  fat_dir_loc_t *loc, 
+                                  const fat_dir_entry_t *entries, 
+                                  uint32_t count);
+
+// mark count consecutive entries starting at loc deleted, same as above
+fat_error_t fat_mark_dir_entries_deleted(fat_volume_t *volume, 
+                                         fat_dir_loc_t *loc, 
+                                         uint32_t count);
+
+fat_error_t fat_locate_dir_entry(fat_volume_t *volume, 
+                                 cluster_t dir_cluster, 
+                                 uint32_t entry_index, 
+                                 uint32_t *sector, 
+                                 uint32_t *offset);
+
 cluster_t fat_get_entry_cluster(fat_volume_t *volume, 
                                 const fat_dir_entry_t *entry);
 
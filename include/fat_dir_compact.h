@@ -0,0 +1,16 @@
+#ifndef FAT_DIR_COMPACT_H
+#define FAT_DIR_COMPACT_H
+
+#include "fat_types.h"
+#include "fat_volume.h"
+
+/* packs live entries of a directory to the front and frees trailing clusters
+ * - open file handles in the directory are moved along, handles of deleted
+ *   entries are detached (FAT_DIR_ENTRY_DETACHED) and no longer update one
+ * - open fat_dir_t streams of the directory must be reopened
+ * - not atomic without an intent log: a crash mid-pass can leave a moved
+ *   entry in both places, sharing one chain
+ */
+fat_error_t fat_compact_dir(fat_volume_t *volume, const char *path);
+
+#endif
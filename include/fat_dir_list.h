@@ -4,6 +4,14 @@
 #include "fat_types.h"
 #include "fat_volume.h"
 #include "fat_dir.h"
+#include <stddef.h>
+
+// fat_readdir_batch flags
+#define FAT_READDIR_SKIP_LFN 0x01   // report 8.3 names, no LFN decoding
+#define FAT_READDIR_COMPACT 0x02    // name, attributes, size and cluster only
+
+// fat_readdir_batch records are aligned to this many bytes
+#define FAT_DIRENT_ALIGN 4
 
 typedef struct {
     fat_volume_t *volume;
@@ -14,11 +22,18 @@ typedef struct {
     uint8_t *cluster_buffer;
     bool is_root_fat12;
     uint32_t max_entries;
+
+    // long name collected front to back by fat_readdir_batch
+    uint16_t lfn_chars[260];
+    uint16_t lfn_length;
+    uint8_t lfn_checksum;
+    uint8_t lfn_entries;            // entries in the sequence (0: none)
+    uint8_t lfn_next_order;         // next expected order (0: complete)
 } fat_dir_t;
 
 typedef struct {
     char short_name[13];
-    char long_name[256];
+    char long_name[FAT_LFN_UTF8_MAX];
     uint8_t attributes;
     uint32_t file_size;
     uint16_t create_date;
@@ -32,10 +47,41 @@ typedef struct {
     bool is_readonly;
 } fat_dir_entry_info_t;
 
+/* fat_readdir_batch record, packed back to back into the caller's buffer
+ * - name is NUL-terminated UTF-8, name_length excludes the NUL
+ * - without FAT_READDIR_COMPACT a fat_dirent_times_t closes the record,
+ *   see fat_dirent_times()
+ * - record_length is the offset of the next record
+ */
+typedef struct {
+    uint16_t record_length;
+    uint16_t name_length;
+    uint32_t file_size;
+    cluster_t start_cluster;
+    uint8_t attributes;
+    char name[];
+} fat_dirent_t;
+
+typedef struct {
+    uint16_t create_date;
+    uint16_t create_time;
+    uint16_t modify_date;
+    uint16_t modify_time;
+    uint16_t access_date;
+} fat_dirent_times_t;
+
 fat_error_t fat_opendir(fat_volume_t *volume, const char *path, fat_dir_t **dir);
 
 fat_error_t fat_readdir(fat_dir_t *dir, fat_dir_entry_info_t *info);
 
+fat_error_t fat_readdir_batch(fat_dir_t *dir, 
+                              void *buffer, 
+                              size_t buffer_size, 
+                              uint32_t flags, 
+                              size_t *bytes_filled);
+
+const fat_dirent_times_t *fat_dirent_times(const fat_dirent_t *record);
+
 fat_error_t fat_closedir(fat_dir_t *dir);
 
 void fat_convert_short_name(const uint8_t *short_name, char *output);
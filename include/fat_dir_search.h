@@ -5,6 +5,19 @@
 #include "fat_volume.h"
 #include "fat_dir.h"
 
+// clusters added per directory growth step (contiguous where possible)
+#define FAT_DIR_GROWTH_CLUSTERS 4
+
+// search name prepared once per lookup, compared against raw entries
+typedef struct {
+    uint64_t short_name_lo;         // 8.3 name bytes 0-7, space padded, folded
+    uint32_t short_name_hi;         // 8.3 name bytes 8-10
+    bool has_short_name;            // name can be stored as 8.3
+    uint8_t lfn_entries;            // LFN entries of a matching long name
+    uint16_t long_length;
+    uint16_t long_name[255];        // folded UTF-16 long name
+} fat_lookup_key_t;
+
 typedef fat_error_t (*fat_dir_iterator_callback)(
     const fat_dir_entry_t *entry,
     const char *long_name,
@@ -12,22 +25,48 @@ typedef fat_error_t (*fat_dir_iterator_callback)(
     void *user_data
 );
 
-fat_error_t fat_find_entry (fat_volume_t *volume, 
+// raw slot callback: every slot up to end of directory (LFN + deleted too)
+typedef fat_error_t (*fat_dir_slot_callback)(
+    const fat_dir_entry_t *entry,
+    uint32_t entry_index,
+    void *user_data
+);
+
+fat_error_t fat_find_entry (fat_volume_t *volume,
                             cluster_t dir_cluster, 
                             const char *name, 
                             fat_dir_entry_t *entry, 
                             uint32_t *entry_index);
 
+fat_error_t fat_find_entry_loc(fat_volume_t *volume, 
+                               cluster_t dir_cluster, 
+                               const char *name,
+                               fat_dir_entry_t *entry, 
+                               fat_dir_loc_t *loc);
+
 fat_error_t fat_iterate_directory(fat_volume_t *volume,
                                   cluster_t dir_cluster,
                                   fat_dir_iterator_callback callback,
                                   void *user_data);
 
+fat_error_t fat_scan_directory_slots(fat_volume_t *volume,
+                                     cluster_t dir_cluster,
+                                     fat_dir_slot_callback callback,
+                                     void *user_data);
+
+fat_error_t fat_grow_directory(fat_volume_t *volume, 
+                               cluster_t last_cluster, 
+                               cluster_t *first_new_cluster);
+
 fat_error_t fat_find_free_entry(fat_volume_t *volume,
                                 cluster_t dir_cluster,
                                 uint32_t num_entries,
                                 uint32_t *entry_index);
     
+void fat_make_lookup_key(const char *name, fat_lookup_key_t *key);
+
+bool fat_match_short_key(const fat_lookup_key_t *key, const uint8_t *short_name);
+
 bool fat_compare_short_name(const uint8_t *short_name, const char *filename);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,67 @@
+#ifndef FAT_DIR_SLOTS_H
+#define FAT_DIR_SLOTS_H
+
+#include "fat_types.h"
+#include "fat_volume.h"
+#include "fat_dir.h"
+
+// directories with a cached free-slot map per volume (least recently used
+// map is dropped first)
+#define FAT_DIR_SLOT_MAPS_MAX 8
+
+// run of free directory slots (deleted or never used)
+typedef struct{
+    uint32_t start;
+    uint32_t length;
+} fat_slot_run_t;
+
+// free-slot map of one directory
+typedef struct fat_dir_slot_map{
+    cluster_t dir_cluster;
+    cluster_t last_cluster;         // last cluster of chain (0: fixed root)
+    uint32_t capacity;              // slots in the allocated directory
+
+    cluster_t *clusters;            // directory chain in order (NULL: fixed root)
+    uint32_t cluster_count;
+
+    fat_slot_run_t *runs;           // sorted by start, never adjacent
+    uint32_t run_count;
+    uint32_t run_capacity;
+
+    struct fat_dir_slot_map *next;
+} fat_dir_slot_map_t;
+
+fat_error_t fat_dir_slots_get(fat_volume_t *volume,
+                              cluster_t dir_cluster,
+                              fat_dir_slot_map_t **map);
+
+fat_error_t fat_dir_slots_find(const fat_dir_slot_map_t *map,
+                               uint32_t num_entries,
+                               uint32_t *entry_index);
+
+fat_error_t fat_dir_slots_extend(fat_volume_t *volume,
+                                 fat_dir_slot_map_t *map,
+                                 cluster_t first_new_cluster);
+
+// locate entry_index through the cached chain of dir_cluster
+// FAT_ERR_NOT_FOUND: no map cached or index beyond the chain
+fat_error_t fat_dir_slots_locate(fat_volume_t *volume,
+                                 cluster_t dir_cluster,
+                                 uint32_t entry_index,
+                                 fat_dir_loc_t *loc);
+
+void fat_dir_slots_claim(fat_volume_t *volume,
+                         cluster_t dir_cluster,
+                         uint32_t entry_index,
+                         uint32_t count);
+
+void fat_dir_slots_release(fat_volume_t *volume,
+                           cluster_t dir_cluster,
+                           uint32_t entry_index,
+                           uint32_t count);
+
+void fat_dir_slots_invalidate(fat_volume_t *volume, cluster_t dir_cluster);
+
+void fat_dir_slots_free_all(fat_volume_t *volume);
+
+#endif
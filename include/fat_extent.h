@@ -0,0 +1,77 @@
+#ifndef FAT_EXTENT_H
+#define FAT_EXTENT_H
+
+#include "fat_types.h"
+#include "fat_volume.h"
+#include "fat_file.h"
+
+/* extent map - runs of physically contiguous clusters of one open file
+ *
+ * - built lazily per handle from the cluster chain and extended as the chain
+ *   grows, so positional reads and writes (fat_pread, fat_pwrite) and long
+ *   seeks look clusters up with a binary search instead of walking the FAT
+ * - callers hold the volume lock (either mode) so the chain does not change
+ *   under the lookup, the map itself is guarded by the handle's extent lock
+ * - rebuilt when the file's first cluster changes
+ */
+
+// run of contiguous clusters
+typedef struct{
+    uint32_t index;                 // file cluster index of the first cluster
+    cluster_t cluster;              // first cluster on disk
+    uint32_t length;                // clusters in the run
+} fat_extent_t;
+
+typedef struct fat_extent_map{
+    cluster_t start_cluster;        // chain the map describes
+    uint32_t clusters;              // clusters mapped so far
+    bool complete;                  // reached the end of chain
+
+    fat_extent_t *extents;          // sorted by index
+    uint32_t count;
+    uint32_t capacity;
+} fat_extent_map_t;
+
+// cluster holding file cluster index, and how many clusters follow it
+// contiguously (including itself)
+fat_error_t fat_extent_lookup(fat_file_t *file, 
+                              cluster_t start_cluster, 
+                              uint32_t index, 
+                              cluster_t *cluster, 
+                              uint32_t *run_length);
+
+void fat_extent_free(fat_file_t *file);
+
+/* extent query (FIEMAP-style) - where a file range lives on the device
+ *
+ * - lets a consumer with its own path to the device or image (DMA, a block
+ *   mapper, sendfile from the image) read file data without the driver
+ *   copying it
+ * - runs are maximal, each one physically contiguous, and cover the range
+ *   clipped to the end of file. the last sector of a run may hold bytes
+ *   past length
+ * - the handle's buffered writes go to the device first. the answer holds
+ *   until the file is written, truncated or closed
+ */
+
+typedef struct{
+    uint32_t logical;               // file offset of the first byte
+    uint32_t sector;                // device sector holding it
+    uint32_t sector_offset;         // its offset in that sector
+    uint32_t length;                // bytes
+    uint32_t flags;                 // FAT_EXTENT_*
+} fat_file_extent_t;
+
+#define FAT_EXTENT_LAST 0x01        // run ends at end of file
+
+// runs backing length bytes from offset. count: in - room in extents,
+// out - runs stored. with extents NULL only the runs are counted.
+// fewer runs than the range needs when extents is full - ask again from
+// the end of the last one
+fat_error_t fat_get_extents(fat_file_t *file, 
+                            uint32_t offset, 
+                            uint32_t length, 
+                            fat_file_extent_t *extents, 
+                            uint32_t *count);
+
+#endif
@@ -5,16 +5,28 @@
 #include "fat_volume.h"
 #include "fat_dir.h"
 
-typedef struct {
+// dir_entry_offset of a handle whose entry is gone (fat_dir_compact.h)
+#define FAT_DIR_ENTRY_DETACHED UINT32_MAX
+
+typedef struct fat_file {
     fat_volume_t *volume;
     fat_dir_entry_t dir_entry;
     cluster_t current_cluster;
     uint32_t position;
     cluster_t dir_cluster;
-    uint32_t dir_entry_offset;
+    uint32_t dir_entry_offset;          // FAT_DIR_ENTRY_DETACHED: entry deleted
+    fat_dir_loc_t dir_entry_loc;        // short entry location (sector 0: unknown)
     int flags;
     bool modified;
     uint32_t cluster_offset;
+    cluster_t tail_cluster;             // last cluster of the chain (0: unknown)
+    uint32_t chain_clusters;            // chain length, valid with tail_cluster
+    uint8_t advice;                     // access pattern, FAT_FADV_* (fat_file_advise.h)
+
+    struct fat_file *next_open;         // volume's open file list
+    struct fat_file_lock *lock;         // FAT_THREAD_SAFE builds (fat_lock.h)
+    struct fat_extent_map *extents;     // cluster runs, built lazily (fat_extent.h)
+    struct fat_write_buffer *write_buffer; // NULL: unbuffered (fat_file_buffer.h)
 } fat_file_t;
 
 fat_error_t fat_open(fat_volume_t *volume, const char *path, int flags, 
@@ -26,9 +38,24 @@ fat_error_t fat_init_file_handle(fat_file_t *file,
                                  fat_volume_t *volume, 
                                  const fat_dir_entry_t *dir_entry, 
                                  cluster_t dir_cluster,
-                                 uint32_t dir_entry_offset, 
+                                 const fat_dir_loc_t *dir_entry_loc, 
                                  int flags);
 
+void fat_register_open_file(fat_file_t *file);
+
+void fat_unregister_open_file(fat_file_t *file);
+
+// both handles are open on the same directory entry (detached handles only
+// match themselves)
+bool fat_same_file(const fat_file_t *a, const fat_file_t *b);
+
+// other handles of the file take over a larger size and the chain start -
+// caller holds the exclusive volume lock
+void fat_share_file_size(fat_file_t *file);
+
+// another handle is open on the file - caller holds the volume lock
+bool fat_file_is_shared(const fat_file_t *file);
+
 bool fat_validate_open_flags(int flags, const fat_dir_entry_t *entry);
 
 void fat_update_file_timestamps(fat_dir_entry_t *entry);
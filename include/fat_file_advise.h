@@ -0,0 +1,42 @@
+#ifndef FAT_FILE_ADVISE_H
+#define FAT_FILE_ADVISE_H
+
+#include "fat_types.h"
+#include "fat_file.h"
+
+/* access pattern hints for an open file (posix_fadvise)
+ *
+ * - the driver keeps no file data in memory besides the handle's write
+ *   buffer and reads each physically contiguous run in one request, so the
+ *   hints steer cluster lookup and placement instead of a page cache
+ * - SEQUENTIAL: a growing file asks the allocator for room for
+ *   FAT_FADV_SEQUENTIAL_RUN clusters, with FAT_ALLOC_BEST_FIT the stream
+ *   stays in long runs that later read in few requests
+ * - RANDOM: the whole chain goes into the extent map (fat_extent.h) now,
+ *   seeks and positional I/O afterwards never walk the FAT
+ * - WILLNEED: the part of the chain under the range is mapped now
+ *   (synchronously - there is no data to prefetch)
+ * - DONTNEED: buffered writes in the range go to the device, a range
+ *   covering the whole file drops the extent map as well
+ * - NOREUSE: accepted, no effect
+ * - SEQUENTIAL, RANDOM and NORMAL set the handle's pattern, the others act
+ *   once and leave it
+ */
+
+#define FAT_FADV_NORMAL 0
+#define FAT_FADV_SEQUENTIAL 1
+#define FAT_FADV_RANDOM 2
+#define FAT_FADV_WILLNEED 3
+#define FAT_FADV_DONTNEED 4
+#define FAT_FADV_NOREUSE 5
+
+// clusters a sequential file asks the allocator for at least
+#define FAT_FADV_SEQUENTIAL_RUN 64
+
+// length 0: to the end of file
+fat_error_t fat_fadvise(fat_file_t *file,
+                        uint32_t offset,
+                        uint32_t length,
+                        int advice);
+
+#endif
@@ -0,0 +1,48 @@
+#ifndef FAT_FILE_BUFFER_H
+#define FAT_FILE_BUFFER_H
+
+#include "fat_types.h"
+#include "fat_file.h"
+#include <stdlib.h>
+#include <time.h>
+
+/* per-handle write-back buffer (off by default)
+ *
+ * - gathers small sequential writes of one handle and sends them to the
+ *   device as full sectors / cluster runs
+ * - written out when full, on a write that does not continue it, on seek,
+ *   read, fat_pread / fat_pwrite, fat_fflush and close - with the background
+ *   flusher running also by age and total size (fat_flusher.h)
+ * - clusters are still allocated and the file size updated by each write,
+ *   only the data waits - a crash loses at most the buffered bytes. other
+ *   handles of the file see the new size at once, the bytes once written out
+ * - writes of a buffer or more go straight to the device
+ */
+
+typedef struct fat_write_buffer{
+    uint8_t *data;
+    uint32_t capacity;              // bytes
+    uint32_t start;                 // file offset of data[0]
+    uint32_t length;                // bytes buffered
+    time_t since;                   // first byte buffered, valid with length
+} fat_write_buffer_t;
+
+// clusters: buffer size, 0 disables the buffer (flushed first)
+fat_error_t fat_set_write_buffer(fat_file_t *file, uint32_t clusters);
+
+// write buffered data of the handle to the device
+fat_error_t fat_fflush(fat_file_t *file);
+
+// internal - caller holds the handle lock and the volume lock (either mode)
+
+// result of fat_buffer_write when the write must go to the device instead
+#define FAT_BUFFER_BYPASS 0
+
+// bytes buffered, -error, or FAT_BUFFER_BYPASS (buffer flushed already)
+int fat_buffer_write(fat_file_t *file, const void *buffer, size_t size);
+
+fat_error_t fat_buffer_flush(fat_file_t *file);
+
+void fat_buffer_free(fat_file_t *file);
+
+#endif
@@ -0,0 +1,41 @@
+#ifndef FAT_FILE_COPY_H
+#define FAT_FILE_COPY_H
+
+#include "fat_types.h"
+#include "fat_volume.h"
+#include "fat_file.h"
+
+/* file copy inside one volume
+ *
+ * - the destination is extended once for the whole range, its clusters
+ *   requested as one run so the allocation policy can place them together
+ * - data moves per pair of physically contiguous source / destination runs:
+ *   sector aligned runs go through the device's copy_sectors without
+ *   leaving it, anything else through one bounce buffer of
+ *   FAT_COPY_CHUNK_CLUSTERS clusters in whole-run device requests
+ * - only a partial head or tail sector of the destination is read,
+ *   modified and written back
+ */
+
+// clusters moved per bounce buffer round trip
+#define FAT_COPY_CHUNK_CLUSTERS 32
+
+// copy src_path to dst_path - an existing destination file is replaced,
+// a missing one created
+fat_error_t fat_copy_file(fat_volume_t *volume,
+                          const char *src_path,
+                          const char *dst_path);
+
+// copy up to length bytes of in at *in_offset to out at *out_offset
+// (copy_file_range) - a NULL offset uses and moves the handle's position,
+// otherwise the offset moves and the position stays. out must not be
+// opened with FAT_O_APPEND and the write must not leave a hole. ranges of
+// the same file must not overlap.
+// bytes copied, 0 at end of in, or -error
+fat_ssize_t fat_copy_file_range(fat_file_t *in,
+                                int64_t *in_offset,
+                                fat_file_t *out,
+                                int64_t *out_offset,
+                                size_t length);
+
+#endif
@@ -19,7 +19,8 @@ fat_error_t fat_create_directory_entries(fat_volume_t *volume,
                                          const char *filename, 
                                          const uint8_t *short_name, 
                                          cluster_t file_cluster, 
-                                         uint8_t attributes);
+                                         uint8_t attributes,
+                                         fat_dir_loc_t *sfn_loc);
 
 fat_error_t fat_create(fat_volume_t *volume, 
                        const char *path,  
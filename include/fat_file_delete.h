@@ -8,13 +8,13 @@ fat_error_t fat_update_free_cluster_count(fat_volume_t *volume,
 
 fat_error_t fat_find_lfn_entries(fat_volume_t *volume, 
                                  cluster_t parent_cluster, 
-                                 uint32_t entry_index, 
-                                 uint32_t *lfn_start_index, 
+                                 const fat_dir_loc_t *loc, 
+                                 fat_dir_loc_t *lfn_start, 
                                  uint32_t *lfn_count);
 
 fat_error_t fat_delete_directory_entries(fat_volume_t *volume, 
                                          cluster_t parent_cluster, 
-                                         uint32_t entry_index, 
+                                         const fat_dir_loc_t *loc, 
                                          bool has_lfn);
 
 fat_error_t fat_delete_file_clusters(fat_volume_t *volume, 
@@ -5,6 +5,7 @@
 #include "fat_cluster.h"
 #include "fat_file.h"
 #include "fat_types.h"
+#include "fat_iovec.h"
 #include <stdlib.h>
 
 void fat_calculate_cluster_position(fat_volume_t *volume, 
@@ -19,12 +20,45 @@ fat_error_t fat_walk_cluster_chain(fat_volume_t *volume,
 
 fat_error_t fat_seek_to_position(fat_file_t *file, uint32_t target_position);
 
+// read length bytes from offset into the physically contiguous clusters
+// starting at cluster - whole sectors go straight to buffer in one request,
+// only an unaligned head or tail sector is bounced
+fat_error_t fat_read_cluster_run(fat_volume_t *volume, 
+                                 cluster_t cluster, 
+                                 uint32_t offset, 
+                                 void *buffer, 
+                                 size_t length);
+
+// fat_read_cluster_run into the buffers at cursor, moved past the data -
+// with the device's readv_sectors one request covers the whole sectors
+fat_error_t fat_read_cluster_runv(fat_volume_t *volume, 
+                                  cluster_t cluster, 
+                                  uint32_t offset, 
+                                  fat_iov_cursor_t *cursor, 
+                                  size_t length);
+
 fat_error_t fat_read_cluster_data(fat_volume_t *volume, 
                                   cluster_t cluster, 
                                   uint32_t offset, 
                                   void *buffer, 
                                   size_t length);
 
+// at most INT_MAX bytes per call, fat_read64 reads any size at once
 int fat_read(fat_file_t *file, void *buffer, size_t size);
 
+fat_ssize_t fat_read64(fat_file_t *file, void *buffer, size_t size);
+
+// read into iovcnt buffers in turn, physically contiguous data goes to all
+// of them in one device request where the device supports it
+fat_ssize_t fat_readv(fat_file_t *file, const fat_iovec_t *iov, int iovcnt);
+
+// read at offset without moving the handle's position - calls on one handle
+// from several threads share its extent map (fat_extent.h)
+int fat_pread(fat_file_t *file, void *buffer, size_t size, uint32_t offset);
+
+fat_ssize_t fat_pread64(fat_file_t *file, 
+                        void *buffer, 
+                        size_t size, 
+                        int64_t offset);
+
 #endif
\ No newline at end of file
@@ -3,10 +3,10 @@
 
 #include "fat_file.h"
 
-bool fat_validate_seek_parameters(fat_file_t *file, int32_t offset, int whence);
+bool fat_validate_seek_parameters(fat_file_t *file, int64_t offset, int whence);
 
 fat_error_t fat_calculate_target_position(fat_file_t *file, 
-                                          int32_t offset, 
+                                          int64_t offset, 
                                           int whence, 
                                           uint32_t *target_position);
 
@@ -17,6 +17,13 @@ fat_error_t fat_seek_to_position(fat_file_t *file, uint32_t target_position);
 
 fat_error_t fat_seek(fat_file_t *file, int32_t offset, int whence);
 
+// any position of a FAT file from 0 to its size (at most FAT_MAX_FILE_SIZE)
+// from any origin - targets past the end of file are FAT_ERR_INVALID_PARAM
+fat_error_t fat_seek64(fat_file_t *file, int64_t offset, int whence);
+
 uint32_t fat_tell(fat_file_t *file);
 
+// position, or -FAT_ERR_INVALID_PARAM
+int64_t fat_tell64(fat_file_t *file);
+
 #endif
\ No newline at end of file
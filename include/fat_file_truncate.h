@@ -0,0 +1,29 @@
+#ifndef FAT_FILE_TRUNCATE_H
+#define FAT_FILE_TRUNCATE_H
+
+#include "fat_types.h"
+#include "fat_file.h"
+
+/* truncation of an open file to any length
+ *
+ * - shrinking ends the chain after the last cluster the new size needs and
+ *   releases the rest in one pass over the FAT (fat_release_chain), the
+ *   directory entry is written first so nothing on disk references the
+ *   released clusters - with fat_set_discard they are discarded as well.
+ *   in group commit mode the cut and the frees reach the disk after the
+ *   entry (step 3 of fat_sync, fat_commit.h)
+ * - growing allocates the clusters and zero-fills from the old end of file
+ * - every open handle of the file sees the new size, a position past the new
+ *   end moves to it. their entries, cursors and buffers change under the
+ *   exclusive volume lock only, so whatever reads a handle's entry holds
+ *   the volume lock as well (fat_pread64 keeps it from its snapshot to the
+ *   end of the read)
+ * - FAT_O_TRUNC truncates to 0 on open
+ */
+
+fat_error_t fat_ftruncate(fat_file_t *file, uint32_t length);
+
+// internal - caller holds the handle lock and the exclusive volume lock
+fat_error_t fat_truncate_file(fat_file_t *file, uint32_t length);
+
+#endif
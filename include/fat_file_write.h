@@ -4,6 +4,7 @@
 #include "fat_file.h"
 #include "fat_cluster.h"
 #include "fat_table.h"
+#include "fat_iovec.h"
 #include <stdlib.h>
 
 uint32_t fat_calculate_clusters_needed(fat_volume_t *volume, uint32_t file_size);
@@ -12,11 +13,43 @@ fat_error_t fat_find_last_cluster(fat_volume_t *volume,
                                   cluster_t start_cluster, 
                                   cluster_t *last_cluster);
 
+// last cluster and length of a chain (chain_clusters may be NULL)
+fat_error_t fat_find_chain_tail(fat_volume_t *volume, 
+                                cluster_t start_cluster, 
+                                cluster_t *last_cluster, 
+                                uint32_t *chain_clusters);
+
+// move the handle to end of file, O(1) when its cached tail is current
+fat_error_t fat_position_at_end(fat_file_t *file);
+
 fat_error_t fat_allocate_and_link_cluster(fat_volume_t *volume, 
                                           cluster_t prev_cluster, 
                                           cluster_t *new_cluster);
+fat_error_t fat_allocate_and_link_cluster_hint(fat_volume_t *volume, 
+                                               cluster_t prev_cluster, 
+                                               const fat_alloc_hint_t *hint, 
+                                               cluster_t *new_cluster);
+
+// goal: cluster to place the new clusters after (0: end of the chain, or
+// near the file's directory for a file without clusters)
+fat_error_t fat_extend_file(fat_file_t *file, uint32_t new_size, cluster_t goal);
 
-fat_error_t fat_extend_file(fat_file_t *file, uint32_t new_size);
+// write length bytes at offset into the physically contiguous clusters
+// starting at cluster - whole sectors go out in one request, only a partial
+// head or tail sector is read, modified and written back
+fat_error_t fat_write_cluster_run(fat_volume_t *volume, 
+                                  cluster_t cluster, 
+                                  uint32_t offset, 
+                                  const void *buffer, 
+                                  size_t length);
+
+// fat_write_cluster_run from the buffers at cursor, moved past the data -
+// with the device's writev_sectors one request covers the whole sectors
+fat_error_t fat_write_cluster_runv(fat_volume_t *volume, 
+                                   cluster_t cluster, 
+                                   uint32_t offset, 
+                                   fat_iov_cursor_t *cursor, 
+                                   size_t length);
 
 fat_error_t fat_write_cluster_data(fat_volume_t *volume, 
                                    cluster_t cluster, 
@@ -24,6 +57,30 @@ fat_error_t fat_write_cluster_data(fat_volume_t *volume,
                                    const void *buffer, 
                                    size_t length);
 
+// at most INT_MAX bytes per call, fat_write64 writes any size at once.
+// writes stop at FAT_MAX_FILE_SIZE
 int fat_write(fat_file_t *file, const void *buffer, size_t size);
 
+fat_ssize_t fat_write64(fat_file_t *file, const void *buffer, size_t size);
+
+// write iovcnt buffers in turn, gathered into one device request per
+// physically contiguous run where the device supports it
+fat_ssize_t fat_writev(fat_file_t *file, const fat_iovec_t *iov, int iovcnt);
+
+// write at offset without moving the handle's position, offset must not be
+// past the end of file
+fat_ssize_t fat_write_at(fat_file_t *file, 
+                         const void *buffer, 
+                         size_t size, 
+                         uint32_t offset);      // caller holds handle and volume lock
+int fat_pwrite(fat_file_t *file, 
+               const void *buffer, 
+               size_t size, 
+               uint32_t offset);
+
+fat_ssize_t fat_pwrite64(fat_file_t *file, 
+                         const void *buffer, 
+                         size_t size, 
+                         int64_t offset);
+
 #endif
\ No newline at end of file
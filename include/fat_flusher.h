@@ -0,0 +1,39 @@
+#ifndef FAT_FLUSHER_H
+#define FAT_FLUSHER_H
+
+#include "fat_types.h"
+#include "fat_volume.h"
+
+/* background write-back of metadata (FAT_THREAD_SAFE builds)
+ * - runs fat_sync() on a per-volume thread, foreground operations only
+ *   queue their changes (group commit is enabled while it runs)
+ * - the thread wakes every interval_ms and writes back once a threshold is
+ *   reached, operations crossing a threshold wake it early
+ * - buffered data of open handles (fat_file_buffer.h) goes out once it is
+ *   max_age_seconds old (every pass with 0), all of it when the handles
+ *   together hold max_dirty_bytes or a pass syncs. a handle busy in
+ *   another thread is skipped until the next pass
+ * - callers needing durability use fat_sync()
+ * - the volume must stay at the same address until fat_stop_flusher()
+ */
+
+typedef struct {
+    uint32_t interval_ms;               // wake-up period
+    uint32_t max_dirty_bytes;           // write back at this much pending metadata (0: no limit)
+    uint32_t max_age_seconds;           // write back changes this old (0: no limit)
+} fat_flusher_params_t;
+
+// FAT_ERR_NOT_SUPPORTED without thread support
+fat_error_t fat_start_flusher(fat_volume_t *volume,
+                              const fat_flusher_params_t *params);
+
+// stops the thread and writes back everything still pending
+fat_error_t fat_stop_flusher(fat_volume_t *volume);
+
+// pending changes reached the flusher thresholds (volume lock held)
+bool fat_flusher_due(fat_volume_t *volume);
+
+// write back without waiting for the next interval (volume lock held)
+void fat_flusher_wake(fat_volume_t *volume);
+
+#endif
@@ -0,0 +1,75 @@
+#ifndef FAT_INTENT_H
+#define FAT_INTENT_H
+
+#include "fat_types.h"
+#include "fat_volume.h"
+
+/* metadata intent log
+ *
+ * a reserved file (FAT_INTENT_LOG_PATH, read-only/hidden/system) holding the
+ * FAT and directory changes of one fat_sync() in group commit mode. the sync
+ * writes the changed byte runs to the log, commits them with a single header
+ * sector write and only then updates the FAT copies and directory sectors in
+ * place. fat_mount() replays a committed log, so a crash at any point leaves
+ * either the previous or the new metadata - never a mix.
+ *
+ * log layout, first sector is the header:
+ *  fat_intent_header_t | fat_intent_record_t + bytes | ... (following sectors)
+ *
+ * a sync that does not fit in the log falls back to the ordered sync
+ * documented in fat_commit.h.
+ */
+
+#define FAT_INTENT_LOG_PATH "/FATLOG.SYS"
+#define FAT_INTENT_DEFAULT_BYTES (64 * 1024)
+
+#define FAT_INTENT_AREA_FAT 1           // sector relative to the first FAT
+#define FAT_INTENT_AREA_DIR 2           // volume sector
+
+typedef struct {
+    uint8_t magic[8];                   // "FATILOG1"
+    uint32_t sequence;                  // transaction number
+    uint32_t record_bytes;              // 0: nothing to replay
+    uint32_t record_checksum;
+    uint32_t header_checksum;           // over the fields above
+} fat_intent_header_t;
+
+typedef struct {
+    uint8_t area;                       // FAT_INTENT_AREA_*
+    uint8_t reserved;
+    uint16_t offset;                    // byte offset in the sector
+    uint32_t sector;
+    uint16_t length;                    // bytes following the record
+    uint16_t reserved2;
+} fat_intent_record_t;
+
+// create (or reuse) the log file and route fat_sync() through it
+fat_error_t fat_enable_intent_log(fat_volume_t *volume, uint32_t log_bytes);
+
+// stop logging, the file is kept for the next fat_enable_intent_log()
+fat_error_t fat_disable_intent_log(fat_volume_t *volume);
+
+// apply a committed log (fat_mount)
+fat_error_t fat_replay_intent_log(fat_volume_t *volume);
+
+// transaction building, used by fat_sync() - volume lock held
+bool fat_intent_active(fat_volume_t *volume);
+
+void fat_intent_begin(fat_volume_t *volume);
+
+// record the byte runs that differ, false if the log is full
+bool fat_intent_add(fat_volume_t *volume,
+                    uint8_t area,
+                    uint32_t sector,
+                    const uint8_t *old_data,
+                    const uint8_t *new_data);
+
+// write the records and the header - the commit point
+fat_error_t fat_intent_commit(fat_volume_t *volume);
+
+// in place writes are done, nothing to replay
+fat_error_t fat_intent_checkpoint(fat_volume_t *volume);
+
+void fat_intent_release(fat_volume_t *volume);
+
+#endif
@@ -0,0 +1,47 @@
+#ifndef FAT_IOVEC_H
+#define FAT_IOVEC_H
+
+#include "fat_types.h"
+#include "fat_block_device.h"
+#include <stdlib.h>
+
+/* position in a caller's buffer list (fat_readv, fat_writev)
+ *
+ * - single buffer transfers (fat_read, fat_write) use a list of one
+ * - empty buffers are skipped, iov[0] has bytes left unless count is 0
+ */
+
+typedef struct{
+    const fat_iovec_t *iov;
+    int count;                      // buffers from iov on
+    size_t offset;                  // bytes of iov[0] already used
+} fat_iov_cursor_t;
+
+// false if a buffer is NULL, count is not positive or the sum overflows
+bool fat_iov_total(const fat_iovec_t *iov, int count, size_t *total);
+
+void fat_iov_init(fat_iov_cursor_t *cursor, const fat_iovec_t *iov, int count);
+
+// contiguous bytes at the cursor
+static inline uint8_t *fat_iov_base(const fat_iov_cursor_t *cursor){
+    return (uint8_t *)cursor->iov[0].base + cursor->offset;
+}
+
+static inline size_t fat_iov_span(const fat_iov_cursor_t *cursor){
+    return (cursor->count > 0) ? cursor->iov[0].length - cursor->offset : 0;
+}
+
+void fat_iov_advance(fat_iov_cursor_t *cursor, size_t length);
+
+// copy between the buffers and one flat area, moving the cursor
+void fat_iov_copy_out(fat_iov_cursor_t *cursor, const void *data, size_t length);
+void fat_iov_copy_in(fat_iov_cursor_t *cursor, void *data, size_t length);
+
+// list of the buffer pieces covering the next length bytes (for
+// readv_sectors / writev_sectors), cursor unchanged - free() the slice
+fat_error_t fat_iov_slice(const fat_iov_cursor_t *cursor,
+                          size_t length,
+                          fat_iovec_t **slice,
+                          int *count);
+
+#endif
@@ -12,6 +12,22 @@ fat_error_t fat_parse_lfn(const fat_lfn_entry_t *lfn_entry,
 
 uint8_t fat_calculate_lfn_checksum(const uint8_t *short_name);
 
+// length UTF-16 units to NUL-terminated UTF-8, unpaired surrogates become
+// '?' and a character that does not fit ends the output
+// bytes written without the NUL
+size_t fat_utf16_to_utf8(const uint16_t *utf16, 
+                         size_t length, 
+                         char *output, 
+                         size_t output_size);
+
+// NUL-terminated UTF-8 to at most capacity UTF-16 units (output NULL: count
+// only), *length receives the unit count
+// FAT_ERR_INVALID_PARAM: malformed UTF-8 or more than capacity units
+fat_error_t fat_utf8_to_utf16(const char *utf8, 
+                              uint16_t *output, 
+                              size_t capacity, 
+                              size_t *length);
+
 fat_error_t fat_read_lfn_sequence(fat_volume_t *volume, 
                                   uint32_t dir_cluster, 
                                   uint32_t *entry_index, 
@@ -19,6 +35,14 @@ fat_error_t fat_read_lfn_sequence(fat_volume_t *volume,
                                   size_t buffer_size, 
                                   uint8_t expected_checksum);
 
+// loc points at the short entry, on success at the first LFN entry
+fat_error_t fat_read_lfn_sequence_at(fat_volume_t *volume, 
+                                     uint32_t dir_cluster, 
+                                     fat_dir_loc_t *loc, 
+                                     char *filename_buffer, 
+                                     size_t buffer_size, 
+                                     uint8_t expected_checksum);
+
 fat_error_t fat_create_lfn_entries (const char *long_name, 
                                     const uint8_t *short_name,
                                     fat_lfn_entry_t *lfn_entries, 
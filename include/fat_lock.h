@@ -0,0 +1,57 @@
+#ifndef FAT_LOCK_H
+#define FAT_LOCK_H
+
+#include "fat_types.h"
+#include "fat_volume.h"
+#include "fat_file.h"
+
+/* locking (FAT_THREAD_SAFE builds, make THREADS=1 - no-ops otherwise)
+ *
+ * volume lock - reader-writer, taken by the public entry points
+ * - shared: path lookup, read, seek, directory listing and writes inside
+ *   the clusters a file already owns - FAT pages, directory sectors and
+ *   pending metadata are only read, readers of different files never wait
+ *   for each other
+ * - exclusive: anything changing the FAT, directory entries, the open file
+ *   list or group commit state (create, unlink, mkdir, rmdir, open, close,
+ *   growing writes, sync) - this also serializes entry mutation per directory
+ * - nests per thread, a nested request runs in the mode already held. a
+ *   thread holding the lock shared must not ask for it exclusively
+ *
+ * file lock - per handle, protects position and cached entry of one handle,
+ * always taken before the volume lock. directory handles (fat_dir_t) are
+ * not locked, use each one from a single thread at a time
+ *
+ * extent lock - per handle, protects the handle's extent map (fat_extent.h)
+ * so positional reads and writes share it without the file lock. taken
+ * last, after the volume lock, and held only around map lookups
+ */
+
+fat_error_t fat_lock_init(fat_volume_t *volume);
+
+void fat_lock_destroy(fat_volume_t *volume);
+
+void fat_lock_volume(fat_volume_t *volume);
+
+void fat_lock_volume_shared(fat_volume_t *volume);
+
+// releases either mode
+void fat_unlock_volume(fat_volume_t *volume);
+
+fat_error_t fat_lock_file_init(fat_file_t *file);
+
+void fat_lock_file_destroy(fat_file_t *file);
+
+void fat_lock_file(fat_file_t *file);
+
+void fat_unlock_file(fat_file_t *file);
+
+// false if another thread holds the file lock - lets a thread that holds
+// the volume lock take a file lock against the usual order
+bool fat_trylock_file(fat_file_t *file);
+
+void fat_lock_extents(fat_file_t *file);
+
+void fat_unlock_extents(fat_file_t *file);
+
+#endif
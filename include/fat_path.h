@@ -17,11 +17,17 @@ fat_error_t fat_resolve_path(fat_volume_t *volume,
                              cluster_t *parent_cluster, 
                              uint32_t *entry_index);
 
+fat_error_t fat_resolve_path_loc(fat_volume_t *volume, 
+                                 const char *path, 
+                                 fat_dir_entry_t *entry, 
+                                 cluster_t *parent_cluster, 
+                                 fat_dir_loc_t *loc);
+
 fat_error_t fat_find_in_directory(fat_volume_t *volume, 
                                   cluster_t dir_cluster, 
                                   const char *component, 
                                   fat_dir_entry_t *entry, 
-                                  uint32_t *entry_index);
+                                  fat_dir_loc_t *loc);
 
 bool fat_validate_component(const char *component);
 
@@ -12,4 +12,10 @@ fat_error_t fat_write_entry(fat_volume_t *volume,
                             cluster_t cluster, 
                             uint32_t value);
 
+// copy raw bytes into the FAT cache for the next flush (log replay)
+fat_error_t fat_write_table_bytes(fat_volume_t *volume, 
+                                  uint32_t byte_offset, 
+                                  const void *data, 
+                                  uint32_t length);
+
 #endif
\ No newline at end of file
@@ -15,6 +15,12 @@ typedef enum {
 // represent cluster numbers
 typedef uint32_t cluster_t;
 
+// bytes transferred or -fat_error_t, 64-bit file API (fat_read64, ...)
+typedef int64_t fat_ssize_t;
+
+// largest FAT file: the directory entry holds a 32-bit size
+#define FAT_MAX_FILE_SIZE UINT32_MAX
+
 // FAT Entry markers: 0x0000 means cluster is available for allocation
 #define FAT_FREE 0x0000
 
@@ -80,7 +86,11 @@ typedef enum {
     FAT_ERR_READ_ONLY,              // write on rd-only file / volume attempted
 
     // file operation errors
-    FAT_ERR_EOF                     // read beyond end of file attempted
+    FAT_ERR_EOF,                    // read beyond end of file attempted
+
+    // build configuration errors
+    FAT_ERR_NOT_SUPPORTED           // feature not compiled in (FAT_THREAD_SAFE)
+                                    // or not offered by the device
 } fat_error_t;
 
 // boot sector signature: magic number at bytes 510-511 validate boot sector
@@ -102,5 +112,6 @@ typedef enum {
 #define FAT_O_RDWR 0x03     // read and write
 #define FAT_O_CREATE 0x04   // create file if it doesn't exist
 #define FAT_O_TRUNC 0x08    // truncate file to 0 length on open
+#define FAT_O_APPEND 0x10   // every write goes to the end of file
 
 #endif
\ No newline at end of file
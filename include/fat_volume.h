@@ -39,10 +39,51 @@ typedef struct{
     uint8_t *fat_cache;                 // pointer to the allocated FAT buffer
     uint32_t fat_cache_size;            // size in bytes
     bool fat_dirty;
+    uint8_t *fat_dirty_map;             // one bit per FAT sector
+    uint32_t fat_dirty_sectors;         // bits set in fat_dirty_map
+
+    // per-group free space summaries, built on first allocation
+    // (fat_alloc_group.h)
+    struct fat_alloc_groups *alloc_groups;
+
+    // allocation policy (a fat_alloc_policy_t) and next-fit cursor
+    // (fat_alloc_policy.h)
+    uint32_t alloc_policy;
+    cluster_t alloc_cursor;
+
+    // discard clusters released by truncation, if the device supports it
+    // (fat_set_discard)
+    bool discard;
+
+    // group commit state, NULL in write-through mode (fat_commit.h)
+    struct fat_commit *commit;
+
+    // metadata intent log, NULL when not enabled (fat_intent.h)
+    struct fat_intent_log *intent;
+
+    // volume lock and background flusher, FAT_THREAD_SAFE builds only
+    // (fat_lock.h, fat_flusher.h)
+    struct fat_volume_lock *lock;
+    struct fat_flusher *flusher;
+
+    // cached free-slot maps of recently used directories (fat_dir_slots.h)
+    struct fat_dir_slot_map *dir_slot_maps;
+
+    // open file handles (fat_file.h)
+    struct fat_file *open_files;
 } fat_volume_t;
 
+static inline bool fat_sector_dirty(const fat_volume_t *volume, uint32_t sector){
+    return (volume->fat_dirty_map[sector / 8] >> (sector % 8)) & 1;
+}
+
 fat_error_t fat_mount(fat_block_device_t *device, fat_volume_t *volume);
 fat_error_t fat_flush(fat_volume_t *volume);
 fat_error_t fat_unmount(fat_volume_t *volume);
 
+// tell the device about clusters a truncation releases (off by default) -
+// write-through mode only, in group commit mode they stay referenced on disk
+// until the sync
+fat_error_t fat_set_discard(fat_volume_t *volume, bool enable);
+
 #endif
\ No newline at end of file
@@ -0,0 +1,173 @@
+#include "fat_alloc_group.h"
+#include "fat_table.h"
+#include <stdlib.h>
+
+static inline uint32_t fat_group_of(cluster_t cluster){
+    return (cluster - FAT_FIRST_VALID_CLUSTER) / FAT_ALLOC_GROUP_CLUSTERS;
+}
+
+static inline cluster_t fat_group_start(uint32_t group){
+    return FAT_FIRST_VALID_CLUSTER + group * FAT_ALLOC_GROUP_CLUSTERS;
+}
+
+static inline cluster_t fat_group_end(fat_volume_t *volume, uint32_t group){
+    cluster_t end = fat_group_start(group) + FAT_ALLOC_GROUP_CLUSTERS;
+    cluster_t last = FAT_FIRST_VALID_CLUSTER + volume->total_clusters;
+    return (end < last) ? end : last;
+}
+
+fat_error_t fat_alloc_groups_build(fat_volume_t *volume){
+
+    // parameter validation
+    if(!volume){
+        return FAT_ERR_INVALID_PARAM;
+    }
+
+    fat_alloc_groups_free(volume);
+
+    fat_alloc_groups_t *alloc = calloc(1, sizeof(fat_alloc_groups_t));
+    if(!alloc){
+        return FAT_ERR_NO_MEMORY;
+    }
+
+    alloc->count = (volume->total_clusters + FAT_ALLOC_GROUP_CLUSTERS - 1) / 
+                   FAT_ALLOC_GROUP_CLUSTERS;
+    alloc->groups = calloc(alloc->count ? alloc->count : 1, 
+                           sizeof(fat_alloc_group_t));
+    if(!alloc->groups){
+        free(alloc);
+        return FAT_ERR_NO_MEMORY;
+    }
+
+    // one pass over the cached FAT
+    for(uint32_t g = 0; g < alloc->count; g++){
+        alloc->groups[g].next = fat_group_start(g);
+        for(cluster_t c = fat_group_start(g); c < fat_group_end(volume, g); c++){
+            uint32_t value;
+            if(fat_read_entry(volume, c, &value) == FAT_OK && value == FAT_FREE){
+                alloc->groups[g].free++;
+            }
+        }
+    }
+
+    volume->alloc_groups = alloc;
+    return FAT_OK;
+}
+
+void fat_alloc_groups_free(fat_volume_t *volume){
+
+    // parameter validation
+    if(!volume || !volume->alloc_groups){
+        return;
+    }
+
+    free(volume->alloc_groups->groups);
+    free(volume->alloc_groups);
+    volume->alloc_groups = NULL;
+}
+
+void fat_alloc_groups_update(fat_volume_t *volume, 
+                             cluster_t cluster, 
+                             uint32_t old_value, 
+                             uint32_t new_value){
+
+    // parameter validation
+    if(!volume || !volume->alloc_groups){
+        return;
+    }
+
+    fat_alloc_group_t *group = &volume->alloc_groups->groups[fat_group_of(cluster)];
+    if(old_value == FAT_FREE && new_value != FAT_FREE){
+        group->free--;
+    } else if(old_value != FAT_FREE && new_value == FAT_FREE){
+        group->free++;
+    }
+}
+
+// next free cluster of group g at or after start, wrapping inside the group
+static bool fat_group_scan(fat_volume_t *volume, 
+                           uint32_t g, 
+                           cluster_t start, 
+                           cluster_t *cluster){
+
+    cluster_t first = fat_group_start(g);
+    cluster_t end = fat_group_end(volume, g);
+    if(start < first || start >= end){
+        start = first;
+    }
+
+    cluster_t c = start;
+    do {
+        uint32_t value;
+        if(fat_read_entry(volume, c, &value) == FAT_OK && value == FAT_FREE){
+            *cluster = c;
+            return true;
+        }
+        c = (c + 1 < end) ? c + 1 : first;
+    } while(c != start);
+
+    return false;
+}
+
+fat_error_t fat_alloc_groups_find(fat_volume_t *volume, 
+                                  cluster_t goal, 
+                                  cluster_t *cluster){
+
+    // parameter validation
+    if(!volume || !cluster){
+        return FAT_ERR_INVALID_PARAM;
+    }
+
+    if(!volume->alloc_groups){
+        fat_error_t err = fat_alloc_groups_build(volume);
+        if(err != FAT_OK){
+            return err;
+        }
+    }
+
+    fat_alloc_groups_t *alloc = volume->alloc_groups;
+    if(alloc->count == 0){
+        return FAT_ERR_DISK_FULL;
+    }
+
+    uint32_t first_group;
+    cluster_t start;
+    bool valid_goal = goal >= FAT_FIRST_VALID_CLUSTER && 
+                      goal < FAT_FIRST_VALID_CLUSTER + volume->total_clusters;
+
+    if(valid_goal){
+        // grow in place - right after the goal
+        first_group = fat_group_of(goal);
+        start = goal;
+    } else {
+        // new chain - emptiest group, ties rotate
+        first_group = alloc->rotor % alloc->count;
+        for(uint32_t i = 1; i < alloc->count; i++){
+            uint32_t g = (alloc->rotor + i) % alloc->count;
+            if(alloc->groups[g].free > alloc->groups[first_group].free){
+                first_group = g;
+            }
+        }
+        alloc->rotor = first_group + 1;
+        start = alloc->groups[first_group].next;
+    }
+
+    // own group first, then spill over to the following groups
+    for(uint32_t i = 0; i < alloc->count; i++){
+        uint32_t g = (first_group + i) % alloc->count;
+        fat_alloc_group_t *group = &alloc->groups[g];
+        if(group->free == 0){
+            continue;
+        }
+
+        if(fat_group_scan(volume, g, (i == 0) ? start : group->next, cluster)){
+            group->next = *cluster + 1;
+            return FAT_OK;
+        }
+
+        // summary out of step with the FAT - fix it, keep looking
+        group->free = 0;
+    }
+
+    return FAT_ERR_DISK_FULL;
+}
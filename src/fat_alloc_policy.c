@@ -0,0 +1,148 @@
+#include "fat_alloc_policy.h"
+#include "fat_alloc_group.h"
+#include "fat_table.h"
+#include "fat_lock.h"
+
+static inline bool fat_alloc_valid(fat_volume_t *volume, cluster_t cluster){
+    return cluster >= FAT_FIRST_VALID_CLUSTER && 
+           cluster < FAT_FIRST_VALID_CLUSTER + volume->total_clusters;
+}
+
+static inline bool fat_alloc_is_free(fat_volume_t *volume, cluster_t cluster){
+    uint32_t value;
+    return fat_read_entry(volume, cluster, &value) == FAT_OK && 
+           value == FAT_FREE;
+}
+
+// first free cluster at or after start, wrapping at the end of the volume
+static fat_error_t fat_alloc_scan(fat_volume_t *volume, 
+                                  cluster_t start, 
+                                  cluster_t *cluster){
+
+    if(!fat_alloc_valid(volume, start)){
+        start = FAT_FIRST_VALID_CLUSTER;
+    }
+
+    cluster_t end = FAT_FIRST_VALID_CLUSTER + volume->total_clusters;
+    cluster_t current = start;
+    for(uint32_t i = 0; i < volume->total_clusters; i++){
+        if(fat_alloc_is_free(volume, current)){
+            *cluster = current;
+            return FAT_OK;
+        }
+        current = (current + 1 < end) ? current + 1 : FAT_FIRST_VALID_CLUSTER;
+    }
+
+    return FAT_ERR_DISK_FULL;
+}
+
+// start of the smallest free run of at least count clusters, else the longest
+static fat_error_t fat_alloc_best_run(fat_volume_t *volume, 
+                                      uint32_t count, 
+                                      cluster_t *cluster){
+
+    cluster_t end = FAT_FIRST_VALID_CLUSTER + volume->total_clusters;
+    cluster_t best = 0;
+    uint32_t best_length = 0;
+    cluster_t longest = 0;
+    uint32_t longest_length = 0;
+
+    cluster_t current = FAT_FIRST_VALID_CLUSTER;
+    while(current < end){
+        if(!fat_alloc_is_free(volume, current)){
+            current++;
+            continue;
+        }
+
+        cluster_t run_start = current;
+        while(current < end && fat_alloc_is_free(volume, current)){
+            current++;
+        }
+        uint32_t length = current - run_start;
+
+        if(length >= count && (best_length == 0 || length < best_length)){
+            best = run_start;
+            best_length = length;
+            if(length == count){
+                break; // exact fit
+            }
+        }
+        if(length > longest_length){
+            longest = run_start;
+            longest_length = length;
+        }
+    }
+
+    if(best_length != 0){
+        *cluster = best;
+        return FAT_OK;
+    }
+    if(longest_length != 0){
+        *cluster = longest;
+        return FAT_OK;
+    }
+    return FAT_ERR_DISK_FULL;
+}
+
+fat_error_t fat_set_alloc_policy(fat_volume_t *volume, fat_alloc_policy_t policy){
+
+    // parameter validation
+    if(!volume){
+        return FAT_ERR_INVALID_PARAM;
+    }
+
+    switch(policy){
+        case FAT_ALLOC_GROUPS:
+        case FAT_ALLOC_NEXT_FIT:
+        case FAT_ALLOC_BEST_FIT:
+        case FAT_ALLOC_PARENT:
+            break;
+        default:
+            return FAT_ERR_INVALID_PARAM;
+    }
+
+    fat_lock_volume(volume);
+    volume->alloc_policy = policy;
+    fat_unlock_volume(volume);
+    return FAT_OK;
+}
+
+fat_error_t fat_alloc_find(fat_volume_t *volume, 
+                           const fat_alloc_hint_t *hint, 
+                           cluster_t *cluster){
+
+    // parameter validation
+    if(!volume || !hint || !cluster){
+        return FAT_ERR_INVALID_PARAM;
+    }
+
+    cluster_t goal = fat_alloc_valid(volume, hint->goal) ? hint->goal : 0;
+
+    // extend in place whatever the policy
+    if(goal != 0 && fat_alloc_valid(volume, goal + 1) && 
+       fat_alloc_is_free(volume, goal + 1)){
+        *cluster = goal + 1;
+        return FAT_OK;
+    }
+
+    fat_error_t err;
+    switch(volume->alloc_policy){
+        case FAT_ALLOC_NEXT_FIT:
+            err = fat_alloc_scan(volume, volume->alloc_cursor, cluster);
+            if(err == FAT_OK){
+                volume->alloc_cursor = *cluster + 1;
+            }
+            return err;
+
+        case FAT_ALLOC_BEST_FIT:
+            return fat_alloc_best_run(volume, hint->count ? hint->count : 1, 
+                                      cluster);
+
+        case FAT_ALLOC_PARENT:
+            return fat_alloc_scan(volume, goal ? goal : hint->parent, cluster);
+
+        case FAT_ALLOC_GROUPS:
+        default:
+            return fat_alloc_groups_find(volume, goal, cluster);
+    }
+}
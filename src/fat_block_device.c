@@ -1,9 +1,28 @@
 // file based block device
+#if defined(__linux__)
+#define _GNU_SOURCE                 // preadv, pwritev, fileno, copy_file_range
+#define FAT_FILE_VECTORED
+#define FAT_FILE_COPY_RANGE
+#elif defined(__FreeBSD__) || defined(__NetBSD__)
+#define _DEFAULT_SOURCE             // preadv, pwritev, fileno
+#define FAT_FILE_VECTORED
+#endif
+
 #include "fat_block_device.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
+#ifdef FAT_FILE_VECTORED
+#include <stdbool.h>
+#include <sys/uio.h>
+#endif
+
+#ifdef FAT_FILE_COPY_RANGE
+#include <errno.h>
+#include <unistd.h>
+#endif
+
 // file based block device
 
 typedef struct {
@@ -20,12 +39,23 @@ static int file_read_sectors(void *device,
     file_block_device_t *dev = (file_block_device_t*) device;
 
     // seek sector position
-    if(fseek(dev->file, sector * dev->sector_size, SEEK_SET) != 0){
+    if(fseek(dev->file, (long)sector * dev->sector_size, SEEK_SET) != 0){
         return -1;
     }
 
     size_t bytes_read = fread(buffer, dev->sector_size, count, dev->file);
-    return (bytes_read == count) ? 0 : -1;
+    if(bytes_read == count){
+        return 0;
+    }
+
+    // past the end of a short image - zeros, as the sectors were never written
+    if(!feof(dev->file) || sector + count > dev->sector_count){
+        return -1;
+    }
+    clearerr(dev->file);
+    memset((uint8_t*)buffer + bytes_read * dev->sector_size, 0, 
+           (size_t)(count - bytes_read) * dev->sector_size);
+    return 0;
 }
 
 static int file_write_sectors(void *device, 
@@ -36,7 +66,7 @@ static int file_write_sectors(void *device,
     file_block_device_t *dev = (file_block_device_t*)device;
 
     // seek sector position
-    if(fseek(dev->file, sector * dev->sector_size, SEEK_SET) != 0){
+    if(fseek(dev->file, (long)sector * dev->sector_size, SEEK_SET) != 0){
         return -1;
     }
 
@@ -45,6 +75,162 @@ static int file_write_sectors(void *device,
     return (bytes_written == count) ? 0 : -1;
 }
 
+#ifdef FAT_FILE_VECTORED
+
+// fat_iovec_t passed to preadv / pwritev in batches of this many buffers
+#define FILE_IOV_BATCH 64
+
+static int file_transfer_vector(file_block_device_t *dev, 
+                                uint32_t sector, 
+                                uint32_t count, 
+                                const fat_iovec_t *iov, 
+                                int iovcnt, 
+                                bool write){
+
+    // the stream is unbuffered (fat_block_device_file_create), stdio holds
+    // no copy of the image the fd would bypass
+    int fd = fileno(dev->file);
+    off_t position = (off_t)sector * dev->sector_size;
+    off_t end = position + (off_t)count * dev->sector_size;
+    struct iovec batch[FILE_IOV_BATCH];
+    int next = 0;                   // first buffer not yet in a batch
+    size_t skip = 0;                // bytes of iov[next] already transferred
+
+    while(position < end && next < iovcnt){
+        int n = 0;
+        for(int i = next; i < iovcnt && n < FILE_IOV_BATCH; i++){
+            size_t used = (i == next) ? skip : 0;
+            batch[n].iov_base = (uint8_t *)iov[i].base + used;
+            batch[n].iov_len = iov[i].length - used;
+            n++;
+        }
+
+        ssize_t done = write ? pwritev(fd, batch, n, position) :
+                               preadv(fd, batch, n, position);
+
+        // read past the end of a short image - the rest are zeros
+        if(done == 0 && !write && sector + count <= dev->sector_count){
+            for(int i = 0; i < n; i++){
+                memset(batch[i].iov_base, 0, batch[i].iov_len);
+            }
+            for(int i = next + n; i < iovcnt; i++){
+                memset(iov[i].base, 0, iov[i].length);
+            }
+            return 0;
+        }
+        if(done <= 0){
+            return -1;
+        }
+        position += done;
+
+        // short transfers continue where they stopped
+        while(done > 0){
+            size_t left = iov[next].length - skip;
+            if((size_t)done < left){
+                skip += (size_t)done;
+                break;
+            }
+            done -= (ssize_t)left;
+            next++;
+            skip = 0;
+        }
+    }
+
+    return (position == end) ? 0 : -1;
+}
+
+static int file_readv_sectors(void *device, 
+                              uint32_t sector, 
+                              uint32_t count, 
+                              const fat_iovec_t *iov, 
+                              int iovcnt){
+    return file_transfer_vector((file_block_device_t*)device, sector, count, 
+                                iov, iovcnt, false);
+}
+
+static int file_writev_sectors(void *device, 
+                               uint32_t sector, 
+                               uint32_t count, 
+                               const fat_iovec_t *iov, 
+                               int iovcnt){
+    return file_transfer_vector((file_block_device_t*)device, sector, count, 
+                                iov, iovcnt, true);
+}
+
+#endif
+
+#ifdef FAT_FILE_COPY_RANGE
+
+// bytes moved per pread / pwrite where the kernel cannot copy in place
+#define FILE_COPY_CHUNK (256 * 1024)
+
+static int file_copy_bounce(int fd, off_t source, off_t target, off_t length){
+
+    size_t chunk = (length < FILE_COPY_CHUNK) ? (size_t)length : 
+                                                FILE_COPY_CHUNK;
+    uint8_t *buffer = malloc(chunk);
+    if(!buffer){
+        return -1;
+    }
+
+    int result = 0;
+    while(length > 0){
+        size_t step = (length < (off_t)chunk) ? (size_t)length : chunk;
+        ssize_t got = pread(fd, buffer, step, source);
+        if(got < 0){
+            result = -1;
+            break;
+        }
+
+        // past the end of a short image - zeros
+        memset(&buffer[got], 0, step - (size_t)got);
+
+        if(pwrite(fd, buffer, step, target) != (ssize_t)step){
+            result = -1;
+            break;
+        }
+        source += (off_t)step;
+        target += (off_t)step;
+        length -= (off_t)step;
+    }
+
+    free(buffer);
+    return result;
+}
+
+// the kernel copies inside the image file, sharing blocks where the file
+// system supports it
+static int file_copy_sectors(void *device, 
+                             uint32_t source, 
+                             uint32_t target, 
+                             uint32_t count){
+
+    file_block_device_t *dev = (file_block_device_t*)device;
+
+    int fd = fileno(dev->file);
+    off_t in = (off_t)source * dev->sector_size;
+    off_t out = (off_t)target * dev->sector_size;
+    off_t left = (off_t)count * dev->sector_size;
+
+    while(left > 0){
+        ssize_t done = copy_file_range(fd, &in, fd, &out, (size_t)left, 0);
+
+        // 0: source past the end of a short image
+        if(done == 0 || (done < 0 && (errno == ENOSYS || errno == EXDEV || 
+                                      errno == EINVAL || errno == EOPNOTSUPP))){
+            return file_copy_bounce(fd, in, out, left);
+        }
+        if(done < 0){
+            return -1;
+        }
+        left -= done;
+    }
+
+    return 0;
+}
+
+#endif
+
 static int file_get_sector_count(void *device, uint32_t *sector_count){
 
     file_block_device_t *dev = (file_block_device_t*)device;
@@ -72,6 +258,12 @@ fat_block_device_t * fat_block_device_file_create(const char *filename,
         dev->file = fopen(filename, "w+b");
     }
 
+    // unbuffered - vectored and in-place copies go through the descriptor,
+    // a stdio buffer would serve stale sectors after them
+    if(dev->file){
+        setvbuf(dev->file, NULL, _IONBF, 0);
+    }
+
     dev->sector_count = sector_count;
     dev->sector_size = FAT_SECTOR_SIZE;
 
@@ -80,6 +272,19 @@ fat_block_device_t * fat_block_device_file_create(const char *filename,
     block_dev->write_sectors = file_write_sectors;
     block_dev->get_sector_count = file_get_sector_count;
     block_dev->get_sector_size = file_get_sector_size;
+    block_dev->discard_sectors = NULL;
+#ifdef FAT_FILE_COPY_RANGE
+    block_dev->copy_sectors = file_copy_sectors;
+#else
+    block_dev->copy_sectors = NULL;
+#endif
+#ifdef FAT_FILE_VECTORED
+    block_dev->readv_sectors = file_readv_sectors;
+    block_dev->writev_sectors = file_writev_sectors;
+#else
+    block_dev->readv_sectors = NULL;
+    block_dev->writev_sectors = NULL;
+#endif
     block_dev->device_data = dev;
 
     return block_dev;
@@ -128,6 +333,90 @@ static int memory_write_sectors(void *device,
     return 0;
 }
 
+static int memory_readv_sectors(void *device, 
+                                uint32_t sector, 
+                                uint32_t count, 
+                                const fat_iovec_t *iov, 
+                                int iovcnt){
+
+    memory_block_device_t *dev = (memory_block_device_t*)device;
+
+    if(sector + count > dev->sector_count){
+        return -1;
+    }
+
+    const uint8_t *source = dev->memory + (sector * dev->sector_size);
+    size_t remaining = (size_t)count * dev->sector_size;
+    for(int i = 0; i < iovcnt && remaining > 0; i++){
+        size_t length = (iov[i].length < remaining) ? iov[i].length : remaining;
+        memcpy(iov[i].base, source, length);
+        source += length;
+        remaining -= length;
+    }
+
+    return (remaining == 0) ? 0 : -1;
+}
+
+static int memory_writev_sectors(void *device, 
+                                 uint32_t sector, 
+                                 uint32_t count, 
+                                 const fat_iovec_t *iov, 
+                                 int iovcnt){
+
+    memory_block_device_t *dev = (memory_block_device_t*)device;
+
+    if(sector + count > dev->sector_count){
+        return -1;
+    }
+
+    uint8_t *target = dev->memory + (sector * dev->sector_size);
+    size_t remaining = (size_t)count * dev->sector_size;
+    for(int i = 0; i < iovcnt && remaining > 0; i++){
+        size_t length = (iov[i].length < remaining) ? iov[i].length : remaining;
+        memcpy(target, iov[i].base, length);
+        target += length;
+        remaining -= length;
+    }
+
+    return (remaining == 0) ? 0 : -1;
+}
+
+// discarded sectors read back as zeros
+static int memory_discard_sectors(void *device, 
+                                  uint32_t sector, 
+                                  uint32_t count){
+
+    memory_block_device_t *dev = (memory_block_device_t*)device;
+
+    if(sector + count > dev->sector_count){
+        return -1;
+    }
+
+    memset(dev->memory + (sector * dev->sector_size), 
+           0, 
+           count * dev->sector_size);
+
+    return 0;
+}
+
+static int memory_copy_sectors(void *device, 
+                               uint32_t source, 
+                               uint32_t target, 
+                               uint32_t count){
+
+    memory_block_device_t *dev = (memory_block_device_t*)device;
+
+    if(source + count > dev->sector_count || target + count > dev->sector_count){
+        return -1;
+    }
+
+    memmove(dev->memory + (target * dev->sector_size), 
+            dev->memory + (source * dev->sector_size), 
+            count * dev->sector_size);
+
+    return 0;
+}
+
 static int memory_get_sector_count(void* device, uint32_t *sector_count){
 
     memory_block_device_t *dev = (memory_block_device_t*)device;
@@ -155,6 +444,10 @@ fat_block_device_t *fat_block_device_memory_create(uint32_t sector_count){
     block_dev->write_sectors = memory_write_sectors;
     block_dev->get_sector_count = memory_get_sector_count;
     block_dev->get_sector_size = memory_get_sector_size;
+    block_dev->discard_sectors = memory_discard_sectors;
+    block_dev->copy_sectors = memory_copy_sectors;
+    block_dev->readv_sectors = memory_readv_sectors;
+    block_dev->writev_sectors = memory_writev_sectors;
     block_dev->device_data = dev;
 
     return block_dev;
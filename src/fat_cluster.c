@@ -1,5 +1,7 @@
 #include "fat_cluster.h"
 #include "fat_table.h"
+#include "fat_root.h"
+#include <stddef.h>
 
 fat_error_t fat_get_next_cluster(fat_volume_t *volume, 
                                  cluster_t cluster, 
@@ -51,62 +53,198 @@ bool fat_is_bad(fat_volume_t *volume, uint32_t value){
     }
 }
 
-fat_error_t fat_allocate_cluster(fat_volume_t *volume, cluster_t *cluster){
+uint32_t fat_get_eoc_marker(fat_volume_t *volume){
+
+    switch(volume->type){
+        case FAT_TYPE_FAT12:
+            return FAT12_EOC;
+        case FAT_TYPE_FAT16:
+            return FAT16_EOC;
+        case FAT_TYPE_FAT32:
+            return FAT32_EOC;
+        default:
+            return 0;
+    }
+}
+
+fat_error_t fat_contiguous_clusters(fat_volume_t *volume, 
+                                    cluster_t cluster, 
+                                    uint32_t max_clusters, 
+                                    uint32_t *count){
 
     // parameter validation
-    if(!volume || !cluster){
+    if(!volume || !count || max_clusters == 0){
         return FAT_ERR_INVALID_PARAM;
     }
 
-    // search for free cluster
+    uint32_t run = 1;
+    while(run < max_clusters){
+        cluster_t next;
+        fat_error_t err = fat_get_next_cluster(volume, cluster, &next);
+        if(err != FAT_OK){
+            return err;
+        }
+        if(next != cluster + 1){
+            break;
+        }
+        cluster = next;
+        run++;
+    }
+
+    *count = run;
+    return FAT_OK;
+}
+
+fat_error_t fat_allocate_cluster(fat_volume_t *volume, 
+                                 cluster_t goal, 
+                                 cluster_t *cluster){
+    fat_alloc_hint_t hint = { goal, 0, 1 };
+    return fat_allocate_cluster_hint(volume, &hint, cluster);
+}
+
+fat_error_t fat_allocate_cluster_hint(fat_volume_t *volume, 
+                                      const fat_alloc_hint_t *hint, 
+                                      cluster_t *cluster){
+
+    // parameter validation
+    if(!volume || !hint || !cluster){
+        return FAT_ERR_INVALID_PARAM;
+    }
+
+    uint32_t eoc_marker = fat_get_eoc_marker(volume);
+    if(eoc_marker == 0){
+        return FAT_ERR_UNSUPPORTED_FAT_TYPE;
+    }
+
+    // let the volume's policy pick a free cluster
+    cluster_t free_cluster;
+    fat_error_t err = fat_alloc_find(volume, hint, &free_cluster);
+    if(err != FAT_OK){
+        return err;
+    }
+
+    // allocate cluster: mark as EOC
+    err = fat_write_entry(volume, free_cluster, eoc_marker);
+    if(err != FAT_OK){
+        return err;
+    }
+
+    *cluster = free_cluster;
+    return FAT_OK;
+}
+
+fat_error_t fat_allocate_chain(fat_volume_t *volume, 
+                               cluster_t goal, 
+                               uint32_t count, 
+                               cluster_t *first_cluster){
+
+    // parameter validation
+    if(!volume || !first_cluster || count == 0){
+        return FAT_ERR_INVALID_PARAM;
+    }
+
+    uint32_t eoc_marker = fat_get_eoc_marker(volume);
+    if(eoc_marker == 0){
+        return FAT_ERR_UNSUPPORTED_FAT_TYPE;
+    }
+
     cluster_t FAT_LAST_VALID_CLUSTER = FAT_FIRST_VALID_CLUSTER + 
                                        volume->total_clusters;
-    
-    for(cluster_t current_cluster = FAT_FIRST_VALID_CLUSTER; 
-        current_cluster < FAT_LAST_VALID_CLUSTER; 
-        current_cluster++){
-        
+    if(goal < FAT_FIRST_VALID_CLUSTER || goal >= FAT_LAST_VALID_CLUSTER){
+        goal = FAT_FIRST_VALID_CLUSTER;
+    }
+
+    // look for a contiguous run of free clusters, starting at the goal
+    cluster_t run_start = 0;
+    uint32_t run_length = 0;
+    cluster_t current_cluster = goal;
+
+    for(uint32_t scanned = 0; scanned < volume->total_clusters; scanned++){
+        if(current_cluster >= FAT_LAST_VALID_CLUSTER){
+            // wrap around - a run cannot span the end of the volume
+            current_cluster = FAT_FIRST_VALID_CLUSTER;
+            run_length = 0;
+        }
+
         uint32_t value;
         fat_error_t err = fat_read_entry(volume, current_cluster, &value);
         if(err != FAT_OK){
-            continue;
-        }
-
-        if(value != FAT_FREE){
-
-            // allocate cluster: mark as EOC
-            uint32_t eoc_marker;
-            switch(volume->type){
-                case FAT_TYPE_FAT12:
-                    eoc_marker = FAT12_EOC;
-                    break;
-                case FAT_TYPE_FAT16:
-                    eoc_marker = FAT16_EOC;
-                    break;
-                case FAT_TYPE_FAT32:
-                    eoc_marker = FAT32_EOC;
-                    break;
-                default:
-                    return FAT_ERR_UNSUPPORTED_FAT_TYPE;
+            return err;
+        }
+
+        if(value == FAT_FREE){
+            if(run_length == 0){
+                run_start = current_cluster;
+            }
+            run_length++;
+            if(run_length == count){
+                break;
             }
+        } else {
+            run_length = 0;
+        }
+        current_cluster++;
+    }
 
-            // write EOC marker to FAT
-            err = fat_write_entry(volume, current_cluster, eoc_marker);
+    if(run_length == count){
+        // link the run: each cluster points to its physical successor
+        for(uint32_t i = 0; i < count; i++){
+            uint32_t value = (i == count - 1) ? eoc_marker : run_start + i + 1;
+            fat_error_t err = fat_write_entry(volume, run_start + i, value);
             if(err != FAT_OK){
                 return err;
             }
+        }
 
-            // return allocated cluster
-            *cluster = current_cluster;
-            return FAT_OK;
+        *first_cluster = run_start;
+        return FAT_OK;
+    }
+
+    // no contiguous run - link single clusters
+    cluster_t first = 0;
+    cluster_t prev = 0;
+    for(uint32_t i = 0; i < count; i++){
+        cluster_t new_cluster;
+        fat_alloc_hint_t hint = { prev ? prev : goal, 0, count - i };
+        fat_error_t err = fat_allocate_cluster_hint(volume, &hint, &new_cluster);
+        if(err == FAT_OK && prev != 0){
+            err = fat_write_entry(volume, prev, new_cluster);
+            if(err != FAT_OK){
+                fat_write_entry(volume, new_cluster, FAT_FREE);
+            }
+        }
+
+        if(err != FAT_OK){
+            if(first != 0){
+                fat_free_chain(volume, first);
+            }
+            return err;
+        }
+
+        if(first == 0){
+            first = new_cluster;
         }
+        prev = new_cluster;
     }
 
-    // no free cluster found
-    return FAT_ERR_DISK_FULL;
+    *first_cluster = first;
+    return FAT_OK;
 }
 
-fat_error_t fat_free_chain(fat_volume_t *volume, cluster_t start_cluster){
+// tell the device a run of freed clusters holds no data - advisory, errors
+// are ignored
+static void fat_discard_run(fat_volume_t *volume, 
+                            cluster_t first_cluster, 
+                            uint32_t count){
+    volume->device->discard_sectors(volume->device->device_data,
+                                    fat_cluster_to_sector(volume, first_cluster),
+                                    count * volume->sectors_per_cluster);
+}
+
+fat_error_t fat_release_chain(fat_volume_t *volume, 
+                              cluster_t start_cluster, 
+                              bool discard, 
+                              uint32_t *clusters_freed){
 
     // parameter validation
     if(!volume){
@@ -117,48 +255,75 @@ fat_error_t fat_free_chain(fat_volume_t *volume, cluster_t start_cluster){
         start_cluster >= FAT_FIRST_VALID_CLUSTER + volume->total_clusters){
         return FAT_ERR_INVALID_CLUSTER;
     }
-    
-    // follow cluster chain and free each cluster
+
+    // deferred frees are still referenced on disk until the sync
+    discard = discard && volume->device->discard_sectors && !volume->commit;
+
+    // follow cluster chain and free each cluster, discarding contiguous runs
     cluster_t current_cluster = start_cluster;
-    uint32_t max_iterations = volume->total_clusters;
-    uint32_t iterations = 0;
+    cluster_t run_start = 0;
+    uint32_t run_length = 0;
+    uint32_t freed = 0;
+    fat_error_t err = FAT_OK;
 
-    while(iterations < max_iterations){
-        iterations++;
+    while(true){
+        if(freed >= volume->total_clusters){
+            // too many iterations, possibly a cycle
+            err = FAT_ERR_CORRUPTED;
+            break;
+        }
 
         // read next cluster
         uint32_t next_cluster;
-        fat_error_t err = fat_read_entry(volume, current_cluster, &next_cluster);
+        err = fat_read_entry(volume, current_cluster, &next_cluster);
         if(err != FAT_OK){
-            return err;
+            break;
         }
 
         // free current cluster
         err = fat_write_entry(volume, current_cluster, FAT_FREE);
         if(err != FAT_OK){
-            return err;
+            break;
         }
+        freed++;
 
-        // check for EOC
-        if(fat_is_eoc(volume, next_cluster)){
-            return FAT_OK;
+        if(run_length > 0 && current_cluster == run_start + run_length){
+            run_length++;
+        } else {
+            if(discard && run_length > 0){
+                fat_discard_run(volume, run_start, run_length);
+            }
+            run_start = current_cluster;
+            run_length = 1;
         }
 
-        // check for bad cluster
-        if(fat_is_bad(volume, next_cluster)){
-            return FAT_OK;
+        // check for EOC or bad cluster
+        if(fat_is_eoc(volume, next_cluster) || fat_is_bad(volume, next_cluster)){
+            break;
         }
 
         // validate next cluster in [first_valid_cluster, last_valid_cluster]
         if (next_cluster < FAT_FIRST_VALID_CLUSTER ||
             next_cluster >= FAT_FIRST_VALID_CLUSTER + volume->total_clusters){
-                return FAT_ERR_CORRUPTED;
+            err = FAT_ERR_CORRUPTED;
+            break;
         }
 
         current_cluster = next_cluster;
     }
-    // too many iterations, possibly a cycle
-    return FAT_ERR_CORRUPTED;
+
+    if(discard && run_length > 0){
+        fat_discard_run(volume, run_start, run_length);
+    }
+
+    if(clusters_freed){
+        *clusters_freed = freed;
+    }
+    return err;
+}
+
+fat_error_t fat_free_chain(fat_volume_t *volume, cluster_t start_cluster){
+    return fat_release_chain(volume, start_cluster, false, NULL);
 }
 
 fat_error_t fat_validate_chain(fat_volume_t *volume, cluster_t start_cluster){
@@ -0,0 +1,549 @@
+#include "fat_commit.h"
+#include "fat_table.h"
+#include "fat_cluster.h"
+#include "fat_lock.h"
+#include "fat_flusher.h"
+#include "fat_intent.h"
+#include <string.h>
+#include <stdlib.h>
+#include <time.h>
+
+typedef struct {
+    uint32_t sector;
+    uint8_t *data;
+} fat_pending_sector_t;
+
+// chain ended since the last sync
+typedef struct {
+    cluster_t cluster;
+    uint32_t link;                      // entry before the first cut
+    uint32_t current;                   // entry in the cache, kept during step 1
+} fat_pending_cut_t;
+
+struct fat_commit {
+    fat_commit_params_t params;
+
+    // pending directory sectors, sorted by sector number
+    fat_pending_sector_t *sectors;
+    uint32_t sector_count;
+    uint32_t sector_capacity;
+
+    // clusters freed since the last sync
+    cluster_t *frees;
+    uint32_t free_count;
+    uint32_t free_capacity;
+
+    // chains cut since the last sync
+    fat_pending_cut_t *cuts;
+    uint32_t cut_count;
+    uint32_t cut_capacity;
+
+    time_t oldest;                      // first pending change (0: none)
+    bool syncing;                       // writes go straight to the device
+};
+
+// first pending sector >= sector
+static uint32_t fat_pending_lower_bound(const struct fat_commit *commit,
+                                        uint32_t sector){
+    uint32_t low = 0;
+    uint32_t high = commit->sector_count;
+
+    while(low < high){
+        uint32_t mid = low + (high - low) / 2;
+        if(commit->sectors[mid].sector < sector){
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    return low;
+}
+
+static void fat_pending_clear(struct fat_commit *commit){
+    for(uint32_t i = 0; i < commit->sector_count; i++){
+        free(commit->sectors[i].data);
+    }
+    commit->sector_count = 0;
+}
+
+fat_error_t fat_enable_group_commit(fat_volume_t *volume,
+                                    const fat_commit_params_t *params){
+
+    // parameter validation
+    if(!volume || !params){
+        return FAT_ERR_INVALID_PARAM;
+    }
+
+    fat_lock_volume(volume);
+
+    if(!volume->commit){
+        volume->commit = calloc(1, sizeof(struct fat_commit));
+        if(!volume->commit){
+            fat_unlock_volume(volume);
+            return FAT_ERR_NO_MEMORY;
+        }
+    }
+
+    volume->commit->params = *params;
+
+    fat_unlock_volume(volume);
+    return FAT_OK;
+}
+
+fat_error_t fat_disable_group_commit(fat_volume_t *volume){
+
+    // parameter validation
+    if(!volume){
+        return FAT_ERR_INVALID_PARAM;
+    }
+
+    fat_lock_volume(volume);
+
+    fat_error_t err = fat_sync(volume);
+    if(err == FAT_OK){
+        fat_commit_release(volume);
+    } // else stay in group commit mode, nothing is lost
+
+    fat_unlock_volume(volume);
+    return err;
+}
+
+/* one transaction through the intent log - frees, links and entries reach
+ * the disk together, logged is false if the changes did not fit
+ */
+static fat_error_t fat_sync_logged(fat_volume_t *volume, bool *logged){
+
+    struct fat_commit *commit = volume->commit;
+    *logged = false;
+
+    uint8_t *old_data = malloc(volume->bytes_per_sector);
+    uint32_t *previous = malloc((commit->free_count + 1) * sizeof(uint32_t));
+    if(!old_data || !previous){
+        free(old_data);
+        free(previous);
+        return FAT_OK; // ordered sync needs no memory
+    }
+
+    // frees join the transaction, keep the old entries in case it does not fit
+    for(uint32_t i = 0; i < commit->free_count; i++){
+        fat_read_entry(volume, commit->frees[i], &previous[i]);
+        fat_write_entry(volume, commit->frees[i], FAT_FREE);
+    }
+
+    // log what differs from the disk
+    fat_error_t err = FAT_OK;
+    bool fits = true;
+    fat_intent_begin(volume);
+
+    for(uint32_t s = 0; fits && s < volume->fat_size_sectors; s++){
+        if(!fat_sector_dirty(volume, s)){
+            continue;
+        }
+        if(volume->device->read_sectors(volume->device->device_data,
+                                        volume->fat_begin_sector + s, 1,
+                                        old_data) != 0){
+            err = FAT_ERR_DEVICE_ERROR;
+            break;
+        }
+        fits = fat_intent_add(volume, FAT_INTENT_AREA_FAT, s, old_data,
+                              &volume->fat_cache[(size_t)s *
+                                                 volume->bytes_per_sector]);
+    }
+
+    for(uint32_t i = 0; err == FAT_OK && fits && i < commit->sector_count; i++){
+        if(volume->device->read_sectors(volume->device->device_data,
+                                        commit->sectors[i].sector, 1,
+                                        old_data) != 0){
+            err = FAT_ERR_DEVICE_ERROR;
+            break;
+        }
+        fits = fat_intent_add(volume, FAT_INTENT_AREA_DIR,
+                              commit->sectors[i].sector, old_data,
+                              commit->sectors[i].data);
+    }
+
+    if(err == FAT_OK && fits){
+        err = fat_intent_commit(volume);
+    }
+
+    if(err != FAT_OK || !fits){
+        // nothing written in place - frees go back to waiting
+        for(uint32_t i = commit->free_count; i > 0; i--){
+            fat_write_entry(volume, commit->frees[i - 1], previous[i - 1]);
+        }
+        free(old_data);
+        free(previous);
+        return err;
+    }
+
+    free(old_data);
+    free(previous);
+    commit->free_count = 0;
+    commit->cut_count = 0;
+    *logged = true;
+
+    // in place, any order - a crash from here on is repaired by the replay
+    err = fat_flush(volume);
+    if(err != FAT_OK){
+        return err;
+    }
+
+    for(uint32_t i = 0; i < commit->sector_count; i++){
+        int result = volume->device->write_sectors(volume->device->device_data,
+                                                   commit->sectors[i].sector, 1,
+                                                   commit->sectors[i].data);
+        if(result != 0){
+            return FAT_ERR_DEVICE_ERROR; // all sectors stay pending
+        }
+    }
+    fat_pending_clear(commit);
+
+    err = fat_intent_checkpoint(volume);
+    if(err == FAT_OK){
+        commit->oldest = 0;
+    }
+    return err;
+}
+
+static fat_error_t fat_sync_locked(fat_volume_t *volume){
+
+    struct fat_commit *commit = volume->commit;
+    if(!commit){
+        return fat_flush(volume);
+    }
+
+    commit->syncing = true;
+
+    if(fat_intent_active(volume)){
+        bool logged;
+        fat_error_t err = fat_sync_logged(volume, &logged);
+        if(err != FAT_OK || logged){
+            commit->syncing = false;
+            return err;
+        }
+        // too much for the log - ordered writes below
+    }
+
+    // 1. allocations and chain links - the cache holds no deferred frees,
+    // cut chains go out with their old link (the clusters behind it wait
+    // for step 3 as well)
+    for(uint32_t i = 0; i < commit->cut_count; i++){
+        fat_pending_cut_t *cut = &commit->cuts[i];
+        fat_read_entry(volume, cut->cluster, &cut->current);
+        fat_write_entry(volume, cut->cluster, cut->link);
+    }
+
+    fat_error_t err = fat_flush(volume);
+
+    for(uint32_t i = 0; i < commit->cut_count; i++){
+        fat_write_entry(volume, commit->cuts[i].cluster, commit->cuts[i].current);
+    }
+
+    if(err != FAT_OK){
+        goto done;
+    }
+
+    // 2. directory sectors referencing the new clusters
+    for(uint32_t i = 0; i < commit->sector_count; i++){
+        int result = volume->device->write_sectors(volume->device->device_data,
+                                                   commit->sectors[i].sector, 1,
+                                                   commit->sectors[i].data);
+        if(result != 0){
+            // keep the sectors not yet written for the next attempt
+            for(uint32_t j = 0; j < i; j++){
+                free(commit->sectors[j].data);
+            }
+            memmove(commit->sectors, &commit->sectors[i],
+                    (commit->sector_count - i) * sizeof(fat_pending_sector_t));
+            commit->sector_count -= i;
+            err = FAT_ERR_DEVICE_ERROR;
+            goto done;
+        }
+    }
+    fat_pending_clear(commit);
+
+    // 3. cuts and frees - nothing on disk references these clusters any more
+    commit->cut_count = 0;
+    for(uint32_t i = 0; i < commit->free_count; i++){
+        fat_write_entry(volume, commit->frees[i], FAT_FREE);
+    }
+    commit->free_count = 0;
+
+    err = fat_flush(volume);
+    if(err == FAT_OK){
+        commit->oldest = 0;
+    }
+
+done:
+    commit->syncing = false;
+    return err;
+}
+
+fat_error_t fat_sync(fat_volume_t *volume){
+
+    // parameter validation
+    if(!volume){
+        return FAT_ERR_INVALID_PARAM;
+    }
+
+    fat_lock_volume(volume);
+    fat_error_t err = fat_sync_locked(volume);
+    fat_unlock_volume(volume);
+    return err;
+}
+
+bool fat_commit_due(fat_volume_t *volume, const fat_commit_params_t *limits){
+
+    // parameter validation
+    if(!volume || !limits){
+        return false;
+    }
+
+    struct fat_commit *commit = volume->commit;
+    if(!commit){
+        return volume->fat_dirty;
+    }
+
+    if(commit->sector_count == 0 && commit->free_count == 0 &&
+       commit->cut_count == 0 && !volume->fat_dirty){
+        return false;
+    }
+
+    time_t now = time(NULL);
+    if(commit->oldest == 0){
+        commit->oldest = now;
+    }
+
+    uint32_t dirty_sectors = commit->sector_count + volume->fat_dirty_sectors;
+    if(limits->max_dirty_sectors != 0 &&
+       dirty_sectors >= limits->max_dirty_sectors){
+        return true;
+    }
+
+    return limits->max_age_seconds != 0 &&
+           now - commit->oldest >= (time_t)limits->max_age_seconds;
+}
+
+fat_error_t fat_commit(fat_volume_t *volume){
+
+    // parameter validation
+    if(!volume){
+        return FAT_ERR_INVALID_PARAM;
+    }
+
+    fat_lock_volume(volume);
+
+    fat_error_t err = FAT_OK;
+    if(!volume->commit){
+        err = fat_flush(volume);
+    } else if(volume->flusher){
+        // background writer owns the thresholds - never block the caller
+        if(fat_flusher_due(volume)){
+            fat_flusher_wake(volume);
+        }
+    } else if(fat_commit_due(volume, &volume->commit->params)){
+        err = fat_sync_locked(volume);
+    }
+
+    fat_unlock_volume(volume);
+    return err;
+}
+
+fat_error_t fat_meta_read(fat_volume_t *volume,
+                          uint32_t sector,
+                          uint32_t count,
+                          void *buffer){
+
+    // parameter validation
+    if(!volume || !buffer || count == 0){
+        return FAT_ERR_INVALID_PARAM;
+    }
+
+    int result = volume->device->read_sectors(volume->device->device_data,
+                                              sector, count, buffer);
+    if(result != 0){
+        return FAT_ERR_DEVICE_ERROR;
+    }
+
+    // overlay sectors not yet written
+    struct fat_commit *commit = volume->commit;
+    if(!commit || commit->sector_count == 0){
+        return FAT_OK;
+    }
+
+    uint8_t *out = (uint8_t*)buffer;
+    for(uint32_t i = fat_pending_lower_bound(commit, sector);
+        i < commit->sector_count && commit->sectors[i].sector < sector + count;
+        i++){
+        memcpy(&out[(size_t)(commit->sectors[i].sector - sector) *
+                    volume->bytes_per_sector],
+               commit->sectors[i].data, volume->bytes_per_sector);
+    }
+
+    return FAT_OK;
+}
+
+fat_error_t fat_meta_write(fat_volume_t *volume,
+                           uint32_t sector,
+                           uint32_t count,
+                           const void *buffer){
+
+    // parameter validation
+    if(!volume || !buffer || count == 0){
+        return FAT_ERR_INVALID_PARAM;
+    }
+
+    struct fat_commit *commit = volume->commit;
+    if(!commit || commit->syncing){
+        int result = volume->device->write_sectors(volume->device->device_data,
+                                                   sector, count, buffer);
+        return (result != 0) ? FAT_ERR_DEVICE_ERROR : FAT_OK;
+    }
+
+    const uint8_t *in = (const uint8_t*)buffer;
+    for(uint32_t s = 0; s < count; s++){
+        const uint8_t *data = &in[(size_t)s * volume->bytes_per_sector];
+        uint32_t position = fat_pending_lower_bound(commit, sector + s);
+
+        // already pending - replace contents
+        if(position < commit->sector_count &&
+           commit->sectors[position].sector == sector + s){
+            memcpy(commit->sectors[position].data, data,
+                   volume->bytes_per_sector);
+            continue;
+        }
+
+        if(commit->sector_count == commit->sector_capacity){
+            uint32_t new_capacity = commit->sector_capacity ?
+                                    commit->sector_capacity * 2 : 16;
+            fat_pending_sector_t *sectors = realloc(commit->sectors,
+                                    new_capacity * sizeof(fat_pending_sector_t));
+            if(!sectors){
+                return FAT_ERR_NO_MEMORY;
+            }
+            commit->sectors = sectors;
+            commit->sector_capacity = new_capacity;
+        }
+
+        uint8_t *copy = malloc(volume->bytes_per_sector);
+        if(!copy){
+            return FAT_ERR_NO_MEMORY;
+        }
+        memcpy(copy, data, volume->bytes_per_sector);
+
+        memmove(&commit->sectors[position + 1], &commit->sectors[position],
+                (commit->sector_count - position) * sizeof(fat_pending_sector_t));
+        commit->sectors[position].sector = sector + s;
+        commit->sectors[position].data = copy;
+        commit->sector_count++;
+    }
+
+    return FAT_OK;
+}
+
+fat_error_t fat_commit_defer_free(fat_volume_t *volume,
+                                  cluster_t cluster,
+                                  bool *deferred){
+
+    // parameter validation
+    if(!volume || !deferred){
+        return FAT_ERR_INVALID_PARAM;
+    }
+
+    *deferred = false;
+
+    struct fat_commit *commit = volume->commit;
+    if(!commit || commit->syncing){
+        return FAT_OK;
+    }
+
+    if(commit->free_count == commit->free_capacity){
+        uint32_t new_capacity = commit->free_capacity ?
+                                commit->free_capacity * 2 : 64;
+        cluster_t *frees = realloc(commit->frees,
+                                   new_capacity * sizeof(cluster_t));
+        if(!frees){
+            return FAT_ERR_NO_MEMORY; // cluster stays allocated (lost)
+        }
+        commit->frees = frees;
+        commit->free_capacity = new_capacity;
+    }
+
+    commit->frees[commit->free_count++] = cluster;
+    *deferred = true;
+    return FAT_OK;
+}
+
+fat_error_t fat_commit_cut_chain(fat_volume_t *volume, cluster_t cluster){
+
+    // parameter validation
+    if(!volume){
+        return FAT_ERR_INVALID_PARAM;
+    }
+
+    uint32_t link;
+    fat_error_t err = fat_read_entry(volume, cluster, &link);
+    if(err != FAT_OK){
+        return err;
+    }
+
+    struct fat_commit *commit = volume->commit;
+    if(commit && !commit->syncing){
+        // the disk keeps the link from before the first cut
+        bool known = false;
+        for(uint32_t i = 0; i < commit->cut_count && !known; i++){
+            known = (commit->cuts[i].cluster == cluster);
+        }
+
+        if(!known){
+            if(commit->cut_count == commit->cut_capacity){
+                uint32_t new_capacity = commit->cut_capacity ?
+                                        commit->cut_capacity * 2 : 16;
+                fat_pending_cut_t *cuts = realloc(commit->cuts,
+                                    new_capacity * sizeof(fat_pending_cut_t));
+                if(!cuts){
+                    return FAT_ERR_NO_MEMORY;
+                }
+                commit->cuts = cuts;
+                commit->cut_capacity = new_capacity;
+            }
+
+            commit->cuts[commit->cut_count].cluster = cluster;
+            commit->cuts[commit->cut_count].link = link;
+            commit->cut_count++;
+        }
+    }
+
+    return fat_write_entry(volume, cluster, fat_get_eoc_marker(volume));
+}
+
+uint32_t fat_commit_pending_sectors(fat_volume_t *volume){
+
+    // parameter validation
+    if(!volume){
+        return 0;
+    }
+
+    fat_lock_volume_shared(volume);
+    uint32_t pending = volume->fat_dirty_sectors;
+    if(volume->commit){
+        pending += volume->commit->sector_count;
+    }
+    fat_unlock_volume(volume);
+    return pending;
+}
+
+void fat_commit_release(fat_volume_t *volume){
+
+    // parameter validation
+    if(!volume || !volume->commit){
+        return;
+    }
+
+    fat_pending_clear(volume->commit);
+    free(volume->commit->sectors);
+    free(volume->commit->frees);
+    free(volume->commit->cuts);
+    free(volume->commit);
+    volume->commit = NULL;
+}
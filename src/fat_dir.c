@@ -1,4 +1,8 @@
 #include "fat_dir.h"
+#include "fat_cluster.h"
+#include "fat_root.h"
+#include "fat_commit.h"
+#include "fat_dir_slots.h"
 #include <string.h>
 #include <stdlib.h>
 
@@ -24,12 +28,10 @@ fat_error_t fat_read_dir_entry (fat_volume_t *volume, uint32_t sector,
         return FAT_ERR_NO_MEMORY;
     }
 
-    int result = volume->device->read_sectors(volume->device->device_data, 
-                                              sector, 1, sector_buffer);
-    
-    if(result != 0){
+    fat_error_t err = fat_meta_read(volume, sector, 1, sector_buffer);
+    if(err != FAT_OK){
         free(sector_buffer);
-        return FAT_ERR_DEVICE_ERROR;
+        return err;
     }
 
     // copy 32 bit entry from sector
@@ -63,26 +65,20 @@ fat_error_t fat_write_dir_entry(fat_volume_t *volume, uint32_t sector,
     }
 
     // read current sector
-    int result = volume->device->read_sectors(volume->device->device_data,
-                                              sector, 1, sector_buffer);
-    if(result != 0){
+    fat_error_t err = fat_meta_read(volume, sector, 1, sector_buffer);
+    if(err != FAT_OK){
         free(sector_buffer);
-        return FAT_ERR_DEVICE_ERROR;
+        return err;
     }
 
     // modify the entry
     memcpy(&sector_buffer[offset], entry, sizeof(fat_dir_entry_t));
 
     // write sector to drive
-    result = volume->device->write_sectors(volume->device->device_data,
-                                            sector, 1, sector_buffer);
-    if(result != 0){
-        free(sector_buffer);
-        return FAT_ERR_DEVICE_ERROR;
-    }
+    err = fat_meta_write(volume, sector, 1, sector_buffer);
 
     free(sector_buffer);
-    return FAT_OK;
+    return err;
 }
 
 cluster_t fat_get_entry_cluster(fat_volume_t *volume, 
@@ -121,4 +117,240 @@ void fat_set_entry_cluster(fat_volume_t *volume,
     } else {
         entry->first_cluster_high = 0;
     }
-}
\ No newline at end of file
+}
+
+fat_error_t fat_dir_loc_from_index(fat_volume_t *volume, 
+                                   cluster_t dir_cluster, 
+                                   uint32_t entry_index, 
+                                   fat_dir_loc_t *loc){
+
+    // parameter validation
+    if(!volume || !loc){
+        return FAT_ERR_INVALID_PARAM;
+    }
+
+    uint32_t entries_per_sector = volume->bytes_per_sector / 32;
+
+    if(dir_cluster == 0 && volume->type != FAT_TYPE_FAT32){
+        // FAT12/16 root directory (fixed region)
+        if(entry_index >= volume->root_entry_count){
+            return FAT_ERR_INVALID_PARAM;
+        }
+
+        uint32_t root_start = volume->reserved_sector_count +
+                              (volume->num_fats * volume->fat_size_sectors);
+        loc->cluster = 0;
+        loc->sector = root_start + (entry_index / entries_per_sector);
+        loc->offset = (entry_index % entries_per_sector) * 32;
+        loc->index = entry_index;
+        return FAT_OK;
+    }
+
+    // FAT32 root directory / subdirectory - a directory with a slot map
+    // has its chain cached
+    if(fat_dir_slots_locate(volume, dir_cluster, entry_index, loc) == FAT_OK){
+        return FAT_OK;
+    }
+
+    uint32_t entries_per_cluster = volume->bytes_per_cluster / 32;
+    uint32_t cluster_index = entry_index / entries_per_cluster;
+    uint32_t entry_in_cluster = entry_index % entries_per_cluster;
+
+    // walk cluster chain
+    cluster_t target_cluster = dir_cluster;
+    for(uint32_t i = 0; i < cluster_index; i++){
+        fat_error_t err = fat_get_next_cluster(volume, target_cluster, 
+                                               &target_cluster);
+        if(err != FAT_OK){
+            return err;
+        }
+
+        if(fat_is_eoc(volume, target_cluster)){
+            return FAT_ERR_CORRUPTED;
+        }
+    }
+
+    loc->cluster = target_cluster;
+    loc->sector = fat_cluster_to_sector(volume, target_cluster) + 
+                    (entry_in_cluster / entries_per_sector);
+    loc->offset = (entry_in_cluster % entries_per_sector) * 32;
+    loc->index = entry_index;
+    return FAT_OK;
+}
+
+fat_error_t fat_dir_loc_next(fat_volume_t *volume, fat_dir_loc_t *loc){
+
+    // parameter validation
+    if(!volume || !loc || loc->sector == 0){
+        return FAT_ERR_INVALID_PARAM;
+    }
+
+    // same sector
+    if(loc->offset + 32 < volume->bytes_per_sector){
+        loc->offset += 32;
+        loc->index++;
+        return FAT_OK;
+    }
+
+    if(loc->cluster == 0 && volume->type != FAT_TYPE_FAT32){
+        // FAT12/16 root directory ends after root_entry_count entries
+        if(loc->index + 1 >= volume->root_entry_count){
+            return FAT_ERR_EOF;
+        }
+    } else if(loc->sector + 1 >= fat_cluster_to_sector(volume, loc->cluster) + 
+                                 volume->sectors_per_cluster){
+        // next cluster - one FAT lookup
+        cluster_t next_cluster;
+        fat_error_t err = fat_get_next_cluster(volume, loc->cluster, 
+                                               &next_cluster);
+        if(err != FAT_OK){
+            return err;
+        }
+
+        if(fat_is_eoc(volume, next_cluster)){
+            return FAT_ERR_EOF;
+        }
+
+        loc->cluster = next_cluster;
+        loc->sector = fat_cluster_to_sector(volume, next_cluster);
+        loc->offset = 0;
+        loc->index++;
+        return FAT_OK;
+    }
+
+    loc->sector++;
+    loc->offset = 0;
+    loc->index++;
+    return FAT_OK;
+}
+
+fat_error_t fat_dir_loc_prev(fat_volume_t *volume, 
+                             cluster_t dir_cluster, 
+                             fat_dir_loc_t *loc){
+
+    // parameter validation
+    if(!volume || !loc || loc->sector == 0 || loc->index == 0){
+        return FAT_ERR_INVALID_PARAM;
+    }
+
+    // same sector
+    if(loc->offset >= 32){
+        loc->offset -= 32;
+        loc->index--;
+        return FAT_OK;
+    }
+
+    // previous sector of the root region or of the same cluster
+    if((loc->cluster == 0 && volume->type != FAT_TYPE_FAT32) ||
+       loc->sector > fat_cluster_to_sector(volume, loc->cluster)){
+        loc->sector--;
+        loc->offset = volume->bytes_per_sector - 32;
+        loc->index--;
+        return FAT_OK;
+    }
+
+    // previous cluster - chains only link forward, the cached chain of a
+    // directory with a slot map or a walk from the start
+    return fat_dir_loc_from_index(volume, dir_cluster, loc->index - 1, loc);
+}
+
+// rewrite count consecutive slots from loc on with one read-modify-write per
+// sector - without entries the slots are marked deleted
+static fat_error_t fat_update_dir_slots(fat_volume_t *volume, 
+                                        fat_dir_loc_t *loc, 
+                                        const fat_dir_entry_t *entries, 
+                                        uint32_t count){
+
+    uint8_t *sector_buffer = (uint8_t*)malloc(volume->bytes_per_sector);
+    if(!sector_buffer){
+        return FAT_ERR_NO_MEMORY;
+    }
+
+    fat_error_t err = FAT_OK;
+    uint32_t done = 0;
+
+    while(done < count && err == FAT_OK){
+        uint32_t sector = loc->sector;
+
+        err = fat_meta_read(volume, sector, 1, sector_buffer);
+        if(err != FAT_OK){
+            break;
+        }
+
+        // fill every slot of the group that lives in this sector
+        while(1){
+            uint8_t *slot = &sector_buffer[loc->offset];
+            if(entries){
+                memcpy(slot, &entries[done], sizeof(fat_dir_entry_t));
+            } else {
+                slot[0] = FAT_DIR_ENTRY_DELETED;
+            }
+            done++;
+
+            if(done == count){
+                break;
+            }
+
+            err = fat_dir_loc_next(volume, loc);
+            if(err != FAT_OK || loc->sector != sector){
+                break;
+            }
+        }
+
+        fat_error_t write_err = fat_meta_write(volume, sector, 1, sector_buffer);
+        if(write_err != FAT_OK){
+            err = write_err;
+        }
+    }
+
+    free(sector_buffer);
+    return err;
+}
+
+fat_error_t fat_write_dir_entries(fat_volume_t *volume, 
+                                  fat_dir_loc_t *loc, 
+                                  const fat_dir_entry_t *entries, 
+                                  uint32_t count){
+
+    // parameter validation
+    if(!volume || !loc || loc->sector == 0 || !entries || count == 0){
+        return FAT_ERR_INVALID_PARAM;
+    }
+
+    return fat_update_dir_slots(volume, loc, entries, count);
+}
+
+fat_error_t fat_mark_dir_entries_deleted(fat_volume_t *volume, 
+                                         fat_dir_loc_t *loc, 
+                                         uint32_t count){
+
+    // parameter validation
+    if(!volume || !loc || loc->sector == 0 || count == 0){
+        return FAT_ERR_INVALID_PARAM;
+    }
+
+    return fat_update_dir_slots(volume, loc, NULL, count);
+}
+
+fat_error_t fat_locate_dir_entry(fat_volume_t *volume, 
+                                 cluster_t dir_cluster, 
+                                 uint32_t entry_index, 
+                                 uint32_t *sector, 
+                                 uint32_t *offset){
+
+    // parameter validation
+    if(!volume || !sector || !offset){
+        return FAT_ERR_INVALID_PARAM;
+    }
+
+    fat_dir_loc_t loc;
+    fat_error_t err = fat_dir_loc_from_index(volume, dir_cluster, entry_index, 
+                                             &loc);
+    if(err != FAT_OK){
+        return err;
+    }
+
+    *sector = loc.sector;
+    *offset = loc.offset;
+    return FAT_OK;
+}
@@ -0,0 +1,249 @@
+#include "fat_dir_compact.h"
+#include "fat_dir.h"
+#include "fat_dir_slots.h"
+#include "fat_file.h"
+#include "fat_path.h"
+#include "fat_cluster.h"
+#include "fat_table.h"
+#include "fat_root.h"
+#include "fat_commit.h"
+#include "fat_lock.h"
+#include <string.h>
+#include <stdlib.h>
+
+// collect the cluster chain of a directory
+static fat_error_t fat_collect_dir_clusters(fat_volume_t *volume,
+                                            cluster_t dir_cluster,
+                                            cluster_t **clusters,
+                                            uint32_t *cluster_count){
+
+    uint32_t capacity = 16;
+    uint32_t count = 0;
+    cluster_t *list = malloc(capacity * sizeof(cluster_t));
+    if(!list){
+        return FAT_ERR_NO_MEMORY;
+    }
+
+    cluster_t current_cluster = dir_cluster;
+    while(1){
+        if(current_cluster < FAT_FIRST_VALID_CLUSTER ||
+           count >= volume->total_clusters){
+            free(list);
+            return FAT_ERR_CORRUPTED;
+        }
+
+        if(count == capacity){
+            capacity *= 2;
+            cluster_t *grown = realloc(list, capacity * sizeof(cluster_t));
+            if(!grown){
+                free(list);
+                return FAT_ERR_NO_MEMORY;
+            }
+            list = grown;
+        }
+        list[count++] = current_cluster;
+
+        fat_error_t err = fat_get_next_cluster(volume, current_cluster,
+                                               &current_cluster);
+        if(err != FAT_OK){
+            free(list);
+            return err;
+        }
+
+        if(fat_is_eoc(volume, current_cluster)){
+            break;
+        }
+    }
+
+    *clusters = list;
+    *cluster_count = count;
+    return FAT_OK;
+}
+
+static fat_error_t fat_compact_dir_locked(fat_volume_t *volume, const char *path){
+
+    // parameter validation
+    if(!volume || !path){
+        return FAT_ERR_INVALID_PARAM;
+    }
+
+    fat_dir_entry_t dir_entry;
+    fat_error_t err = fat_resolve_path(volume, path, &dir_entry, NULL, NULL);
+    if(err != FAT_OK){
+        return err;
+    }
+
+    if(!(dir_entry.attr & FAT_ATTR_DIRECTORY)){
+        return FAT_ERR_NOT_A_DIRECTORY;
+    }
+
+    cluster_t dir_cluster = fat_get_entry_cluster(volume, &dir_entry);
+    bool is_root_fat12 = (dir_cluster == 0 && volume->type != FAT_TYPE_FAT32);
+
+    // directory layout: sectors of the fixed root or clusters of the chain
+    cluster_t *clusters = NULL;
+    uint32_t unit_count;
+    uint32_t unit_size;
+    uint32_t root_start_sector = volume->reserved_sector_count +
+                                 (volume->num_fats * volume->fat_size_sectors);
+
+    if(is_root_fat12){
+        unit_count = volume->root_dir_sectors;
+        unit_size = volume->bytes_per_sector;
+    } else {
+        err = fat_collect_dir_clusters(volume, dir_cluster, &clusters,
+                                       &unit_count);
+        if(err != FAT_OK){
+            return err;
+        }
+        unit_size = volume->bytes_per_cluster;
+    }
+
+    uint32_t total_entries = (unit_count * unit_size) / 32;
+    uint8_t *old_entries = malloc((size_t)unit_count * unit_size);
+    uint8_t *new_entries = calloc(unit_count, unit_size);
+    uint32_t *new_index = malloc(total_entries * sizeof(uint32_t));
+    if(!old_entries || !new_entries || !new_index){
+        err = FAT_ERR_NO_MEMORY;
+        goto cleanup;
+    }
+
+    // deleted entries have no new place
+    for(uint32_t i = 0; i < total_entries; i++){
+        new_index[i] = FAT_DIR_ENTRY_DETACHED;
+    }
+
+    // read whole directory
+    for(uint32_t i = 0; i < unit_count; i++){
+        if(is_root_fat12){
+            err = fat_meta_read(volume, root_start_sector + i, 1,
+                                &old_entries[i * unit_size]);
+        } else {
+            err = fat_meta_read(volume, fat_cluster_to_sector(volume, clusters[i]),
+                                volume->sectors_per_cluster,
+                                &old_entries[i * unit_size]);
+        }
+
+        if(err != FAT_OK){
+            goto cleanup;
+        }
+    }
+
+    // pack live entries (LFN groups stay in order in front of their SFN)
+    uint32_t live_count = 0;
+    uint32_t scanned = 0;
+    for(; scanned < total_entries; scanned++){
+        const uint8_t *entry = &old_entries[scanned * 32];
+
+        if(entry[0] == FAT_DIR_ENTRY_FREE){
+            break;
+        }
+
+        if(entry[0] == FAT_DIR_ENTRY_DELETED){
+            continue;
+        }
+
+        memcpy(&new_entries[live_count * 32], entry, 32);
+        new_index[scanned] = live_count;
+        live_count++;
+    }
+
+    // clusters still needed - a directory keeps at least one
+    uint32_t entries_per_unit = unit_size / 32;
+    uint32_t units_needed = unit_count;
+    if(!is_root_fat12){
+        units_needed = (live_count + entries_per_unit - 1) / entries_per_unit;
+        if(units_needed == 0){
+            units_needed = 1;
+        }
+    }
+
+    if(live_count == scanned && units_needed == unit_count){
+        err = FAT_OK; // nothing to reclaim
+        goto cleanup;
+    }
+
+    // write back changed sectors front to back - entries only move towards
+    // the front, so an interrupted pass loses none, but it can leave an
+    // entry at its old place as well. both copies then share one chain
+    // until a checker drops the stale one, deleting either frees the
+    // other's clusters. only an intent log (fat_intent.h) makes the pass
+    // atomic
+    uint32_t sectors_per_unit = unit_size / volume->bytes_per_sector;
+    for(uint32_t i = 0; i < units_needed; i++){
+        for(uint32_t s = 0; s < sectors_per_unit; s++){
+            size_t offset = (size_t)i * unit_size + s * volume->bytes_per_sector;
+            if(memcmp(&old_entries[offset], &new_entries[offset],
+                      volume->bytes_per_sector) == 0){
+                continue;
+            }
+
+            uint32_t sector = is_root_fat12 ? root_start_sector + i :
+                                fat_cluster_to_sector(volume, clusters[i]) + s;
+            err = fat_meta_write(volume, sector, 1, &new_entries[offset]);
+            if(err != FAT_OK){
+                // directory partly rewritten - cached positions are stale
+                fat_dir_slots_invalidate(volume, dir_cluster);
+                goto cleanup;
+            }
+        }
+    }
+
+    // move open handles along with their entries, a handle of a deleted
+    // entry is detached - its slot may hold another entry now
+    for(fat_file_t *file = volume->open_files; file; file = file->next_open){
+        if(file->dir_cluster != dir_cluster ||
+           file->dir_entry_offset == FAT_DIR_ENTRY_DETACHED){
+            continue;
+        }
+
+        file->dir_entry_offset = (file->dir_entry_offset < scanned) ?
+                                 new_index[file->dir_entry_offset] :
+                                 FAT_DIR_ENTRY_DETACHED;
+        if(file->dir_entry_offset == FAT_DIR_ENTRY_DETACHED){
+            file->dir_entry_loc.sector = 0;
+            continue;
+        }
+
+        if(fat_dir_loc_from_index(volume, dir_cluster, file->dir_entry_offset,
+                                  &file->dir_entry_loc) != FAT_OK){
+            file->dir_entry_loc.sector = 0; // resolved on next update
+        }
+    }
+
+    fat_dir_slots_invalidate(volume, dir_cluster);
+
+    // truncate surplus trailing clusters
+    if(units_needed < unit_count){
+        err = fat_free_chain(volume, clusters[units_needed]);
+        if(err == FAT_OK){
+            err = fat_commit_cut_chain(volume, clusters[units_needed - 1]);
+        }
+        if(err != FAT_OK){
+            goto cleanup;
+        }
+    }
+
+    err = fat_commit(volume);
+
+cleanup:
+    free(new_index);
+    free(new_entries);
+    free(old_entries);
+    free(clusters);
+    return err;
+}
+
+fat_error_t fat_compact_dir(fat_volume_t *volume, const char *path){
+
+    // parameter validation
+    if(!volume || !path){
+        return FAT_ERR_INVALID_PARAM;
+    }
+
+    fat_lock_volume(volume);
+    fat_error_t err = fat_compact_dir_locked(volume, path);
+    fat_unlock_volume(volume);
+    return err;
+}
+
@@ -3,54 +3,48 @@
 #include "fat_cluster.h"
 #include "fat_lfn.h"
 #include "fat_root.h"
-#include <stdio.h>
+#include "fat_commit.h"
+#include "fat_lock.h"
 #include <string.h>
 #include <stdlib.h>
 
-void fat_convert_short_name(const uint8_t *short_name, char *output){
-    
-    // parameter validation
-    if(!short_name || !output){
-        if(output) 
-            output[0] = '\0';
-        return;
-    }
-
-    char name_part[9] = {0};
-    char ext_part[4] = {0};
+// writes "NAME.EXT" without padding, returns length
+static uint8_t fat_format_short_name(const uint8_t *short_name, char *output){
 
-    // extract name part
-    int name_len = 8;
+    // name part without trailing spaces
+    uint8_t name_len = 8;
     while(name_len > 0 && short_name[name_len-1] == ' '){
         name_len--;
     }
+    memcpy(output, short_name, name_len);
 
-    if(name_len > 0){
-            memcpy(name_part, short_name, name_len);
-            name_part[name_len] = '\0';
-    }
-
-    // extract extension part
-    int ext_len = 3;
+    // extension part without trailing spaces
+    uint8_t ext_len = 3;
     while(ext_len > 0 && short_name[8 + ext_len - 1] == ' '){
         ext_len--;
     }
 
+    uint8_t length = name_len;
     if(ext_len > 0){
-        memcpy(ext_part, &short_name[8], ext_len);
-        ext_part[ext_len] = '\0';
+        output[length++] = '.';
+        memcpy(&output[length], &short_name[8], ext_len);
+        length += ext_len;
     }
 
-    // build output string
-    if(name_len > 0 && ext_len > 0){
-        snprintf(output, 13, "%s.%s", name_part, ext_part);
-    } else if(name_len > 0){
-        strcpy(output, name_part);
-    } else if(ext_len > 0){
-        snprintf(output, 13, ".%s", ext_part);
-    } else {
-        output[0] = '\0';
+    output[length] = '\0';
+    return length;
+}
+
+void fat_convert_short_name(const uint8_t *short_name, char *output){
+    
+    // parameter validation
+    if(!short_name || !output){
+        if(output) 
+            output[0] = '\0';
+        return;
     }
+
+    fat_format_short_name(short_name, output);
 }
 
 void fat_extract_entry_info(const fat_dir_entry_t *entry, const char *long_name, 
@@ -120,11 +114,10 @@ fat_error_t fat_load_directory_cluster(fat_dir_t *dir, cluster_t cluster){
         sectors_to_read = dir->volume->sectors_per_cluster;
     }
 
-    int result = dir->volume->device->read_sectors(dir->volume->device->device_data,
-                                                   sector, sectors_to_read,
-                                                   dir->cluster_buffer);
-    if(result != 0){
-        return FAT_ERR_DEVICE_ERROR;
+    fat_error_t err = fat_meta_read(dir->volume, sector, sectors_to_read,
+                                    dir->cluster_buffer);
+    if(err != FAT_OK){
+        return err;
     }
 
     dir->current_cluster = cluster;
@@ -133,7 +126,7 @@ fat_error_t fat_load_directory_cluster(fat_dir_t *dir, cluster_t cluster){
     return FAT_OK;
 }
 
-fat_error_t fat_opendir(fat_volume_t *volume, const char *path, fat_dir_t **dir){
+static fat_error_t fat_opendir_locked(fat_volume_t *volume, const char *path, fat_dir_t **dir){
 
     // parameter validation
     if(!volume || !path || !dir){
@@ -197,13 +190,23 @@ fat_error_t fat_opendir(fat_volume_t *volume, const char *path, fat_dir_t **dir)
     return FAT_OK;
 }
 
-fat_error_t fat_readdir(fat_dir_t *dir, fat_dir_entry_info_t *info){
+fat_error_t fat_opendir(fat_volume_t *volume, const char *path, fat_dir_t **dir){
 
     // parameter validation
-    if(!dir || !info){
+    if(!volume || !path || !dir){
         return FAT_ERR_INVALID_PARAM;
     }
 
+    fat_lock_volume_shared(volume);
+    fat_error_t err = fat_opendir_locked(volume, path, dir);
+    fat_unlock_volume(volume);
+    return err;
+}
+
+
+// current slot of the directory stream, loads the next sector/cluster
+static fat_error_t fat_dir_current_slot(fat_dir_t *dir, fat_dir_entry_t **entry){
+
     uint32_t entries_per_buffer;
     if(dir->is_root_fat12){
         entries_per_buffer = dir->volume->bytes_per_sector / 32;
@@ -211,84 +214,160 @@ fat_error_t fat_readdir(fat_dir_t *dir, fat_dir_entry_info_t *info){
         entries_per_buffer = dir->volume->bytes_per_cluster / 32;
     }
 
-    while(1){
-        // check if we need to load the next sector/cluster
-        if(dir->cluster_offset >= entries_per_buffer){
-            if(dir->is_root_fat12){
-                // FAT12/16
-                dir->current_entry_index = ((dir->current_entry_index / 
-                                            entries_per_buffer) + 1) *
-                                            entries_per_buffer;
-                
-                if(dir->current_entry_index >= dir->max_entries){
-                    return FAT_ERR_EOF;
-                }
-
-                fat_error_t err = fat_load_directory_cluster(dir, 0);
-                if(err != FAT_OK){
-                    return err;
-                }
-            } else {
-                // FAT32 / subdirectory
-                cluster_t next_cluster;
-                fat_error_t err = fat_get_next_cluster(dir->volume, 
-                                                       dir->current_cluster,
-                                                       &next_cluster);
-                if(err != FAT_OK || fat_is_eoc(dir->volume, next_cluster)){
-                    return FAT_ERR_EOF;
-                }
-
-                err = fat_load_directory_cluster(dir, next_cluster);
-                if(err != FAT_OK){
-                    return err;
-                }
-
-                dir->current_entry_index = ((dir->current_entry_index / 
-                                             entries_per_buffer) + 1) * 
-                                             entries_per_buffer;                
+    // check if we need to load the next sector/cluster - the entry index 
+    // already points at the first entry of the next buffer
+    if(dir->cluster_offset >= entries_per_buffer){
+        if(dir->is_root_fat12){
+            // FAT12/16
+            if(dir->current_entry_index >= dir->max_entries){
+                return FAT_ERR_EOF;
+            }
+
+            fat_error_t err = fat_load_directory_cluster(dir, 0);
+            if(err != FAT_OK){
+                return err;
+            }
+        } else {
+            // FAT32 / subdirectory
+            cluster_t next_cluster;
+            fat_error_t err = fat_get_next_cluster(dir->volume, 
+                                                   dir->current_cluster,
+                                                   &next_cluster);
+            if(err != FAT_OK || fat_is_eoc(dir->volume, next_cluster)){
+                return FAT_ERR_EOF;
+            }
+
+            err = fat_load_directory_cluster(dir, next_cluster);
+            if(err != FAT_OK){
+                return err;
             }
         }
+    }
+
+    *entry = (fat_dir_entry_t*)&dir->cluster_buffer[dir->cluster_offset * 32];
+    return FAT_OK;
+}
+
+// physical location of the current slot (buffer already loaded)
+static void fat_dir_current_loc(const fat_dir_t *dir, fat_dir_loc_t *loc){
+
+    fat_volume_t *volume = dir->volume;
+    uint32_t entries_per_sector = volume->bytes_per_sector / 32;
+
+    if(dir->is_root_fat12){
+        uint32_t root_start = volume->reserved_sector_count +
+                              (volume->num_fats * volume->fat_size_sectors);
+        loc->cluster = 0;
+        loc->sector = root_start + 
+                        (dir->current_entry_index / entries_per_sector);
+    } else {
+        loc->cluster = dir->current_cluster;
+        loc->sector = fat_cluster_to_sector(volume, dir->current_cluster) + 
+                        (dir->cluster_offset / entries_per_sector);
+    }
+    loc->offset = (dir->cluster_offset % entries_per_sector) * 32;
+    loc->index = dir->current_entry_index;
+}
+
+static void fat_dir_advance(fat_dir_t *dir){
+    dir->cluster_offset++;
+    dir->current_entry_index++;
+}
+
+static void fat_dir_reset_lfn(fat_dir_t *dir){
+    dir->lfn_entries = 0;
+    dir->lfn_next_order = 0;
+}
 
-        // get current directory entry
-        fat_dir_entry_t *entry = (fat_dir_entry_t*)&dir->
-                                  cluster_buffer[dir->cluster_offset * 32];
+// collect LFN entry in disk order (last part first, order 1 in front of SFN)
+static void fat_dir_collect_lfn(fat_dir_t *dir, const fat_lfn_entry_t *lfn_entry){
+
+    uint8_t order = lfn_entry->order & 0x3F;
+
+    if(lfn_entry->order & 0x40){
+        // start of a new sequence
+        if(order == 0 || order > 20){
+            fat_dir_reset_lfn(dir);
+            return;
+        }
+        dir->lfn_entries = order;
+        dir->lfn_checksum = lfn_entry->checksum;
+    } else if(dir->lfn_entries == 0 || order == 0 ||
+              order != dir->lfn_next_order ||
+              lfn_entry->checksum != dir->lfn_checksum){
+        // orphaned or out of order entry
+        fat_dir_reset_lfn(dir);
+        return;
+    }
+
+    uint8_t chars_read;
+    if(fat_parse_lfn(lfn_entry, &dir->lfn_chars[(order - 1) * 13], 
+                     &chars_read) != FAT_OK){
+        fat_dir_reset_lfn(dir);
+        return;
+    }
+
+    if(lfn_entry->order & 0x40){
+        dir->lfn_length = (order - 1) * 13 + chars_read;
+    } else if(chars_read != 13){
+        // only the last part may be short
+        fat_dir_reset_lfn(dir);
+        return;
+    }
+
+    dir->lfn_next_order = order - 1;
+}
+
+static fat_error_t fat_readdir_locked(fat_dir_t *dir, fat_dir_entry_info_t *info){
+
+    // parameter validation
+    if(!dir || !info){
+        return FAT_ERR_INVALID_PARAM;
+    }
+
+    fat_dir_reset_lfn(dir);
+
+    while(1){
+        fat_dir_entry_t *entry;
+        fat_error_t err = fat_dir_current_slot(dir, &entry);
+        if(err != FAT_OK){
+            return err;
+        }
 
         if(entry->name[0] == FAT_DIR_ENTRY_FREE){
             return FAT_ERR_EOF;
         }
 
         if(entry->name[0] == FAT_DIR_ENTRY_DELETED){
-            dir->cluster_offset++;
-            dir->current_entry_index++;
+            fat_dir_advance(dir);
             continue;
         }
 
         if(entry->attr == FAT_ATTR_LONG_NAME){
-            dir->cluster_offset++;
-            dir->current_entry_index++;
+            fat_dir_advance(dir);
             continue;
         }
 
         if(entry->attr & FAT_ATTR_VOLUME_ID){
-            dir->cluster_offset++;
-            dir->current_entry_index++;
+            fat_dir_advance(dir);
             continue;
         }
 
         // entry is valid - check for LFN
-        char long_filename[256] = {0};
+        char long_filename[FAT_LFN_UTF8_MAX] = {0};
         bool has_lfn = false;
 
         if(dir->current_entry_index > 0){
             uint8_t checksum = fat_calculate_lfn_checksum(entry->name);
-            uint32_t lfn_entry_index = dir->current_entry_index;
+            fat_dir_loc_t lfn_loc;
+            fat_dir_current_loc(dir, &lfn_loc);
 
-            fat_error_t lfn_err = fat_read_lfn_sequence(dir->volume, 
-                                                        dir->dir_cluster,
-                                                        &lfn_entry_index, 
-                                                        long_filename,
-                                                        sizeof(long_filename), 
-                                                        checksum);
+            fat_error_t lfn_err = fat_read_lfn_sequence_at(dir->volume, 
+                                                           dir->dir_cluster,
+                                                           &lfn_loc, 
+                                                           long_filename,
+                                                           sizeof(long_filename), 
+                                                           checksum);
 
             if(lfn_err == FAT_OK && strlen(long_filename) > 0){
                 has_lfn = true;
@@ -297,13 +376,169 @@ fat_error_t fat_readdir(fat_dir_t *dir, fat_dir_entry_info_t *info){
 
         fat_extract_entry_info(entry, has_lfn ? long_filename : NULL, info);
 
-        dir->cluster_offset++;
-        dir->current_entry_index++;
+        fat_dir_advance(dir);
 
         return FAT_OK;
     }
 }
 
+fat_error_t fat_readdir(fat_dir_t *dir, fat_dir_entry_info_t *info){
+
+    // parameter validation
+    if(!dir || !info){
+        return FAT_ERR_INVALID_PARAM;
+    }
+
+    fat_lock_volume_shared(dir->volume);
+    fat_error_t err = fat_readdir_locked(dir, info);
+    fat_unlock_volume(dir->volume);
+    return err;
+}
+
+
+static fat_error_t fat_readdir_batch_locked(fat_dir_t *dir, 
+                                            void *buffer, 
+                                            size_t buffer_size, 
+                                            uint32_t flags, 
+                                            size_t *bytes_filled){
+
+    // parameter validation
+    if(!dir || !buffer || !bytes_filled){
+        return FAT_ERR_INVALID_PARAM;
+    }
+
+    *bytes_filled = 0;
+
+    uint8_t *output = (uint8_t*)buffer;
+    size_t used = 0;
+    size_t times_size = (flags & FAT_READDIR_COMPACT) ? 0 : 
+                            sizeof(fat_dirent_times_t);
+
+    // LFN parts are collected while streaming - no backwards re-reads
+    while(1){
+        fat_dir_entry_t *entry;
+        fat_error_t err = fat_dir_current_slot(dir, &entry);
+        if(err == FAT_OK && entry->name[0] == FAT_DIR_ENTRY_FREE){
+            err = FAT_ERR_EOF;
+        }
+
+        if(err != FAT_OK){
+            if(used > 0){
+                break; // EOF / error is reported by the next call
+            }
+            return err;
+        }
+
+        if(entry->name[0] == FAT_DIR_ENTRY_DELETED){
+            fat_dir_reset_lfn(dir);
+            fat_dir_advance(dir);
+            continue;
+        }
+
+        if(entry->attr == FAT_ATTR_LONG_NAME){
+            if(!(flags & FAT_READDIR_SKIP_LFN)){
+                fat_dir_collect_lfn(dir, (const fat_lfn_entry_t*)entry);
+            }
+            fat_dir_advance(dir);
+            continue;
+        }
+
+        if(entry->attr & FAT_ATTR_VOLUME_ID){
+            fat_dir_reset_lfn(dir);
+            fat_dir_advance(dir);
+            continue;
+        }
+
+        // name - long name if a complete sequence belongs to this entry
+        char name[FAT_LFN_UTF8_MAX];
+        uint16_t name_length;
+
+        if(!(flags & FAT_READDIR_SKIP_LFN) && dir->lfn_entries > 0 &&
+           dir->lfn_next_order == 0 &&
+           dir->lfn_checksum == fat_calculate_lfn_checksum(entry->name)){
+            size_t units = dir->lfn_length > 255 ? 255 : dir->lfn_length;
+            name_length = (uint16_t)fat_utf16_to_utf8(dir->lfn_chars, units,
+                                                      name, sizeof(name));
+        } else {
+            name_length = fat_format_short_name(entry->name, name);
+        }
+
+        size_t record_length = offsetof(fat_dirent_t, name) + name_length + 1 +
+                               times_size;
+        record_length = (record_length + FAT_DIRENT_ALIGN - 1) & 
+                            ~(size_t)(FAT_DIRENT_ALIGN - 1);
+
+        if(used + record_length > buffer_size){
+            if(used == 0){
+                return FAT_ERR_INVALID_PARAM; // buffer too small for one record
+            }
+            break; // entry and its LFN state stay current for the next call
+        }
+
+        // fill record
+        uint8_t *record = &output[used];
+        memset(record, 0, record_length);
+
+        fat_dirent_t header;
+        header.record_length = (uint16_t)record_length;
+        header.name_length = name_length;
+        header.attributes = entry->attr;
+        header.file_size = entry->file_size;
+        header.start_cluster = fat_get_entry_cluster(dir->volume, entry);
+        memcpy(record, &header, offsetof(fat_dirent_t, name));
+        memcpy(&record[offsetof(fat_dirent_t, name)], name, name_length);
+
+        if(times_size > 0){
+            fat_dirent_times_t times;
+            times.create_date = entry->create_date;
+            times.create_time = entry->create_time;
+            times.modify_date = entry->write_date;
+            times.modify_time = entry->write_time;
+            times.access_date = entry->access_date;
+            memcpy(&record[record_length - times_size], &times, times_size);
+        }
+
+        used += record_length;
+
+        fat_dir_reset_lfn(dir);
+        fat_dir_advance(dir);
+    }
+
+    *bytes_filled = used;
+    return FAT_OK;
+}
+
+fat_error_t fat_readdir_batch(fat_dir_t *dir, 
+                              void *buffer, 
+                              size_t buffer_size, 
+                              uint32_t flags, 
+                              size_t *bytes_filled){
+
+    // parameter validation
+    if(!dir || !buffer || !bytes_filled){
+        return FAT_ERR_INVALID_PARAM;
+    }
+
+    fat_lock_volume_shared(dir->volume);
+    fat_error_t err = fat_readdir_batch_locked(dir, buffer, buffer_size, flags, 
+                                               bytes_filled);
+    fat_unlock_volume(dir->volume);
+    return err;
+}
+
+
+const fat_dirent_times_t *fat_dirent_times(const fat_dirent_t *record){
+
+    // parameter validation
+    if(!record){
+        return NULL;
+    }
+
+    return (const fat_dirent_times_t*)((const uint8_t*)record + 
+                                       record->record_length - 
+                                       sizeof(fat_dirent_times_t));
+}
+
 fat_error_t fat_closedir(fat_dir_t *dir){
     
     // parameter validation
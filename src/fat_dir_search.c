@@ -3,52 +3,136 @@
 #include "fat_table.h"
 #include "fat_root.h"
 #include "fat_lfn.h"
+#include "fat_dir_slots.h"
+#include "fat_commit.h"
 #include <string.h>
-#include <ctype.h>
 #include <stdlib.h>
 
-bool fat_compare_short_name(const uint8_t *short_name, const char *filename){
+#define FAT_BYTES_64(b) (0x0101010101010101ULL * (uint8_t)(b))
+#define FAT_BYTES_32(b) (0x01010101U * (uint8_t)(b))
+
+// fold ASCII 'A'-'Z' to lower case in all 8 bytes at once
+static uint64_t fat_fold_word64(uint64_t word){
+    uint64_t low7 = word & FAT_BYTES_64(0x7F);
+    uint64_t above_a = low7 + FAT_BYTES_64(0x80 - 'A');
+    uint64_t above_z = low7 + FAT_BYTES_64(0x80 - 'Z' - 1);
+    uint64_t upper = (above_a ^ above_z) & ~word & FAT_BYTES_64(0x80);
+    return word ^ (upper >> 2);
+}
+
+static uint32_t fat_fold_word32(uint32_t word){
+    uint32_t low7 = word & FAT_BYTES_32(0x7F);
+    uint32_t above_a = low7 + FAT_BYTES_32(0x80 - 'A');
+    uint32_t above_z = low7 + FAT_BYTES_32(0x80 - 'Z' - 1);
+    uint32_t upper = (above_a ^ above_z) & ~word & FAT_BYTES_32(0x80);
+    return word ^ (upper >> 2);
+}
+
+static uint16_t fat_fold_char(uint16_t ch){
+    return (ch >= 'A' && ch <= 'Z') ? ch + ('a' - 'A') : ch;
+}
+
+void fat_make_lookup_key(const char *name, fat_lookup_key_t *key){
+
     // parameter validation
-    if(!short_name || !filename){
-        return false;
+    if(!name || !key){
+        return;
     }
 
-    char name_part[9] = {0};
-    char ext_part[4] = {0};
+    size_t len = strlen(name);
 
-    // get name and trim trailing spaces
-    int name_len = 8;
-    while(name_len > 0 && short_name[name_len-1] == ' '){
-        name_len--;
+    // long name key - UTF-16 as fat_create_lfn_entries stores it, a
+    // malformed or overlong name matches no long name
+    size_t units;
+    key->long_length = 0;
+    key->lfn_entries = 0;
+    if(len > 0 && fat_utf8_to_utf16(name, key->long_name, 255, &units) == FAT_OK){
+        for(size_t i = 0; i < units; i++){
+            key->long_name[i] = fat_fold_char(key->long_name[i]);
+        }
+        key->long_length = (uint16_t)units;
+        key->lfn_entries = (uint8_t)((units + 12) / 13);
     }
 
-    memcpy(name_part, short_name, name_len);
-    name_part[name_len] = '\0';
-
-    // extract extension and trim trailing spaces
-    int ext_len = 3;
-    while(ext_len > 0 && short_name[8 + ext_len - 1] == ' '){
-        ext_len--;
+    // short name key - only for names that read back as "NAME.EXT"
+    uint8_t short_name[12];
+    memset(short_name, ' ', 11);
+    short_name[11] = 0;
+    key->has_short_name = false;
+
+    const char *dot = strrchr(name, '.');
+    size_t base_len = dot ? (size_t)(dot - name) : len;
+    size_t ext_len = dot ? len - base_len - 1 : 0;
+
+    if(strcmp(name, ".") == 0 || strcmp(name, "..") == 0){
+        // dot entries
+        memcpy(short_name, name, len);
+        key->has_short_name = true;
+    } else if(base_len >= 1 && base_len <= 8 && ext_len <= 3 &&
+              (!dot || ext_len > 0) && memchr(name, '.', base_len) == NULL &&
+              name[base_len - 1] != ' ' && 
+              (ext_len == 0 || name[len - 1] != ' ')){
+        memcpy(short_name, name, base_len);
+        memcpy(&short_name[8], dot ? dot + 1 : "", ext_len);
+        key->has_short_name = true;
     }
 
-    memcpy(ext_part, &short_name[8], ext_len);
-    ext_part[ext_len] = '\0';
+    uint64_t lo;
+    uint32_t hi;
+    memcpy(&lo, short_name, 8);
+    memcpy(&hi, &short_name[8], 4);
+    key->short_name_lo = fat_fold_word64(lo);
+    key->short_name_hi = fat_fold_word32(hi);
+}
 
-    // rebuild complete entry (filename + extension)
-    char full_name[13] = {0};
-    strcpy(full_name, name_part);
-    if(ext_len>0){
-        strcat(full_name, ".");
-        strcat(full_name, ext_part);
+bool fat_match_short_key(const fat_lookup_key_t *key, const uint8_t *short_name){
+
+    // parameter validation
+    if(!key || !short_name || !key->has_short_name){
+        return false;
     }
 
-    // filename comparison (case insensitive)
-    if(strlen(filename) != strlen(full_name)){
+    uint64_t lo;
+    uint32_t hi = 0;
+    memcpy(&lo, short_name, 8);
+    memcpy(&hi, &short_name[8], 3);
+
+    // case-insensitive compare of all 11 bytes in two words
+    return fat_fold_word64(lo) == key->short_name_lo &&
+           fat_fold_word32(hi) == key->short_name_hi;
+}
+
+bool fat_compare_short_name(const uint8_t *short_name, const char *filename){
+    // parameter validation
+    if(!short_name || !filename){
         return false;
     }
 
-    for(size_t i=0; i<strlen(filename); i++){
-        if(tolower(filename[i]) != tolower(full_name[i])){
+    fat_lookup_key_t key;
+    fat_make_lookup_key(filename, &key);
+    return fat_match_short_key(&key, short_name);
+}
+
+// compare LFN part with the long name key (part of order n holds 
+// characters (n-1)*13 onwards)
+static bool fat_match_lfn_part(const fat_lookup_key_t *key, 
+                               const fat_lfn_entry_t *lfn_entry){
+
+    uint8_t raw[26];
+    memcpy(raw, lfn_entry->name1, 10);
+    memcpy(&raw[10], lfn_entry->name2, 12);
+    memcpy(&raw[22], lfn_entry->name3, 4);
+
+    uint32_t position = ((lfn_entry->order & 0x3F) - 1) * 13;
+    for(uint32_t i = 0; i < 13; i++, position++){
+        uint16_t ch = raw[2*i] | (raw[2*i + 1] << 8);
+
+        if(position == key->long_length){
+            // name must end here, padding behind the terminator is not checked
+            return ch == 0x0000;
+        }
+
+        if(fat_fold_char(ch) != key->long_name[position]){
             return false;
         }
     }
@@ -62,6 +146,20 @@ fat_error_t fat_find_entry (fat_volume_t *volume,
                             fat_dir_entry_t *entry, 
                             uint32_t *entry_index){
 
+    fat_dir_loc_t loc;
+    fat_error_t err = fat_find_entry_loc(volume, dir_cluster, name, entry, &loc);
+    if(err == FAT_OK && entry_index){
+        *entry_index = loc.index;
+    }
+    return err;
+}
+
+fat_error_t fat_find_entry_loc(fat_volume_t *volume, 
+                               cluster_t dir_cluster, 
+                               const char *name,
+                               fat_dir_entry_t *entry, 
+                               fat_dir_loc_t *loc){
+
     // parameter validation
     if(!volume || !name || !entry){
         return FAT_ERR_INVALID_PARAM;
@@ -86,6 +184,15 @@ fat_error_t fat_find_entry (fat_volume_t *volume,
         return FAT_ERR_NO_MEMORY;
     }
 
+    // search name is converted once, candidates are compared in place
+    fat_lookup_key_t key;
+    fat_make_lookup_key(name, &key);
+
+    // LFN sequence in front of the current entry, matched part by part
+    uint8_t lfn_next_order = 0;
+    uint8_t lfn_checksum = 0;
+    bool lfn_match = false;
+
     while(1){
         uint32_t sector;
         uint32_t sectors_to_read;
@@ -103,14 +210,12 @@ fat_error_t fat_find_entry (fat_volume_t *volume,
             sectors_to_read = 1;
             entries_in_buffer = entries_per_sector;
 
-            int result = volume->device->read_sectors(volume->device->device_data,
-                                                      sector, sectors_to_read, 
-                                                      read_buffer);
-
-            if(result != 0){
+            fat_error_t read_err = fat_meta_read(volume, sector, sectors_to_read, 
+                                                 read_buffer);
+            if(read_err != FAT_OK){
                 free(read_buffer);
-                return FAT_ERR_DEVICE_ERROR;
-            }                                                      
+                return read_err;
+            }
         } else {
             // subdirectory or FAT32 root
             if(current_cluster == 0 || fat_is_eoc(volume, current_cluster)){
@@ -122,13 +227,11 @@ fat_error_t fat_find_entry (fat_volume_t *volume,
             sectors_to_read = volume->sectors_per_cluster;
             entries_in_buffer = entries_per_cluster;
 
-            int result = volume->device->read_sectors(volume->device->device_data,
-                                                      sector, sectors_to_read,
-                                                      read_buffer);
-
-            if(result != 0){
+            fat_error_t read_err = fat_meta_read(volume, sector, sectors_to_read, 
+                                                 read_buffer);
+            if(read_err != FAT_OK){
                 free(read_buffer);
-                return FAT_ERR_DEVICE_ERROR;
+                return read_err;
             }
         }
 
@@ -148,67 +251,60 @@ fat_error_t fat_find_entry (fat_volume_t *volume,
             }
 
             if(current_entry->name[0] == FAT_DIR_ENTRY_DELETED){
+                lfn_match = false;
                 entry_idx++;
                 continue;
             }
 
-            // skip LFN for now
             if(current_entry->attr == FAT_ATTR_LONG_NAME){
+                const fat_lfn_entry_t *lfn_entry = 
+                                        (const fat_lfn_entry_t*)current_entry;
+                uint8_t order = lfn_entry->order & 0x3F;
+
+                if(lfn_entry->order & 0x40){
+                    // first part on disk - sequence length must fit the name
+                    lfn_match = (order == key.lfn_entries);
+                    lfn_checksum = lfn_entry->checksum;
+                } else if(order != lfn_next_order || 
+                          lfn_entry->checksum != lfn_checksum){
+                    lfn_match = false;
+                }
+
+                if(lfn_match && order > 0){
+                    lfn_match = fat_match_lfn_part(&key, lfn_entry);
+                }
+                lfn_next_order = order - 1;
+
                 entry_idx++;
                 continue;
             }
 
             if(current_entry->attr & FAT_ATTR_VOLUME_ID){
+                lfn_match = false;
                 entry_idx++;
                 continue;
             }
 
-            // check if short name matches
-            if(fat_compare_short_name(current_entry->name, name)){
+            // short name or complete long name in front of it
+            bool match = fat_match_short_key(&key, current_entry->name);
+            if(!match && lfn_match && lfn_next_order == 0 &&
+               lfn_checksum == fat_calculate_lfn_checksum(current_entry->name)){
+                match = true;
+            }
+            lfn_match = false;
+
+            if(match){
                 memcpy(entry, current_entry, sizeof(fat_dir_entry_t));
-                if(entry_index){
-                    *entry_index = entry_idx;
+                if(loc){
+                    loc->cluster = is_root_fat12 ? 0 : current_cluster;
+                    loc->sector = sector + (i / entries_per_sector);
+                    loc->offset = (i % entries_per_sector) * 32;
+                    loc->index = entry_idx;
                 }
                 free(read_buffer);
                 return FAT_OK;
             }
 
-            // check if long filename matches
-            if(entry_idx > 0){
-                char long_filename[256];
-                uint8_t checksum = fat_calculate_lfn_checksum(current_entry->name);
-                uint32_t lfn_entry_idx = entry_idx;
-
-                fat_error_t lfn_err = fat_read_lfn_sequence(volume, 
-                                                            dir_cluster, 
-                                                            &lfn_entry_idx, 
-                                                            long_filename, 
-                                                            sizeof(long_filename), 
-                                                            checksum);
-
-                if(lfn_err == FAT_OK){
-                    // compare searchname with long filename (case insensitive)
-                    if(strlen(name) == strlen(long_filename)){
-                        bool match = true;
-                        for(size_t j=0; j<strlen(name); j++){
-                            if(tolower(name[j]) != tolower(long_filename[j])){
-                                match = false;
-                                break;
-                            }
-                        }
-
-                        if(match){
-                            memcpy(entry, current_entry, sizeof(fat_dir_entry_t));
-                            if(entry_index){
-                                *entry_index = entry_idx;
-                            }
-                            free(read_buffer);
-                            return FAT_OK;
-                        }
-                    }
-                }                                                            
-            }
-
             entry_idx++;
         }
 
@@ -224,14 +320,7 @@ fat_error_t fat_find_entry (fat_volume_t *volume,
             }
         }
 
-        // update entry index
-        if(is_root_fat12){
-            entry_idx = ((entry_idx / entries_per_sector) + 1) * 
-                          entries_per_sector;
-        } else {
-            entry_idx = ((entry_idx / entries_per_cluster) + 1) * 
-                          entries_per_cluster;
-        }
+        // entry index already points at the first entry of the next buffer
     }
 }
 
@@ -279,14 +368,11 @@ fat_error_t fat_iterate_directory(fat_volume_t *volume,
             sectors_to_read = 1;
             entries_in_buffer = entries_per_sector;
 
-            int result = volume->device->read_sectors(volume->device->device_data, 
-                                                      sector,
-                                                      sectors_to_read, 
-                                                      read_buffer);
-            
-            if(result != 0){
+            fat_error_t read_err = fat_meta_read(volume, sector, sectors_to_read, 
+                                                 read_buffer);
+            if(read_err != FAT_OK){
                 free(read_buffer);
-                return FAT_ERR_DEVICE_ERROR;
+                return read_err;
             }
         } else {
             if(current_cluster == 0 || fat_is_eoc(volume, current_cluster)){
@@ -297,15 +383,12 @@ fat_error_t fat_iterate_directory(fat_volume_t *volume,
             sectors_to_read = volume->sectors_per_cluster;
             entries_in_buffer = entries_per_cluster;
 
-            int result = volume->device->read_sectors(volume->device->device_data,
-                                                      sector, 
-                                                      sectors_to_read, 
-                                                      read_buffer);
-
-            if(result!=0){
+            fat_error_t read_err = fat_meta_read(volume, sector, sectors_to_read, 
+                                                 read_buffer);
+            if(read_err != FAT_OK){
                 free(read_buffer);
-                return FAT_ERR_DEVICE_ERROR;
-            }                                                      
+                return read_err;
+            }
         }
 
         uint32_t buffer_entry_idx = entry_idx % entries_in_buffer;
@@ -338,17 +421,21 @@ fat_error_t fat_iterate_directory(fat_volume_t *volume,
             }
 
             char *long_name = NULL;
-            char long_filename[256];
+            char long_filename[FAT_LFN_UTF8_MAX];
 
             if(entry_idx > 0){
                 uint8_t checksum = fat_calculate_lfn_checksum(current_entry->name);
-                uint32_t lfn_entry_idx = entry_idx;
-
-                fat_error_t lfn_err = fat_read_lfn_sequence(volume, dir_cluster, 
-                                                            &lfn_entry_idx,
-                                                            long_filename,
-                                                            sizeof(long_filename),
-                                                            checksum);
+                fat_dir_loc_t lfn_loc;
+                lfn_loc.cluster = is_root_fat12 ? 0 : current_cluster;
+                lfn_loc.sector = sector + (i / entries_per_sector);
+                lfn_loc.offset = (i % entries_per_sector) * 32;
+                lfn_loc.index = entry_idx;
+
+                fat_error_t lfn_err = fat_read_lfn_sequence_at(volume, dir_cluster, 
+                                                               &lfn_loc,
+                                                               long_filename,
+                                                               sizeof(long_filename),
+                                                               checksum);
 
                 if(lfn_err == FAT_OK){
                     long_name = long_filename;
@@ -378,142 +465,203 @@ fat_error_t fat_iterate_directory(fat_volume_t *volume,
             }
         }
 
-        if(is_root_fat12){
-            entry_idx = ((entry_idx / entries_per_sector) + 1) * 
-                          entries_per_sector;
-        } else {
-            entry_idx = ((entry_idx / entries_per_cluster) + 1) * 
-                          entries_per_cluster;
-        }
     }
 
     free(read_buffer);
     return FAT_OK;
 }
 
-fat_error_t fat_find_free_entry(fat_volume_t *volume, cluster_t dir_cluster, 
-                                uint32_t num_entries, uint32_t *entry_index){
+fat_error_t fat_scan_directory_slots(fat_volume_t *volume,
+                                     cluster_t dir_cluster,
+                                     fat_dir_slot_callback callback,
+                                     void *user_data){
 
     // parameter validation
-    if(!volume || num_entries == 0 || !entry_index){
+    if(!volume || !callback){
         return FAT_ERR_INVALID_PARAM;
     }
 
-    uint32_t current_cluster = dir_cluster;
-    uint32_t entry_idx = 0;
-    uint32_t consecutive_free = 0;
-    uint32_t first_free_idx = 0;
     bool is_root_fat12 = (dir_cluster == 0 && volume->type != FAT_TYPE_FAT32);
-
-    uint32_t entries_per_cluster = volume->bytes_per_cluster / 32;
     uint32_t entries_per_sector = volume->bytes_per_sector / 32;
-    uint32_t max_root_entries = is_root_fat12 ? volume->root_entry_count : 0;
-    uint32_t root_start_sector = 0;
-
-    if(is_root_fat12){
-        root_start_sector = volume->reserved_sector_count +
-                            (volume->num_fats * volume->fat_size_sectors);
-    }
+    uint32_t entries_in_buffer = is_root_fat12 ? entries_per_sector :
+                                     volume->bytes_per_cluster / 32;
+    uint32_t root_start_sector = volume->reserved_sector_count +
+                                 (volume->num_fats * volume->fat_size_sectors);
 
     uint8_t *read_buffer = malloc(volume->bytes_per_cluster);
     if(!read_buffer){
         return FAT_ERR_NO_MEMORY;
     }
 
-    while(1){
-        uint32_t sector;
-        uint32_t sectors_to_read;
-        uint32_t entries_in_buffer;
+    cluster_t current_cluster = dir_cluster;
+    uint32_t entry_idx = 0;
+    fat_error_t err = FAT_OK;
 
+    // one device read per cluster (per sector for the FAT12/16 root)
+    while(1){
         if(is_root_fat12){
-            if(entry_idx >= max_root_entries){
-                // FAT12/16 root directory has fixed size
-                free(read_buffer);
-                return FAT_ERR_DISK_FULL;
+            if(entry_idx >= volume->root_entry_count){
+                break;
+            }
+            err = fat_meta_read(volume, 
+                                root_start_sector + (entry_idx / entries_per_sector),
+                                1, read_buffer);
+        } else {
+            if(current_cluster < FAT_FIRST_VALID_CLUSTER ||
+               fat_is_eoc(volume, current_cluster)){
+                break;
             }
+            err = fat_meta_read(volume, 
+                                fat_cluster_to_sector(volume, current_cluster),
+                                volume->sectors_per_cluster, read_buffer);
+        }
 
-            sector = root_start_sector + (entry_idx / entries_per_sector);
-            sectors_to_read = 1;
-            entries_in_buffer = entries_per_sector;
+        if(err != FAT_OK){
+            break;
+        }
 
-            int result = volume->device->read_sectors(volume->device->device_data,
-                                                      sector, 
-                                                      sectors_to_read, 
-                                                      read_buffer);
+        for(uint32_t i = 0; i < entries_in_buffer; i++, entry_idx++){
+            fat_dir_entry_t *current_entry = (fat_dir_entry_t*)&read_buffer[i*32];
 
-            if(result != 0){
+            // end of directory
+            if(current_entry->name[0] == FAT_DIR_ENTRY_FREE){
                 free(read_buffer);
-                return FAT_ERR_DEVICE_ERROR;
+                return FAT_OK;
             }
-        } else {
-            if(current_cluster == 0 || fat_is_eoc(volume, current_cluster)){
-                // need to allocate new cluster for the directory
-                // TODO implement directory growth by allocatng new clusters
+
+            err = callback(current_entry, entry_idx, user_data);
+            if(err != FAT_OK){
                 free(read_buffer);
-                return FAT_ERR_DISK_FULL;
+                return err; // callback requested stop
             }
+        }
 
-            sector = fat_cluster_to_sector(volume, current_cluster);
-            sectors_to_read = volume->sectors_per_cluster;
-            entries_in_buffer = entries_per_cluster;
-
-            int result = volume->device->read_sectors(volume->device->device_data,
-                                                      sector, 
-                                                      sectors_to_read, 
-                                                      read_buffer);
-            
-            if(result != 0){
-                free(read_buffer);
-                return FAT_ERR_DEVICE_ERROR;
+        if(!is_root_fat12){
+            err = fat_get_next_cluster(volume, current_cluster, &current_cluster);
+            if(err != FAT_OK){
+                break;
             }
         }
+    }
 
-        uint32_t buffer_entry_idx = entry_idx % entries_in_buffer;
+    free(read_buffer);
+    return err;
+}
 
-        for(uint32_t i = buffer_entry_idx; i<entries_in_buffer; i++){
-            if(is_root_fat12 && entry_idx >= max_root_entries){
+fat_error_t fat_grow_directory(fat_volume_t *volume, 
+                               cluster_t last_cluster, 
+                               cluster_t *first_new_cluster){
+
+    // parameter validation
+    if(!volume || !first_new_cluster || last_cluster < FAT_FIRST_VALID_CLUSTER){
+        return FAT_ERR_INVALID_PARAM;
+    }
+
+    // grow several clusters at once, placed right behind the directory if free
+    uint32_t count = FAT_DIR_GROWTH_CLUSTERS;
+    cluster_t first_cluster;
+    fat_error_t err = fat_allocate_chain(volume, last_cluster + 1, count, 
+                                         &first_cluster);
+    if(err == FAT_ERR_DISK_FULL && count > 1){
+        // not enough space for a full growth step - take a single cluster
+        count = 1;
+        err = fat_allocate_chain(volume, last_cluster + 1, count, &first_cluster);
+    }
+    if(err != FAT_OK){
+        return err;
+    }
+
+    uint8_t *zero_buffer = calloc(count, volume->bytes_per_cluster);
+    if(!zero_buffer){
+        fat_free_chain(volume, first_cluster);
+        return FAT_ERR_NO_MEMORY;
+    }
+
+    // zero new clusters - one device write per physically contiguous run
+    cluster_t run_start = first_cluster;
+    cluster_t current_cluster = first_cluster;
+    uint32_t run_length = 1;
+
+    for(uint32_t i = 1; i <= count; i++){
+        cluster_t next_cluster = 0;
+        if(i < count){
+            err = fat_get_next_cluster(volume, current_cluster, &next_cluster);
+            if(err != FAT_OK){
                 break;
             }
 
-            fat_dir_entry_t *current_entry = (fat_dir_entry_t*)&read_buffer[i*32];
-            
-            // check if entry is free
-            if(current_entry->name[0] == FAT_DIR_ENTRY_FREE || 
-               current_entry->name[0] == FAT_DIR_ENTRY_DELETED){
-                if(consecutive_free == 0){
-                    first_free_idx = entry_idx;
-                }
-                consecutive_free++;
-
-                // check if enough consecutive free entries exist
-                if(consecutive_free >= num_entries){
-                    *entry_index = first_free_idx;
-                    free(read_buffer);
-                    return FAT_OK;
-                } else {
-                    consecutive_free = 0;
-                }
-                entry_idx++;
+            if(next_cluster == current_cluster + 1){
+                run_length++;
+                current_cluster = next_cluster;
+                continue;
             }
+        }
 
-            // move to next cluster
-            if(!is_root_fat12){
-                fat_error_t err = fat_get_next_cluster(volume, 
-                                                       current_cluster, 
-                                                       &current_cluster);
-                if(err != FAT_OK){
-                    free(read_buffer);
-                    return err;
-                }
-            }
+        int result = volume->device->write_sectors(volume->device->device_data,
+                                                   fat_cluster_to_sector(volume, 
+                                                                    run_start),
+                                                   run_length * 
+                                                    volume->sectors_per_cluster,
+                                                   zero_buffer);
+        if(result != 0){
+            err = FAT_ERR_DEVICE_ERROR;
+            break;
+        }
 
-            if(is_root_fat12){
-                entry_idx = ((entry_idx / entries_per_sector) + 1) * 
-                              entries_per_sector;
-            } else {
-                entry_idx = ((entry_idx / entries_per_cluster) + 1) * 
-                              entries_per_cluster;
-            }
+        run_start = next_cluster;
+        current_cluster = next_cluster;
+        run_length = 1;
+    }
+
+    free(zero_buffer);
+
+    // link new clusters to the end of the directory chain
+    if(err == FAT_OK){
+        err = fat_write_entry(volume, last_cluster, first_cluster);
+    }
+
+    if(err != FAT_OK){
+        fat_free_chain(volume, first_cluster);
+        return err;
+    }
+
+    *first_new_cluster = first_cluster;
+    return FAT_OK;
+}
+
+fat_error_t fat_find_free_entry(fat_volume_t *volume, cluster_t dir_cluster, 
+                                uint32_t num_entries, uint32_t *entry_index){
+
+    // parameter validation
+    if(!volume || num_entries == 0 || !entry_index){
+        return FAT_ERR_INVALID_PARAM;
+    }
+
+    // free runs come from the directory's slot map (scanned once per directory)
+    fat_dir_slot_map_t *map;
+    fat_error_t err = fat_dir_slots_get(volume, dir_cluster, &map);
+    if(err != FAT_OK){
+        return err;
+    }
+
+    err = fat_dir_slots_find(map, num_entries, entry_index);
+    while(err == FAT_ERR_DISK_FULL && map->last_cluster >= FAT_FIRST_VALID_CLUSTER){
+        // no run large enough - grow the directory, a free run at the end 
+        // continues into the new clusters
+        cluster_t first_new_cluster;
+        err = fat_grow_directory(volume, map->last_cluster, &first_new_cluster);
+        if(err != FAT_OK){
+            return err;
         }
+
+        err = fat_dir_slots_extend(volume, map, first_new_cluster);
+        if(err != FAT_OK){
+            return err;
+        }
+
+        err = fat_dir_slots_find(map, num_entries, entry_index);
     }
-}
\ No newline at end of file
+
+    // FAT12/16 root directory has fixed size
+    return err;
+}
@@ -0,0 +1,472 @@
+#include "fat_dir_slots.h"
+#include "fat_dir_search.h"
+#include "fat_cluster.h"
+#include "fat_table.h"
+#include "fat_root.h"
+#include <string.h>
+#include <stdlib.h>
+
+typedef struct{
+    fat_dir_slot_map_t *map;
+    uint32_t run_start;
+    uint32_t run_length;
+    uint32_t end_index;             // first slot after the last scanned slot
+    fat_error_t err;
+} fat_slot_build_t;
+
+static void fat_dir_slots_destroy(fat_dir_slot_map_t *map){
+    free(map->clusters);
+    free(map->runs);
+    free(map);
+}
+
+static fat_error_t fat_dir_slots_insert_run(fat_dir_slot_map_t *map,
+                                            uint32_t position,
+                                            uint32_t start,
+                                            uint32_t length){
+
+    if(map->run_count == map->run_capacity){
+        uint32_t new_capacity = map->run_capacity ? map->run_capacity * 2 : 8;
+        fat_slot_run_t *runs = realloc(map->runs,
+                                       new_capacity * sizeof(fat_slot_run_t));
+        if(!runs){
+            return FAT_ERR_NO_MEMORY;
+        }
+        map->runs = runs;
+        map->run_capacity = new_capacity;
+    }
+
+    memmove(&map->runs[position + 1], &map->runs[position],
+            (map->run_count - position) * sizeof(fat_slot_run_t));
+    map->runs[position].start = start;
+    map->runs[position].length = length;
+    map->run_count++;
+    return FAT_OK;
+}
+
+static void fat_dir_slots_remove_run(fat_dir_slot_map_t *map, uint32_t position){
+    memmove(&map->runs[position], &map->runs[position + 1],
+            (map->run_count - position - 1) * sizeof(fat_slot_run_t));
+    map->run_count--;
+}
+
+// add free range, merging with neighbouring runs
+static fat_error_t fat_dir_slots_add_run(fat_dir_slot_map_t *map,
+                                         uint32_t start,
+                                         uint32_t length){
+
+    if(length == 0){
+        return FAT_OK;
+    }
+
+    // first run starting behind the new range
+    uint32_t position = 0;
+    while(position < map->run_count && map->runs[position].start < start){
+        position++;
+    }
+
+    // overlapping ranges mean the map no longer matches the directory
+    if(position > 0){
+        fat_slot_run_t *prev = &map->runs[position - 1];
+        if(prev->start + prev->length > start){
+            return FAT_ERR_CORRUPTED;
+        }
+    }
+    if(position < map->run_count && start + length > map->runs[position].start){
+        return FAT_ERR_CORRUPTED;
+    }
+
+    bool merge_prev = position > 0 &&
+                      map->runs[position - 1].start +
+                        map->runs[position - 1].length == start;
+    bool merge_next = position < map->run_count &&
+                      start + length == map->runs[position].start;
+
+    if(merge_prev && merge_next){
+        map->runs[position - 1].length += length + map->runs[position].length;
+        fat_dir_slots_remove_run(map, position);
+    } else if(merge_prev){
+        map->runs[position - 1].length += length;
+    } else if(merge_next){
+        map->runs[position].start = start;
+        map->runs[position].length += length;
+    } else {
+        return fat_dir_slots_insert_run(map, position, start, length);
+    }
+    return FAT_OK;
+}
+
+static fat_error_t fat_dir_slots_append_cluster(fat_dir_slot_map_t *map,
+                                                cluster_t cluster){
+
+    if((map->cluster_count & (map->cluster_count - 1)) == 0){
+        uint32_t new_capacity = map->cluster_count ? map->cluster_count * 2 : 1;
+        cluster_t *clusters = realloc(map->clusters,
+                                      new_capacity * sizeof(cluster_t));
+        if(!clusters){
+            return FAT_ERR_NO_MEMORY;
+        }
+        map->clusters = clusters;
+    }
+
+    map->clusters[map->cluster_count++] = cluster;
+    return FAT_OK;
+}
+
+static fat_error_t fat_collect_free_slots(const fat_dir_entry_t *entry,
+                                          uint32_t entry_index,
+                                          void *user_data){
+
+    fat_slot_build_t *build = (fat_slot_build_t*)user_data;
+
+    if(entry->name[0] == FAT_DIR_ENTRY_DELETED){
+        if(build->run_length == 0){
+            build->run_start = entry_index;
+        }
+        build->run_length++;
+    } else if(build->run_length > 0){
+        build->err = fat_dir_slots_add_run(build->map, build->run_start,
+                                           build->run_length);
+        build->run_length = 0;
+    }
+
+    build->end_index = entry_index + 1;
+    return build->err;
+}
+
+static fat_error_t fat_dir_slots_build(fat_volume_t *volume,
+                                       cluster_t dir_cluster,
+                                       fat_dir_slot_map_t *map){
+
+    map->dir_cluster = dir_cluster;
+
+    if(dir_cluster == 0 && volume->type != FAT_TYPE_FAT32){
+        // FAT12/16 root directory has fixed size and cannot grow
+        map->last_cluster = 0;
+        map->capacity = volume->root_entry_count;
+    } else {
+        // record the directory chain (FAT cache only)
+        cluster_t current_cluster = dir_cluster;
+
+        while(1){
+            if(current_cluster < FAT_FIRST_VALID_CLUSTER ||
+               map->cluster_count > volume->total_clusters){
+                return FAT_ERR_CORRUPTED;
+            }
+
+            fat_error_t err = fat_dir_slots_append_cluster(map, current_cluster);
+            if(err != FAT_OK){
+                return err;
+            }
+
+            cluster_t next_cluster;
+            err = fat_get_next_cluster(volume, current_cluster, &next_cluster);
+            if(err != FAT_OK){
+                return err;
+            }
+
+            if(fat_is_eoc(volume, next_cluster)){
+                break;
+            }
+            current_cluster = next_cluster;
+        }
+
+        map->last_cluster = current_cluster;
+        map->capacity = map->cluster_count * (volume->bytes_per_cluster / 32);
+    }
+
+    // collect deleted runs up to the end-of-directory marker
+    fat_slot_build_t build;
+    memset(&build, 0, sizeof(build));
+    build.map = map;
+
+    fat_error_t err = fat_scan_directory_slots(volume, dir_cluster,
+                                               fat_collect_free_slots, &build);
+    if(err != FAT_OK){
+        return err;
+    }
+
+    // everything from the end marker on is free, trailing deleted run included
+    uint32_t tail_start = build.run_length > 0 ? build.run_start : build.end_index;
+    return fat_dir_slots_add_run(map, tail_start, map->capacity - tail_start);
+}
+
+fat_error_t fat_dir_slots_get(fat_volume_t *volume,
+                              cluster_t dir_cluster,
+                              fat_dir_slot_map_t **map){
+
+    // parameter validation
+    if(!volume || !map){
+        return FAT_ERR_INVALID_PARAM;
+    }
+
+    // cached map - move to front of the list
+    fat_dir_slot_map_t **link = &volume->dir_slot_maps;
+    while(*link){
+        fat_dir_slot_map_t *current = *link;
+        if(current->dir_cluster == dir_cluster){
+            *link = current->next;
+            current->next = volume->dir_slot_maps;
+            volume->dir_slot_maps = current;
+            *map = current;
+            return FAT_OK;
+        }
+        link = &current->next;
+    }
+
+    // build new map from a slot scan
+    fat_dir_slot_map_t *new_map = calloc(1, sizeof(fat_dir_slot_map_t));
+    if(!new_map){
+        return FAT_ERR_NO_MEMORY;
+    }
+
+    fat_error_t err = fat_dir_slots_build(volume, dir_cluster, new_map);
+    if(err != FAT_OK){
+        fat_dir_slots_destroy(new_map);
+        return err;
+    }
+
+    // drop least recently used maps beyond the limit
+    uint32_t map_count = 1;
+    link = &volume->dir_slot_maps;
+    while(*link){
+        if(map_count >= FAT_DIR_SLOT_MAPS_MAX){
+            fat_dir_slot_map_t *current = *link;
+            *link = current->next;
+            fat_dir_slots_destroy(current);
+            continue;
+        }
+        map_count++;
+        link = &(*link)->next;
+    }
+
+    new_map->next = volume->dir_slot_maps;
+    volume->dir_slot_maps = new_map;
+    *map = new_map;
+    return FAT_OK;
+}
+
+fat_error_t fat_dir_slots_find(const fat_dir_slot_map_t *map,
+                               uint32_t num_entries,
+                               uint32_t *entry_index){
+
+    // parameter validation
+    if(!map || num_entries == 0 || !entry_index){
+        return FAT_ERR_INVALID_PARAM;
+    }
+
+    // first fit, groups start at the beginning of a run
+    for(uint32_t i = 0; i < map->run_count; i++){
+        if(map->runs[i].length >= num_entries){
+            *entry_index = map->runs[i].start;
+            return FAT_OK;
+        }
+    }
+
+    return FAT_ERR_DISK_FULL;
+}
+
+fat_error_t fat_dir_slots_extend(fat_volume_t *volume,
+                                 fat_dir_slot_map_t *map,
+                                 cluster_t first_new_cluster){
+
+    // parameter validation
+    if(!volume || !map || first_new_cluster < FAT_FIRST_VALID_CLUSTER){
+        return FAT_ERR_INVALID_PARAM;
+    }
+
+    // record clusters appended by fat_grow_directory
+    cluster_t current_cluster = first_new_cluster;
+    uint32_t cluster_count = 1;
+
+    while(1){
+        fat_error_t err = fat_dir_slots_append_cluster(map, current_cluster);
+        if(err != FAT_OK){
+            fat_dir_slots_invalidate(volume, map->dir_cluster);
+            return err;
+        }
+
+        cluster_t next_cluster;
+        err = fat_get_next_cluster(volume, current_cluster, &next_cluster);
+        if(err != FAT_OK){
+            fat_dir_slots_invalidate(volume, map->dir_cluster);
+            return err;
+        }
+
+        if(fat_is_eoc(volume, next_cluster)){
+            break;
+        }
+
+        if(next_cluster < FAT_FIRST_VALID_CLUSTER ||
+           cluster_count > volume->total_clusters){
+            fat_dir_slots_invalidate(volume, map->dir_cluster);
+            return FAT_ERR_CORRUPTED;
+        }
+
+        current_cluster = next_cluster;
+        cluster_count++;
+    }
+
+    uint32_t new_slots = cluster_count * (volume->bytes_per_cluster / 32);
+    fat_error_t err = fat_dir_slots_add_run(map, map->capacity, new_slots);
+    if(err != FAT_OK){
+        fat_dir_slots_invalidate(volume, map->dir_cluster);
+        return err;
+    }
+
+    map->capacity += new_slots;
+    map->last_cluster = current_cluster;
+    return FAT_OK;
+}
+
+static fat_dir_slot_map_t *fat_dir_slots_lookup(const fat_volume_t *volume,
+                                                cluster_t dir_cluster){
+    for(fat_dir_slot_map_t *current = volume->dir_slot_maps; current;
+        current = current->next){
+        if(current->dir_cluster == dir_cluster){
+            return current;
+        }
+    }
+    return NULL;
+}
+
+fat_error_t fat_dir_slots_locate(fat_volume_t *volume,
+                                 cluster_t dir_cluster,
+                                 uint32_t entry_index,
+                                 fat_dir_loc_t *loc){
+
+    // parameter validation
+    if(!volume || !loc){
+        return FAT_ERR_INVALID_PARAM;
+    }
+
+    // read only - the list order is left to fat_dir_slots_get, so readers
+    // under the shared volume lock may call this
+    const fat_dir_slot_map_t *map = fat_dir_slots_lookup(volume, dir_cluster);
+    if(!map || !map->clusters){
+        return FAT_ERR_NOT_FOUND;
+    }
+
+    uint32_t entries_per_sector = volume->bytes_per_sector / 32;
+    uint32_t entries_per_cluster = volume->bytes_per_cluster / 32;
+    uint32_t cluster_index = entry_index / entries_per_cluster;
+    uint32_t entry_in_cluster = entry_index % entries_per_cluster;
+
+    if(cluster_index >= map->cluster_count){
+        return FAT_ERR_NOT_FOUND;
+    }
+
+    loc->cluster = map->clusters[cluster_index];
+    loc->sector = fat_cluster_to_sector(volume, loc->cluster) +
+                    (entry_in_cluster / entries_per_sector);
+    loc->offset = (entry_in_cluster % entries_per_sector) * 32;
+    loc->index = entry_index;
+    return FAT_OK;
+}
+
+void fat_dir_slots_claim(fat_volume_t *volume,
+                         cluster_t dir_cluster,
+                         uint32_t entry_index,
+                         uint32_t count){
+
+    // parameter validation
+    if(!volume || count == 0){
+        return;
+    }
+
+    fat_dir_slot_map_t *map = fat_dir_slots_lookup(volume, dir_cluster);
+    if(!map){
+        return; // nothing cached, next lookup scans the directory
+    }
+
+    // find run containing the claimed range
+    for(uint32_t i = 0; i < map->run_count; i++){
+        fat_slot_run_t *run = &map->runs[i];
+        uint32_t run_end = run->start + run->length;
+
+        if(entry_index < run->start || entry_index >= run_end){
+            continue;
+        }
+
+        if(entry_index + count > run_end){
+            break;
+        }
+
+        if(entry_index == run->start){
+            // claim from the front (common case)
+            run->start += count;
+            run->length -= count;
+            if(run->length == 0){
+                fat_dir_slots_remove_run(map, i);
+            }
+            return;
+        }
+
+        // split run, keep head in place
+        uint32_t tail_start = entry_index + count;
+        run->length = entry_index - run->start;
+        if(tail_start < run_end &&
+           fat_dir_slots_insert_run(map, i + 1, tail_start,
+                                    run_end - tail_start) != FAT_OK){
+            break;
+        }
+        return;
+    }
+
+    // range not free in the map - rebuild from disk on next use
+    fat_dir_slots_invalidate(volume, dir_cluster);
+}
+
+void fat_dir_slots_release(fat_volume_t *volume,
+                           cluster_t dir_cluster,
+                           uint32_t entry_index,
+                           uint32_t count){
+
+    // parameter validation
+    if(!volume || count == 0){
+        return;
+    }
+
+    fat_dir_slot_map_t *map = fat_dir_slots_lookup(volume, dir_cluster);
+    if(!map){
+        return;
+    }
+
+    if(entry_index + count > map->capacity ||
+       fat_dir_slots_add_run(map, entry_index, count) != FAT_OK){
+        fat_dir_slots_invalidate(volume, dir_cluster);
+    }
+}
+
+void fat_dir_slots_invalidate(fat_volume_t *volume, cluster_t dir_cluster){
+
+    // parameter validation
+    if(!volume){
+        return;
+    }
+
+    fat_dir_slot_map_t **link = &volume->dir_slot_maps;
+    while(*link){
+        fat_dir_slot_map_t *current = *link;
+        if(current->dir_cluster == dir_cluster){
+            *link = current->next;
+            fat_dir_slots_destroy(current);
+            return;
+        }
+        link = &current->next;
+    }
+}
+
+void fat_dir_slots_free_all(fat_volume_t *volume){
+
+    // parameter validation
+    if(!volume){
+        return;
+    }
+
+    while(volume->dir_slot_maps){
+        fat_dir_slot_map_t *current = volume->dir_slot_maps;
+        volume->dir_slot_maps = current->next;
+        fat_dir_slots_destroy(current);
+    }
+}
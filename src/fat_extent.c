@@ -0,0 +1,255 @@
+#include "fat_extent.h"
+#include "fat_cluster.h"
+#include "fat_root.h"
+#include "fat_lock.h"
+#include "fat_file_buffer.h"
+#include <stdlib.h>
+
+// add a cluster to the end of the map, merging it into the last run
+static fat_error_t fat_extent_append(fat_extent_map_t *map, cluster_t cluster){
+
+    if(map->count > 0){
+        fat_extent_t *last = &map->extents[map->count - 1];
+        if(last->cluster + last->length == cluster){
+            last->length++;
+            map->clusters++;
+            return FAT_OK;
+        }
+    }
+
+    if(map->count == map->capacity){
+        uint32_t capacity = map->capacity ? map->capacity * 2 : 8;
+        fat_extent_t *extents = realloc(map->extents, 
+                                        capacity * sizeof(fat_extent_t));
+        if(!extents){
+            return FAT_ERR_NO_MEMORY;
+        }
+        map->extents = extents;
+        map->capacity = capacity;
+    }
+
+    fat_extent_t *extent = &map->extents[map->count++];
+    extent->index = map->clusters;
+    extent->cluster = cluster;
+    extent->length = 1;
+    map->clusters++;
+    return FAT_OK;
+}
+
+// follow the chain until index is mapped and its run is complete, or the
+// chain ends
+static fat_error_t fat_extent_map_to(fat_volume_t *volume, 
+                                     fat_extent_map_t *map, 
+                                     uint32_t index){
+
+    while(!map->complete){
+        cluster_t next;
+        if(map->count == 0){
+            next = map->start_cluster;
+        } else {
+            fat_extent_t *last = &map->extents[map->count - 1];
+            cluster_t current = last->cluster + last->length - 1;
+            fat_error_t err = fat_get_next_cluster(volume, current, &next);
+            if(err != FAT_OK){
+                return err;
+            }
+            if(fat_is_eoc(volume, next)){
+                map->complete = true;
+                break;
+            }
+
+            // index mapped and the run holding it ends here
+            if(map->clusters > index && next != current + 1){
+                break;
+            }
+        }
+
+        if(next < FAT_FIRST_VALID_CLUSTER || 
+           next >= FAT_FIRST_VALID_CLUSTER + volume->total_clusters){
+            return FAT_ERR_CORRUPTED;
+        }
+
+        // a chain cannot be longer than the volume
+        if(map->clusters >= volume->total_clusters){
+            return FAT_ERR_CORRUPTED;
+        }
+
+        fat_error_t err = fat_extent_append(map, next);
+        if(err != FAT_OK){
+            return err;
+        }
+    }
+
+    return FAT_OK;
+}
+
+static fat_error_t fat_extent_lookup_locked(fat_file_t *file, 
+                                            cluster_t start_cluster, 
+                                            uint32_t index, 
+                                            cluster_t *cluster, 
+                                            uint32_t *run_length){
+
+    fat_extent_map_t *map = file->extents;
+    if(map && map->start_cluster != start_cluster){
+        fat_extent_free(file);
+        map = NULL;
+    }
+
+    if(!map){
+        map = calloc(1, sizeof(fat_extent_map_t));
+        if(!map){
+            return FAT_ERR_NO_MEMORY;
+        }
+        map->start_cluster = start_cluster;
+        file->extents = map;
+    }
+
+    // the chain may have grown since the end was seen, and a run ending the
+    // map may continue
+    if(index >= map->clusters || 
+       (map->count > 0 && index >= map->extents[map->count - 1].index)){
+        map->complete = false;
+    }
+
+    fat_error_t err = fat_extent_map_to(file->volume, map, index);
+    if(err != FAT_OK){
+        return err;
+    }
+
+    if(index >= map->clusters){
+        return FAT_ERR_EOF;
+    }
+
+    // binary search for the run holding index
+    uint32_t low = 0;
+    uint32_t high = map->count - 1;
+    while(low < high){
+        uint32_t mid = (low + high + 1) / 2;
+        if(map->extents[mid].index <= index){
+            low = mid;
+        } else {
+            high = mid - 1;
+        }
+    }
+
+    fat_extent_t *extent = &map->extents[low];
+    *cluster = extent->cluster + (index - extent->index);
+    if(run_length){
+        *run_length = extent->length - (index - extent->index);
+    }
+    return FAT_OK;
+}
+
+fat_error_t fat_extent_lookup(fat_file_t *file, 
+                              cluster_t start_cluster, 
+                              uint32_t index, 
+                              cluster_t *cluster, 
+                              uint32_t *run_length){
+
+    // parameter validation
+    if(!file || !file->volume || !cluster){
+        return FAT_ERR_INVALID_PARAM;
+    }
+
+    if(start_cluster < FAT_FIRST_VALID_CLUSTER){
+        return FAT_ERR_INVALID_CLUSTER;
+    }
+
+    fat_lock_extents(file);
+    fat_error_t err = fat_extent_lookup_locked(file, start_cluster, index, 
+                                               cluster, run_length);
+    fat_unlock_extents(file);
+    return err;
+}
+
+void fat_extent_free(fat_file_t *file){
+
+    // parameter validation
+    if(!file || !file->extents){
+        return;
+    }
+
+    free(file->extents->extents);
+    free(file->extents);
+    file->extents = NULL;
+}
+
+static fat_error_t fat_get_extents_locked(fat_file_t *file, 
+                                          uint32_t offset, 
+                                          uint32_t length, 
+                                          fat_file_extent_t *extents, 
+                                          uint32_t *count){
+
+    fat_volume_t *volume = file->volume;
+    uint32_t file_size = file->dir_entry.file_size;
+    cluster_t start_cluster = fat_get_entry_cluster(volume, &file->dir_entry);
+    uint32_t capacity = extents ? *count : UINT32_MAX;
+    uint32_t found = 0;
+
+    *count = 0;
+    if(offset >= file_size || length == 0 || start_cluster == 0){
+        return FAT_OK;
+    }
+
+    uint32_t end = (length > file_size - offset) ? file_size : offset + length;
+    uint32_t position = offset;
+
+    while(position < end && found < capacity){
+        uint32_t cluster_offset = position % volume->bytes_per_cluster;
+        cluster_t cluster;
+        uint32_t run_length;
+        fat_error_t err = fat_extent_lookup(file, start_cluster, 
+                                            position / volume->bytes_per_cluster, 
+                                            &cluster, &run_length);
+        if(err != FAT_OK){
+            return err;
+        }
+
+        uint64_t run_bytes = (uint64_t)run_length * volume->bytes_per_cluster - 
+                                cluster_offset;
+        uint32_t span = (run_bytes < end - position) ? (uint32_t)run_bytes : 
+                                                       end - position;
+
+        if(extents){
+            fat_file_extent_t *extent = &extents[found];
+            extent->logical = position;
+            extent->sector = fat_cluster_to_sector(volume, cluster) + 
+                                cluster_offset / volume->bytes_per_sector;
+            extent->sector_offset = cluster_offset % volume->bytes_per_sector;
+            extent->length = span;
+            extent->flags = (position + span == file_size) ? FAT_EXTENT_LAST : 0;
+        }
+
+        found++;
+        position += span;
+    }
+
+    *count = found;
+    return FAT_OK;
+}
+
+fat_error_t fat_get_extents(fat_file_t *file, 
+                            uint32_t offset, 
+                            uint32_t length, 
+                            fat_file_extent_t *extents, 
+                            uint32_t *count){
+
+    // parameter validation
+    if(!file || !file->volume || !count){
+        return FAT_ERR_INVALID_PARAM;
+    }
+
+    // the chain is only read
+    fat_lock_file(file);
+    fat_lock_volume_shared(file->volume);
+
+    // a consumer reading the device must see the buffered data
+    fat_error_t err = fat_buffer_flush(file);
+    if(err == FAT_OK){
+        err = fat_get_extents_locked(file, offset, length, extents, count);
+    }
+
+    fat_unlock_volume(file->volume);
+    fat_unlock_file(file);
+    return err;
+}
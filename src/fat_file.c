@@ -3,17 +3,17 @@
 #include "fat_dir_search.h"
 #include "fat_root.h"
 #include "fat_cluster.h"
+#include "fat_lock.h"
+#include "fat_extent.h"
+#include "fat_file_truncate.h"
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
 
 bool fat_validate_open_flags(int flags, const fat_dir_entry_t *entry){
 
-    int access_mode = flags & (FAT_O_RDONLY | FAT_O_WRONLY | FAT_O_RDWR);
-    if(access_mode == (FAT_O_RDONLY | FAT_O_WRONLY)){
-        return false;
-    }
-
+    // FAT_O_RDWR is both bits
+    int access_mode = flags & FAT_O_RDWR;
     if (access_mode == 0){
         return false;
     }
@@ -23,15 +23,14 @@ bool fat_validate_open_flags(int flags, const fat_dir_entry_t *entry){
             return false;
         }
 
-        if((entry->attr & FAT_ATTR_READ_ONLY) && 
-           (flags & (FAT_O_WRONLY | FAT_O_RDWR)))
-        {
+        if((entry->attr & FAT_ATTR_READ_ONLY) && (flags & FAT_O_WRONLY)){
             return false;
         }
 
     }
 
-    if((flags & FAT_O_CREATE) && !(flags & (FAT_O_WRONLY | FAT_O_RDWR))){
+    if((flags & (FAT_O_CREATE | FAT_O_TRUNC | FAT_O_APPEND)) && 
+       !(flags & FAT_O_WRONLY)){
         return false;
     }
 
@@ -56,15 +55,97 @@ void fat_update_file_timestamps(fat_dir_entry_t *entry){
     entry->write_date = fat_date;
 }
 
+void fat_register_open_file(fat_file_t *file){
+
+    // parameter validation
+    if(!file || !file->volume){
+        return;
+    }
+
+    file->next_open = file->volume->open_files;
+    file->volume->open_files = file;
+}
+
+void fat_unregister_open_file(fat_file_t *file){
+
+    // parameter validation
+    if(!file || !file->volume){
+        return;
+    }
+
+    fat_file_t **link = &file->volume->open_files;
+    while(*link){
+        if(*link == file){
+            *link = file->next_open;
+            file->next_open = NULL;
+            return;
+        }
+        link = &(*link)->next_open;
+    }
+}
+
+bool fat_same_file(const fat_file_t *a, const fat_file_t *b){
+
+    if(a == b){
+        return true;
+    }
+
+    return a->dir_entry_offset != FAT_DIR_ENTRY_DETACHED &&
+           a->dir_cluster == b->dir_cluster &&
+           a->dir_entry_offset == b->dir_entry_offset;
+}
+
+void fat_share_file_size(fat_file_t *file){
+
+    // parameter validation
+    if(!file || !file->volume){
+        return;
+    }
+
+    cluster_t start_cluster = fat_get_entry_cluster(file->volume, 
+                                                    &file->dir_entry);
+
+    for(fat_file_t *open = file->volume->open_files; open; 
+        open = open->next_open){
+        if(open == file || !fat_same_file(open, file) ||
+           open->dir_entry.file_size >= file->dir_entry.file_size){
+            continue;
+        }
+
+        // an empty file got its first cluster through the other handle
+        if(fat_get_entry_cluster(open->volume, &open->dir_entry) == 0){
+            fat_set_entry_cluster(open->volume, &open->dir_entry, start_cluster);
+            open->current_cluster = start_cluster;
+        }
+        open->dir_entry.file_size = file->dir_entry.file_size;
+    }
+}
+
+bool fat_file_is_shared(const fat_file_t *file){
+
+    // parameter validation
+    if(!file || !file->volume){
+        return false;
+    }
+
+    for(fat_file_t *open = file->volume->open_files; open; 
+        open = open->next_open){
+        if(open != file && fat_same_file(open, file)){
+            return true;
+        }
+    }
+    return false;
+}
+
 fat_error_t fat_init_file_handle(fat_file_t *file, 
                                  fat_volume_t *volume,
                                  const fat_dir_entry_t *dir_entry, 
                                  cluster_t dir_cluster,
-                                 uint32_t dir_entry_offset, 
+                                 const fat_dir_loc_t *dir_entry_loc, 
                                  int flags){
     
     // parameter validation
-    if(!file || !volume || !dir_entry){
+    if(!file || !volume || !dir_entry || !dir_entry_loc){
         return FAT_ERR_INVALID_PARAM;
     }
 
@@ -73,7 +154,8 @@ fat_error_t fat_init_file_handle(fat_file_t *file,
     file->volume = volume;
     memcpy(&file->dir_entry, dir_entry, sizeof(fat_dir_entry_t));
     file->dir_cluster = dir_cluster;
-    file->dir_entry_offset = dir_entry_offset;
+    file->dir_entry_offset = dir_entry_loc->index;
+    file->dir_entry_loc = *dir_entry_loc;
     file->flags = flags;
     file->modified = false;
 
@@ -82,20 +164,13 @@ fat_error_t fat_init_file_handle(fat_file_t *file,
 
     file->current_cluster = fat_get_entry_cluster(volume, dir_entry);
 
-    // handle truncation
-    if(flags & FAT_O_TRUNC){
-        // TODO implement file truncation - free all clusters and set size to 0
-        file->dir_entry.file_size = 0;
-        file->modified = true;
-    }
-
     return FAT_OK;
 }
 
-fat_error_t fat_open(fat_volume_t *volume, 
-                     const char *path, 
-                     int flags, 
-                     fat_file_t **file){
+static fat_error_t fat_open_locked(fat_volume_t *volume, 
+                                   const char *path, 
+                                   int flags, 
+                                   fat_file_t **file){
 
     // parameter validation
     if(!volume || !path || !file){
@@ -111,13 +186,13 @@ fat_error_t fat_open(fat_volume_t *volume,
 
     fat_dir_entry_t dir_entry;
     cluster_t parent_cluster;
-    uint32_t entry_index;
+    fat_dir_loc_t entry_loc;
 
-    fat_error_t err = fat_resolve_path(volume, 
-                                       path, 
-                                       &dir_entry, 
-                                       &parent_cluster, 
-                                       &entry_index);
+    fat_error_t err = fat_resolve_path_loc(volume, 
+                                           path, 
+                                           &dir_entry, 
+                                           &parent_cluster, 
+                                           &entry_loc);
     if(err == FAT_ERR_NOT_FOUND){
         
         // file does not exist
@@ -150,7 +225,7 @@ fat_error_t fat_open(fat_volume_t *volume,
                                volume, 
                                &dir_entry, 
                                parent_cluster,
-                               entry_index, 
+                               &entry_loc, 
                                flags);
 
     if(err != FAT_OK){
@@ -158,64 +233,51 @@ fat_error_t fat_open(fat_volume_t *volume,
         return err;
     }
 
-    *file = new_file;
-    return FAT_OK;
-}
-
-fat_error_t fat_close(fat_file_t *file){
-    if(!file){
-        return FAT_ERR_INVALID_PARAM;
+    err = fat_lock_file_init(new_file);
+    if(err != FAT_OK){
+        free(new_file);
+        return err;
     }
 
-    fat_error_t result = FAT_OK;
-
-    if(file->modified){
-        fat_update_file_timestamps(&file->dir_entry);
-        
-        uint32_t sector;
-        uint32_t offset;
-
-        if(file->dir_cluster == 0 && file->volume->type != FAT_TYPE_FAT32){
-            
-            // FAT12/16 root
-            uint32_t entries_per_sector = file->volume->bytes_per_sector / 32;
-            uint32_t root_start = file->volume->reserved_sector_count + 
-                                (file->volume->num_fats * 
-                                    file->volume->fat_size_sectors);
-            sector = root_start + (file->dir_entry_offset / entries_per_sector);
-            offset = (file->dir_entry_offset % entries_per_sector) * 32;
-        } else {
+    fat_register_open_file(new_file);
 
-            // FAT32 or subdirectory
-            uint32_t entries_per_cluster = file->volume->bytes_per_cluster / 32;
-            uint32_t cluster_index=file->dir_entry_offset / entries_per_cluster;
-
-            // walk cluster chain
-            cluster_t target_cluster = file->dir_cluster;
-            for(uint32_t i = 0; i<cluster_index; i++){
-                fat_error_t err = fat_get_next_cluster (file->volume, 
-                                                        target_cluster, 
-                                                        &target_cluster);
-                if(err != FAT_OK){
-                    result = err;
-                    goto cleanup;
-                }
-            }
-
-            sector = fat_cluster_to_sector(file->volume, target_cluster);
-            offset = (file->dir_entry_offset % entries_per_cluster) * 32;
+    // an open handle may be ahead of the entry on disk
+    for(fat_file_t *open = volume->open_files; open; open = open->next_open){
+        if(open != new_file && fat_same_file(open, new_file)){
+            fat_share_file_size(open);
+            break;
         }
+    }
 
-        fat_error_t err = fat_write_dir_entry(file->volume, sector, offset, 
-                                              &file->dir_entry);
-        
+    // nobody else has the handle yet, the volume lock is enough
+    if(flags & FAT_O_TRUNC){
+        err = fat_truncate_file(new_file, 0);
         if(err != FAT_OK){
-            result = err;
+            fat_unregister_open_file(new_file);
+            fat_lock_file_destroy(new_file);
+            fat_extent_free(new_file);
+            free(new_file);
+            return err;
         }
     }
 
-// free file handle memory regardless of errors
-cleanup:
-    free(file);
-    return result;
+    *file = new_file;
+    return FAT_OK;
+}
+
+fat_error_t fat_open(fat_volume_t *volume, 
+                     const char *path, 
+                     int flags, 
+                     fat_file_t **file){
+
+    // parameter validation
+    if(!volume || !path || !file){
+        return FAT_ERR_INVALID_PARAM;
+    }
+
+    fat_lock_volume(volume);
+    fat_error_t err = fat_open_locked(volume, path, flags, file);
+    fat_unlock_volume(volume);
+    return err;
 }
+
@@ -0,0 +1,102 @@
+#include "fat_file_advise.h"
+#include "fat_file_buffer.h"
+#include "fat_file_write.h"
+#include "fat_extent.h"
+#include "fat_lock.h"
+
+// put clusters up to last_index of the chain into the extent map
+static fat_error_t fat_advise_map(fat_file_t *file, uint32_t last_index){
+
+    cluster_t start_cluster = fat_get_entry_cluster(file->volume,
+                                                    &file->dir_entry);
+    if(start_cluster == 0){
+        return FAT_OK;
+    }
+
+    cluster_t cluster;
+    fat_error_t err = fat_extent_lookup(file, start_cluster, last_index,
+                                        &cluster, NULL);
+
+    // a chain shorter than the size says is mapped as far as it goes
+    return (err == FAT_ERR_EOF) ? FAT_OK : err;
+}
+
+static fat_error_t fat_fadvise_locked(fat_file_t *file,
+                                      uint32_t offset,
+                                      uint32_t end,
+                                      int advice){
+
+    fat_volume_t *volume = file->volume;
+    uint32_t file_size = file->dir_entry.file_size;
+
+    switch(advice){
+    case FAT_FADV_NORMAL:
+    case FAT_FADV_SEQUENTIAL:
+        file->advice = (uint8_t)advice;
+        return FAT_OK;
+
+    case FAT_FADV_RANDOM:
+        file->advice = (uint8_t)advice;
+        if(file_size == 0){
+            return FAT_OK;
+        }
+        return fat_advise_map(file, (file_size - 1) / volume->bytes_per_cluster);
+
+    case FAT_FADV_WILLNEED:
+        if(offset >= file_size){
+            return FAT_OK;
+        }
+        if(end > file_size){
+            end = file_size;
+        }
+        return fat_advise_map(file, (end - 1) / volume->bytes_per_cluster);
+
+    case FAT_FADV_DONTNEED: {
+        fat_write_buffer_t *wb = file->write_buffer;
+        if(wb && wb->length > 0 && wb->start < end &&
+           wb->start + wb->length > offset){
+            fat_error_t err = fat_buffer_flush(file);
+            if(err != FAT_OK){
+                return err;
+            }
+        }
+
+        // the map is one piece from the start of the chain
+        if(offset == 0 && end >= file_size){
+            fat_lock_extents(file);
+            fat_extent_free(file);
+            fat_unlock_extents(file);
+        }
+        return FAT_OK;
+    }
+
+    case FAT_FADV_NOREUSE:
+        return FAT_OK;
+
+    default:
+        return FAT_ERR_INVALID_PARAM;
+    }
+}
+
+fat_error_t fat_fadvise(fat_file_t *file,
+                        uint32_t offset,
+                        uint32_t length,
+                        int advice){
+
+    // parameter validation
+    if(!file || !file->volume){
+        return FAT_ERR_INVALID_PARAM;
+    }
+
+    // exclusive end of the range, 0 and overlong lengths reach the last byte
+    uint32_t end = (length == 0 || length > FAT_MAX_FILE_SIZE - offset) ?
+                   FAT_MAX_FILE_SIZE : offset + length;
+
+    // the chain is only read
+    fat_lock_file(file);
+    fat_lock_volume_shared(file->volume);
+    fat_error_t err = fat_fadvise_locked(file, offset, end, advice);
+    fat_unlock_volume(file->volume);
+    fat_unlock_file(file);
+    return err;
+}
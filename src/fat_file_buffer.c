@@ -0,0 +1,221 @@
+#include "fat_file_buffer.h"
+#include "fat_file_write.h"
+#include "fat_file_read.h"
+#include "fat_lock.h"
+#include <string.h>
+#include <stdlib.h>
+
+fat_error_t fat_buffer_flush(fat_file_t *file){
+
+    // parameter validation
+    if(!file){
+        return FAT_ERR_INVALID_PARAM;
+    }
+
+    fat_write_buffer_t *wb = file->write_buffer;
+    if(!wb || wb->length == 0){
+        return FAT_OK;
+    }
+
+    // clusters exist already, this only writes data
+    fat_ssize_t result = fat_write_at(file, wb->data, wb->length, wb->start);
+    if(result < 0){
+        return (fat_error_t)-result;
+    }
+
+    if((uint32_t)result < wb->length){
+        // keep what did not make it
+        memmove(wb->data, &wb->data[result], wb->length - result);
+        wb->start += result;
+        wb->length -= result;
+        return FAT_ERR_DEVICE_ERROR;
+    }
+
+    wb->length = 0;
+    return FAT_OK;
+}
+
+void fat_buffer_free(fat_file_t *file){
+
+    // parameter validation
+    if(!file || !file->write_buffer){
+        return;
+    }
+
+    free(file->write_buffer->data);
+    free(file->write_buffer);
+    file->write_buffer = NULL;
+}
+
+// advance the cluster cursor over size bytes from the position, leaving it
+// where a direct write would
+static fat_error_t fat_buffer_advance_cursor(fat_file_t *file, size_t size){
+
+    fat_error_t err = fat_seek_to_position(file, file->position);
+    if(err != FAT_OK){
+        return err;
+    }
+
+    uint32_t end = file->cluster_offset + size;
+    while(end > file->volume->bytes_per_cluster){
+        cluster_t next_cluster;
+        err = fat_get_next_cluster(file->volume, file->current_cluster, 
+                                   &next_cluster);
+        if(err != FAT_OK){
+            return err;
+        }
+        if(fat_is_eoc(file->volume, next_cluster)){
+            return FAT_ERR_CORRUPTED;
+        }
+        file->current_cluster = next_cluster;
+        end -= file->volume->bytes_per_cluster;
+    }
+
+    file->cluster_offset = end;
+    file->position += size;
+    return FAT_OK;
+}
+
+int fat_buffer_write(fat_file_t *file, const void *buffer, size_t size){
+
+    // parameter validation
+    if(!file || !buffer || size == 0){
+        return -FAT_ERR_INVALID_PARAM;
+    }
+
+    fat_write_buffer_t *wb = file->write_buffer;
+    if(!wb){
+        return FAT_BUFFER_BYPASS;
+    }
+
+    // anything but a small write continuing the buffered range flushes
+    bool continues = (wb->length == 0 || file->position == wb->start + wb->length);
+    if(!continues || size >= wb->capacity){
+        fat_error_t err = fat_buffer_flush(file);
+        if(err != FAT_OK){
+            return -err;
+        }
+        if(size >= wb->capacity){
+            return FAT_BUFFER_BYPASS;
+        }
+    }
+
+    // allocate now, so flushing never touches the FAT
+    if(file->position + size > file->dir_entry.file_size){
+        fat_error_t err = fat_extend_file(file, file->position + size, 0);
+        if(err != FAT_OK){
+            return -err;
+        }
+    }
+
+    const uint8_t *input_buffer = (const uint8_t *)buffer;
+    size_t accepted = 0;
+    fat_error_t err = FAT_OK;
+
+    while(accepted < size){
+        if(wb->length == 0){
+            wb->start = file->position + accepted;
+            wb->since = time(NULL);
+        }
+
+        // windows are aligned to the capacity, so every flush after the
+        // first one writes whole sectors
+        uint64_t window_end = ((uint64_t)wb->start / wb->capacity + 1) * 
+                                wb->capacity;
+        uint64_t room = window_end - (wb->start + wb->length);
+        size_t chunk_size = size - accepted;
+        if(chunk_size > room){
+            chunk_size = (size_t)room;
+        }
+
+        memcpy(&wb->data[wb->length], &input_buffer[accepted], chunk_size);
+        wb->length += chunk_size;
+        accepted += chunk_size;
+
+        if(wb->start + wb->length == window_end){
+            err = fat_buffer_flush(file);
+            if(err != FAT_OK){
+                break;
+            }
+        }
+    }
+
+    if(accepted == 0){
+        return -err;
+    }
+
+    fat_error_t cursor_err = fat_buffer_advance_cursor(file, accepted);
+    if(file->position > file->dir_entry.file_size){
+        file->dir_entry.file_size = file->position;
+        fat_share_file_size(file);
+    }
+    file->modified = true;
+
+    if(cursor_err != FAT_OK){
+        return -cursor_err;
+    }
+    return (int)accepted;
+}
+
+fat_error_t fat_set_write_buffer(fat_file_t *file, uint32_t clusters){
+
+    // parameter validation
+    if(!file || !file->volume){
+        return FAT_ERR_INVALID_PARAM;
+    }
+
+    uint64_t capacity = (uint64_t)clusters * file->volume->bytes_per_cluster;
+    if(capacity > INT32_MAX){
+        return FAT_ERR_INVALID_PARAM;
+    }
+
+    fat_write_buffer_t *wb = NULL;
+    if(clusters > 0){
+        wb = malloc(sizeof(fat_write_buffer_t));
+        if(!wb){
+            return FAT_ERR_NO_MEMORY;
+        }
+        wb->data = malloc((size_t)capacity);
+        if(!wb->data){
+            free(wb);
+            return FAT_ERR_NO_MEMORY;
+        }
+        wb->capacity = (uint32_t)capacity;
+        wb->start = 0;
+        wb->length = 0;
+    }
+
+    fat_lock_file(file);
+    fat_lock_volume_shared(file->volume);
+
+    // the old buffer goes out first
+    fat_error_t err = fat_buffer_flush(file);
+    if(err == FAT_OK){
+        fat_buffer_free(file);
+        file->write_buffer = wb;
+    }
+
+    fat_unlock_volume(file->volume);
+    fat_unlock_file(file);
+
+    if(err != FAT_OK && wb){
+        free(wb->data);
+        free(wb);
+    }
+    return err;
+}
+
+fat_error_t fat_fflush(fat_file_t *file){
+
+    // parameter validation
+    if(!file || !file->volume){
+        return FAT_ERR_INVALID_PARAM;
+    }
+
+    fat_lock_file(file);
+    fat_lock_volume_shared(file->volume);
+    fat_error_t err = fat_buffer_flush(file);
+    fat_unlock_volume(file->volume);
+    fat_unlock_file(file);
+    return err;
+}
@@ -2,6 +2,10 @@
 #include "fat_dir.h"
 #include "fat_cluster.h"
 #include "fat_root.h"
+#include "fat_commit.h"
+#include "fat_lock.h"
+#include "fat_extent.h"
+#include "fat_file_buffer.h"
 #include <stdlib.h>
 #include <time.h>
 
@@ -16,7 +20,8 @@ bool fat_validate_file_handle(fat_file_t *file){
     }
 
     // check if position is more than a cluster beyond file_size
-    if(file->position > file->dir_entry.file_size+file->volume->bytes_per_cluster){
+    if(file->position > (uint64_t)file->dir_entry.file_size + 
+                        file->volume->bytes_per_cluster){
         return false;
     }
 
@@ -37,42 +42,16 @@ fat_error_t fat_calculate_directory_entry_location(fat_file_t *file,
         return FAT_ERR_INVALID_PARAM;
     }
 
-    bool is_root_fat12 = (file->dir_cluster == 0 &&
-                          file->volume->type != FAT_TYPE_FAT32);
-    if(is_root_fat12){
-        // FAT12/16 root directory
-        uint32_t entries_per_sector = file->volume->bytes_per_sector / 32;
-        uint32_t root_start_sector = file->volume->reserved_sector_count +
-                                        (file->volume->num_fats * 
-                                         file->volume->fat_size_sectors);
-        *sector = root_start_sector+(file->dir_entry_offset / entries_per_sector);
-        *offset = (file->dir_entry_offset % entries_per_sector) * 32;
-    } else {
-        // FAT32 or subdirectory
-        uint32_t entries_per_cluster = file->volume->bytes_per_cluster / 32;
-        uint32_t cluster_index = file->dir_entry_offset / entries_per_cluster;
-        uint32_t entry_in_cluster = file->dir_entry_offset % entries_per_cluster;
-
-        // walk cluster chain
-        cluster_t target_cluster = file->dir_cluster;
-        for(uint32_t i=0 ; i<cluster_index; i++){
-            fat_error_t err = fat_get_next_cluster(file->volume, 
-                                                   target_cluster, 
-                                                   &target_cluster);
-            if(err != FAT_OK || fat_is_eoc(file->volume, target_cluster)){
-                return FAT_ERR_CORRUPTED;
-            }
-        }
-
-        // convert cluster to sector
-        uint32_t cluster_first_sector = fat_cluster_to_sector(file->volume, 
-                                                              target_cluster);
-        uint32_t entries_per_sector = file->volume->bytes_per_sector / 32;
-
-        *sector = cluster_first_sector + (entry_in_cluster / entries_per_sector);
-        *offset = (entry_in_cluster % entries_per_sector) * 32;
+    // location recorded at open/create - no chain walk
+    if(file->dir_entry_loc.sector != 0 && 
+       file->dir_entry_loc.index == file->dir_entry_offset){
+        *sector = file->dir_entry_loc.sector;
+        *offset = file->dir_entry_loc.offset;
+        return FAT_OK;
     }
-    return FAT_OK;
+
+    return fat_locate_dir_entry(file->volume, file->dir_cluster, 
+                                file->dir_entry_offset, sector, offset);
 }
 
 fat_error_t fat_update_directory_entry(fat_file_t *file, 
@@ -83,6 +62,11 @@ fat_error_t fat_update_directory_entry(fat_file_t *file,
         return FAT_ERR_INVALID_PARAM;
     }
 
+    // no entry left to update
+    if(file->dir_entry_offset == FAT_DIR_ENTRY_DETACHED){
+        return FAT_OK;
+    }
+
     uint32_t sector, offset;
     fat_error_t err = fat_calculate_directory_entry_location(file, 
                                                              &sector, 
@@ -101,8 +85,8 @@ fat_error_t fat_flush_file_data(fat_file_t *file){
         return FAT_ERR_INVALID_PARAM;
     }
 
-    // flush volume level caches
-    fat_error_t err = fat_flush(file->volume);
+    // flush volume level caches (or queue them for the next group commit)
+    fat_error_t err = fat_commit(file->volume);
     if(err != FAT_OK){
         return err;
     }
@@ -113,14 +97,20 @@ fat_error_t fat_flush_file_data(fat_file_t *file){
     return FAT_OK;
 }
 
-fat_error_t fat_close(fat_file_t *file){
+static fat_error_t fat_close_locked(fat_file_t *file){
 
     // parameter validation
     if(!file){
         return FAT_ERR_INVALID_PARAM;
     }
 
-    fat_error_t result = FAT_OK;
+    // buffered data before the entry that makes it part of the file
+    fat_error_t result = fat_buffer_flush(file);
+    fat_buffer_free(file);
+
+    fat_unregister_open_file(file);
+    fat_lock_file_destroy(file);
+    fat_extent_free(file);
 
     if(!fat_validate_file_handle(file)){
         free(file);
@@ -145,4 +135,20 @@ fat_error_t fat_close(fat_file_t *file){
     // cleanup
     free(file);
     return result;
-}
\ No newline at end of file
+}
+
+fat_error_t fat_close(fat_file_t *file){
+
+    // parameter validation
+    if(!file){
+        return FAT_ERR_INVALID_PARAM;
+    }
+
+    // handle is freed by the close
+    fat_volume_t *volume = file->volume;
+
+    fat_lock_volume(volume);
+    fat_error_t err = fat_close_locked(file);
+    fat_unlock_volume(volume);
+    return err;
+}
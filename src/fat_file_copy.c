@@ -0,0 +1,356 @@
+#include "fat_file_copy.h"
+#include "fat_file_create.h"
+#include "fat_file_truncate.h"
+#include "fat_file_read.h"
+#include "fat_file_write.h"
+#include "fat_file_seek.h"
+#include "fat_file_buffer.h"
+#include "fat_extent.h"
+#include "fat_root.h"
+#include "fat_lock.h"
+#include <stdint.h>
+#include <stdlib.h>
+
+// handle locks in address order, so two copies in opposite directions
+// cannot deadlock
+static void fat_copy_lock(fat_file_t *in, fat_file_t *out){
+
+    if(in == out){
+        fat_lock_file(in);
+        return;
+    }
+
+    if((uintptr_t)in < (uintptr_t)out){
+        fat_lock_file(in);
+        fat_lock_file(out);
+    } else {
+        fat_lock_file(out);
+        fat_lock_file(in);
+    }
+}
+
+static void fat_copy_unlock(fat_file_t *in, fat_file_t *out){
+    fat_unlock_file(in);
+    if(out != in){
+        fat_unlock_file(out);
+    }
+}
+
+// length bytes between two physically contiguous cluster runs
+static fat_error_t fat_copy_run(fat_volume_t *volume,
+                                cluster_t source,
+                                uint32_t source_offset,
+                                cluster_t target,
+                                uint32_t target_offset,
+                                size_t length,
+                                uint8_t **bounce,
+                                size_t bounce_size){
+
+    fat_block_device_t *device = volume->device;
+    uint16_t bytes_per_sector = volume->bytes_per_sector;
+
+    // whole sectors on both sides - the device copies them itself
+    if(device->copy_sectors && length >= bytes_per_sector &&
+       source_offset % bytes_per_sector == 0 &&
+       target_offset % bytes_per_sector == 0){
+
+        uint32_t sectors = (uint32_t)(length / bytes_per_sector);
+        uint32_t source_sector = fat_cluster_to_sector(volume, source) +
+                                    source_offset / bytes_per_sector;
+        uint32_t target_sector = fat_cluster_to_sector(volume, target) +
+                                    target_offset / bytes_per_sector;
+
+        if(device->copy_sectors(device->device_data, source_sector,
+                                target_sector, sectors) != 0){
+            return FAT_ERR_DEVICE_ERROR;
+        }
+
+        size_t done = (size_t)sectors * bytes_per_sector;
+        source_offset += done;
+        target_offset += done;
+        length -= done;
+    }
+
+    while(length > 0){
+        if(!*bounce){
+            *bounce = malloc(bounce_size);
+            if(!*bounce){
+                return FAT_ERR_NO_MEMORY;
+            }
+        }
+
+        // chunks after the first start on a target sector, only the head
+        // and tail of the run are read, modified and written back
+        size_t step = bounce_size - target_offset % bytes_per_sector;
+        if(step > length){
+            step = length;
+        }
+
+        fat_error_t err = fat_read_cluster_run(volume, source, source_offset,
+                                               *bounce, step);
+        if(err != FAT_OK){
+            return err;
+        }
+
+        err = fat_write_cluster_run(volume, target, target_offset,
+                                    *bounce, step);
+        if(err != FAT_OK){
+            return err;
+        }
+
+        source_offset += step;
+        target_offset += step;
+        length -= step;
+    }
+
+    return FAT_OK;
+}
+
+// caller holds both handle locks and the exclusive volume lock
+static fat_ssize_t fat_copy_range_locked(fat_file_t *in,
+                                         uint32_t in_position,
+                                         fat_file_t *out,
+                                         uint32_t out_position,
+                                         size_t length){
+
+    fat_volume_t *volume = in->volume;
+
+    // buffered data of either handle reaches the device first
+    fat_error_t err = fat_buffer_flush(in);
+    if(err == FAT_OK && out != in){
+        err = fat_buffer_flush(out);
+    }
+    if(err != FAT_OK){
+        return -(fat_ssize_t)err;
+    }
+
+    // no holes - the copy lands inside out or right at its end
+    if(out_position > out->dir_entry.file_size){
+        return -FAT_ERR_INVALID_PARAM;
+    }
+
+    if(in_position >= in->dir_entry.file_size){
+        return 0;
+    }
+
+    if(length > in->dir_entry.file_size - in_position){
+        length = in->dir_entry.file_size - in_position;
+    }
+
+    // a FAT file ends at 4 GiB - 1, copy what fits
+    if(length > FAT_MAX_FILE_SIZE - out_position){
+        if(out_position == FAT_MAX_FILE_SIZE){
+            return -FAT_ERR_FILE_TOO_LARGE;
+        }
+        length = FAT_MAX_FILE_SIZE - out_position;
+    }
+
+    if(fat_same_file(in, out) &&
+       (uint64_t)in_position < (uint64_t)out_position + length &&
+       (uint64_t)out_position < (uint64_t)in_position + length){
+        return -FAT_ERR_INVALID_PARAM;
+    }
+
+    // clusters for the whole range in one go, requested as one run
+    if(out_position + length > out->dir_entry.file_size){
+        err = fat_extend_file(out, out_position + length, 0);
+        if(err != FAT_OK){
+            if(out_position >= out->dir_entry.file_size){
+                return -(fat_ssize_t)err;
+            }
+            length = out->dir_entry.file_size - out_position;
+        }
+    }
+
+    uint32_t bytes_per_cluster = volume->bytes_per_cluster;
+    cluster_t in_start = fat_get_entry_cluster(volume, &in->dir_entry);
+    cluster_t out_start = fat_get_entry_cluster(volume, &out->dir_entry);
+
+    // one bounce buffer for the whole copy, allocated on first use
+    size_t bounce_size = (size_t)FAT_COPY_CHUNK_CLUSTERS * bytes_per_cluster;
+    if(bounce_size > length + volume->bytes_per_sector){
+        bounce_size = length + volume->bytes_per_sector;
+    }
+    uint8_t *bounce = NULL;
+    size_t copied = 0;
+
+    while(copied < length){
+        uint32_t source_position = in_position + (uint32_t)copied;
+        uint32_t target_position = out_position + (uint32_t)copied;
+        uint32_t source_offset = source_position % bytes_per_cluster;
+        uint32_t target_offset = target_position % bytes_per_cluster;
+
+        // the next pair of contiguous runs
+        cluster_t source;
+        cluster_t target;
+        uint32_t source_run;
+        uint32_t target_run;
+        err = fat_extent_lookup(in, in_start,
+                                source_position / bytes_per_cluster,
+                                &source, &source_run);
+        if(err == FAT_OK){
+            err = fat_extent_lookup(out, out_start,
+                                    target_position / bytes_per_cluster,
+                                    &target, &target_run);
+        }
+        if(err != FAT_OK){
+            break;
+        }
+
+        size_t chunk = length - copied;
+        size_t source_left = (size_t)source_run * bytes_per_cluster -
+                                source_offset;
+        size_t target_left = (size_t)target_run * bytes_per_cluster -
+                                target_offset;
+        if(chunk > source_left){
+            chunk = source_left;
+        }
+        if(chunk > target_left){
+            chunk = target_left;
+        }
+
+        err = fat_copy_run(volume, source, source_offset, target,
+                           target_offset, chunk, &bounce, bounce_size);
+        if(err != FAT_OK){
+            break;
+        }
+        copied += chunk;
+    }
+
+    free(bounce);
+
+    if(out_position + copied > out->dir_entry.file_size){
+        out->dir_entry.file_size = out_position + (uint32_t)copied;
+    }
+    fat_share_file_size(out);
+
+    if(copied == 0){
+        return (err != FAT_OK) ? -(fat_ssize_t)err : 0;
+    }
+
+    out->modified = true;
+    return (fat_ssize_t)copied;
+}
+
+// handle cursor to target, as if a read or write had ended there
+static void fat_copy_move_position(fat_file_t *file, uint32_t target){
+    if(fat_optimize_cluster_seek(file, target) == FAT_OK){
+        file->position = target;
+    }
+}
+
+fat_ssize_t fat_copy_file_range(fat_file_t *in,
+                                int64_t *in_offset,
+                                fat_file_t *out,
+                                int64_t *out_offset,
+                                size_t length){
+
+    // parameter validation
+    if(!in || !out || !in->volume || in->volume != out->volume){
+        return -FAT_ERR_INVALID_PARAM;
+    }
+
+    if(!(in->flags & FAT_O_RDONLY) || !(out->flags & FAT_O_WRONLY) ||
+       (out->flags & FAT_O_APPEND)){
+        return -FAT_ERR_INVALID_PARAM;
+    }
+
+    if((in_offset && (*in_offset < 0 || *in_offset > FAT_MAX_FILE_SIZE)) ||
+       (out_offset && (*out_offset < 0 || *out_offset > FAT_MAX_FILE_SIZE))){
+        return -FAT_ERR_INVALID_PARAM;
+    }
+
+    if(length == 0){
+        return 0;
+    }
+
+    fat_volume_t *volume = in->volume;
+
+    // out's chain grows - exclusive
+    fat_copy_lock(in, out);
+    fat_lock_volume(volume);
+
+    uint32_t in_position = in_offset ? (uint32_t)*in_offset : in->position;
+    uint32_t out_position = out_offset ? (uint32_t)*out_offset : out->position;
+
+    fat_ssize_t result = fat_copy_range_locked(in, in_position, out,
+                                               out_position, length);
+    if(result > 0){
+        if(in_offset){
+            *in_offset += result;
+        } else {
+            fat_copy_move_position(in, in_position + (uint32_t)result);
+        }
+
+        if(out_offset){
+            *out_offset += result;
+        } else {
+            fat_copy_move_position(out, out_position + (uint32_t)result);
+        }
+    }
+
+    fat_unlock_volume(volume);
+    fat_copy_unlock(in, out);
+    return result;
+}
+
+fat_error_t fat_copy_file(fat_volume_t *volume,
+                          const char *src_path,
+                          const char *dst_path){
+
+    // parameter validation
+    if(!volume || !src_path || !dst_path){
+        return FAT_ERR_INVALID_PARAM;
+    }
+
+    fat_file_t *in = NULL;
+    fat_file_t *out = NULL;
+
+    fat_error_t err = fat_open(volume, src_path, FAT_O_RDONLY, &in);
+    if(err != FAT_OK){
+        return err;
+    }
+
+    // opened without FAT_O_TRUNC - copying a file onto itself must not
+    // empty it first
+    err = fat_open(volume, dst_path, FAT_O_WRONLY, &out);
+    if(err == FAT_ERR_NOT_FOUND){
+        err = fat_create(volume, dst_path, FAT_ATTR_ARCHIVE, &out);
+    }
+    if(err != FAT_OK){
+        out = NULL;
+        goto cleanup;
+    }
+
+    if(fat_same_file(in, out)){
+        err = FAT_ERR_INVALID_PARAM;
+        goto cleanup;
+    }
+
+    err = fat_ftruncate(out, 0);
+    if(err != FAT_OK){
+        goto cleanup;
+    }
+
+    int64_t source_offset = 0;
+    int64_t target_offset = 0;
+    while(source_offset < in->dir_entry.file_size){
+        fat_ssize_t copied = fat_copy_file_range(in, &source_offset,
+                                                 out, &target_offset,
+                                                 in->dir_entry.file_size);
+        if(copied <= 0){
+            err = (copied < 0) ? (fat_error_t)-copied : FAT_ERR_DEVICE_ERROR;
+            break;
+        }
+    }
+
+cleanup:
+    if(out){
+        fat_error_t close_err = fat_close(out);
+        if(err == FAT_OK){
+            err = close_err;
+        }
+    }
+    fat_close(in);
+    return err;
+}
@@ -1,12 +1,14 @@
 #include "fat_file.h"
 #include "fat_path.h"
 #include "fat_dir_search.h"
+#include "fat_dir_slots.h"
 #include "fat_lfn.h"
 #include "fat_cluster.h"
 #include "fat_table.h"
 #include "fat_types.h"
 #include "fat_root.h"
 #include "fat_volume.h"
+#include "fat_lock.h"
 #include <string.h>
 #include <stdlib.h>
 #include <ctype.h>
@@ -21,16 +23,18 @@ bool fat_validate_filename(const char *filename){
         return false;
     }
 
+    // at most 255 UTF-16 units
     size_t len = strlen(filename);
-    if(len > 255){
+    size_t units;
+    if(fat_utf8_to_utf16(filename, NULL, 255, &units) != FAT_OK){
         return false;
     }
 
     const char *invalid_chars = "<>:\"|?*";
     for(size_t i=0; i<len; i++){
-        char c = filename[i];
+        unsigned char c = filename[i];
 
-        // check for control characters
+        // check for control characters, bytes of UTF-8 sequences pass
         if(c<32){
             return false;
         }
@@ -50,16 +54,12 @@ bool fat_validate_filename(const char *filename){
  
     char base_name[256];
     const char *dot = strchr(filename, '.');
-    if(dot){
-        size_t base_len = dot - filename;
-        if(base_len >= sizeof(base_name)){
-            base_len = sizeof(base_name) - 1;
-        }
-        memcpy(base_name, filename, base_len);
-        base_name[base_len] = '\0';
-    } else {
-        strcpy(base_name, filename);
+    size_t base_len = dot ? (size_t)(dot - filename) : len;
+    if(base_len >= sizeof(base_name)){
+        base_len = sizeof(base_name) - 1;
     }
+    memcpy(base_name, filename, base_len);
+    base_name[base_len] = '\0';
 
     // check base name against reserved names
     for(size_t i=0; i<sizeof(reserved) / sizeof(reserved[0]); i++){
@@ -83,15 +83,16 @@ uint32_t fat_calculate_entries_needed(const char *filename){
     // check if filename fits 8.3 
     if(len<= 12 && strchr(filename, ' ') == NULL){
         const char *dot = strchr(filename, '.');
-        if(!dot || (dot == strchr(filename, '.') && 
+        if((!dot && len <= 8) || (dot && dot == strrchr(filename, '.') && 
+                   dot != filename &&
                    (dot - filename) <= 8 && 
-                   strlen(dot+1) <= 3)) {
+                   strlen(dot+1) >= 1 && strlen(dot+1) <= 3)) {
 
             bool is_perfect_83 = true;
 
             // check if all characters are valid 8.3
             for(size_t i=0; i<len; i++){
-                char c = filename[i];
+                unsigned char c = filename[i];
                 if(c != '.' && !isalnum(c) && c != '_' && c != '-'){
                     is_perfect_83 = false;
                     break;
@@ -104,25 +105,190 @@ uint32_t fat_calculate_entries_needed(const char *filename){
         }
     }
 
-    // create LFN if name is not perfect 8.3
-    uint32_t lfn_entries = (len + 12) / 13;
+    // create LFN if name is not perfect 8.3 - 13 UTF-16 units per entry,
+    // malformed names are refused by fat_create_lfn_entries
+    size_t units = len;
+    fat_utf8_to_utf16(filename, NULL, 255, &units);
+    uint32_t lfn_entries = (units + 12) / 13;
     return lfn_entries + 1;
 }
 
+// numeric ~N tails tried before switching to the hashed form (as Windows does)
+#define FAT_SHORT_NAME_NUMERIC_TAILS 4
+#define FAT_SHORT_NAME_MAX_TAIL 999999
+
+// state collected in a single pass over the parent directory
+typedef struct {
+    const uint8_t *basis;       // basis name (11 bytes, space padded)
+    size_t basis_len;           // significant characters of the name part
+    const uint8_t *hashed;      // 6 character hashed prefix
+    uint16_t hashed_used;       // bit n set: hashed prefix + "~n" is taken
+    uint32_t *tails;            // numeric tails in use for the basis
+    uint32_t tail_count;
+    uint32_t tail_capacity;
+} fat_short_name_scan_t;
+
+static bool fat_is_short_name_char(char c){
+    return isalnum((unsigned char)c) || c == '_' || c == '-' || c == '$' || 
+           c == '%' || c == '\'' || c == '@' || c == '~' || c == '`' || 
+           c == '!' || c == '(' || c == ')' || c == '{' || c == '}' || 
+           c == '^' || c == '#' || c == '&';
+}
+
+// 16-bit checksum of the long name used for the hashed short name form
+static uint16_t fat_short_name_hash(const char *long_name){
+
+    uint16_t hash = 0;
+    for(const char *p = long_name; *p; p++){
+        hash = (uint16_t)((hash << 3) ^ (hash >> 5) ^ (uint8_t)*p);
+    }
+    return hash;
+}
+
+// parse a "~N" tail from the name part, returns 0 if there is none
+static uint32_t fat_parse_short_name_tail(const uint8_t *name, 
+                                          size_t *prefix_len, 
+                                          size_t *tail_digits){
+
+    size_t end = 8;
+    while(end > 0 && name[end-1] == ' '){
+        end--;
+    }
+
+    size_t pos = end;
+    while(pos > 0 && name[pos-1] >= '0' && name[pos-1] <= '9'){
+        pos--;
+    }
+
+    size_t digits = end - pos;
+    if(digits == 0 || digits > 6 || pos == 0 || name[pos-1] != '~' || 
+       name[pos] == '0'){
+        return 0;
+    }
+
+    uint32_t tail = 0;
+    for(size_t i = pos; i < end; i++){
+        tail = tail * 10 + (name[i] - '0');
+    }
+
+    *prefix_len = pos - 1;
+    *tail_digits = digits;
+    return tail;
+}
+
+static fat_error_t fat_collect_short_name_tail(const fat_dir_entry_t *entry, 
+                                               uint32_t entry_index, 
+                                               void *user_data){
+
+    fat_short_name_scan_t *scan = (fat_short_name_scan_t*)user_data;
+    (void)entry_index;
+
+    if(entry->name[0] == FAT_DIR_ENTRY_DELETED || 
+       entry->attr == FAT_ATTR_LONG_NAME ||
+       (entry->attr & FAT_ATTR_VOLUME_ID)){
+        return FAT_OK;
+    }
+
+    // only names with the same extension can collide
+    if(memcmp(&entry->name[8], &scan->basis[8], 3) != 0){
+        return FAT_OK;
+    }
+
+    size_t prefix_len, tail_digits;
+    uint32_t tail = fat_parse_short_name_tail(entry->name, &prefix_len, 
+                                              &tail_digits);
+    if(tail == 0){
+        return FAT_OK;
+    }
+
+    // hashed form: 2 basis characters + 4 hex digits + "~n"
+    if(prefix_len == 6 && tail <= 9 && 
+       memcmp(entry->name, scan->hashed, 6) == 0){
+        scan->hashed_used |= (uint16_t)(1u << tail);
+    }
+
+    // numeric form: basis truncated to make room for the tail
+    size_t keep_len = 8 - 1 - tail_digits;
+    if(scan->basis_len < keep_len){
+        keep_len = scan->basis_len;
+    }
+
+    if(prefix_len != keep_len || memcmp(entry->name, scan->basis, keep_len) != 0){
+        return FAT_OK;
+    }
+
+    if(scan->tail_count == scan->tail_capacity){
+        uint32_t new_capacity = scan->tail_capacity ? scan->tail_capacity * 2 : 16;
+        uint32_t *tails = realloc(scan->tails, new_capacity * sizeof(uint32_t));
+        if(!tails){
+            return FAT_ERR_NO_MEMORY;
+        }
+        scan->tails = tails;
+        scan->tail_capacity = new_capacity;
+    }
+    scan->tails[scan->tail_count++] = tail;
+
+    return FAT_OK;
+}
+
+// smallest numeric tail not present in the collected set
+static uint32_t fat_first_free_tail(const fat_short_name_scan_t *scan){
+
+    // with n tails in use the answer is at most n + 1
+    uint32_t limit = scan->tail_count + 1;
+    uint8_t *used = calloc((limit / 8) + 1, 1);
+    if(!used){
+        return 0;
+    }
+
+    for(uint32_t i = 0; i < scan->tail_count; i++){
+        if(scan->tails[i] <= limit){
+            used[scan->tails[i] / 8] |= (uint8_t)(1u << (scan->tails[i] % 8));
+        }
+    }
+
+    uint32_t tail = 1;
+    while(tail <= limit && (used[tail / 8] & (1u << (tail % 8)))){
+        tail++;
+    }
+
+    free(used);
+    return tail;
+}
+
+static void fat_apply_short_name_tail(uint8_t *short_name, 
+                                      const uint8_t *prefix, 
+                                      size_t prefix_len, 
+                                      uint32_t tail){
+
+    char suffix_str[8];
+    int suffix_len = snprintf(suffix_str, sizeof(suffix_str), "~%u", 
+                              (unsigned)tail);
+
+    size_t keep_len = 8 - (size_t)suffix_len;
+    if(prefix_len < keep_len){
+        keep_len = prefix_len;
+    }
+
+    memset(short_name, ' ', 8);
+    memcpy(short_name, prefix, keep_len);
+    memcpy(&short_name[keep_len], suffix_str, suffix_len);
+}
+
 fat_error_t fat_generate_short_name(const char *long_name, 
                                     uint8_t *short_name, 
                                     fat_volume_t *volume, 
                                     cluster_t parent_cluster){
 
     // parameter validation
-    if(!long_name || !short_name) {
+    if(!long_name || !short_name || !volume) {
         return FAT_ERR_INVALID_PARAM;
     }
 
     memset(short_name, ' ', 11);
 
     // find last dot
-    const char *last_dot = strchr(long_name, '.');
+    const char *last_dot = strrchr(long_name, '.');
     const char *name_part = long_name;
     const char *ext_part = NULL;
     size_t name_len = strlen(long_name);
@@ -132,103 +298,109 @@ fat_error_t fat_generate_short_name(const char *long_name,
         ext_part = last_dot + 1;
     }
 
-    // create base name
-    char base_name[9] = {0};
+    // create basis name - one '_' per non-ASCII character, UTF-8
+    // continuation bytes are skipped
     size_t base_pos = 0;
-
-    // process name
     for(size_t i=0; i<name_len && base_pos<8; i++){
-        char c = toupper(name_part[i]);
+        char c = toupper((unsigned char)name_part[i]);
 
-        if(c == ' ' || c == '.'){
+        if(c == ' ' || c == '.' || (c & 0xC0) == 0x80){
             continue;
         }
 
-        if(c == '+') c = '_';
-        if(c == ',') c = '_';
-        if(c == ';') c = '_';
-        if(c == '=') c = '_';
-        if(c == '[') c = '_';
-        if(c == ']') c = '_';
-
-        if(isalnum(c) || c == '_' || c == '-' || c == '$' || c == '%' ||
-            c == '\'' || c == '@' || c == '~' || c == '`' || c == '!' ||
-            c == '('  || c == ')' || c == '{' || c == '}' || c == '^' ||
-            c == '#'  || c == '&'){
-            short_name[base_pos++] = c;
+        if(!fat_is_short_name_char(c)){
+            c = '_';
         }
+
+        short_name[base_pos++] = c;
     }
 
     // default name
     if(base_pos == 0){
-        strcpy(base_name, "NONAME");
+        memcpy(short_name, "NONAME", 6);
         base_pos = 6;
     }
 
     // process extension
-    char ext_name[4] = {4};
     if(ext_part){
         size_t ext_pos = 0;
-        size_t ext_len = strlen(ext_part);
+        for(size_t i=0; ext_part[i] != '\0' && ext_pos<3; i++){
+            char c = toupper((unsigned char)ext_part[i]);
 
-        for(size_t i=0; i<ext_len && ext_pos<3; i++){
-            char c = toupper(ext_part[i]);
+            if(c == ' ' || c == '.' || (c & 0xC0) == 0x80){
+                continue;
+            }
 
-            if(isalnum(c) || c == '_' || c == '-'){
-                short_name[8 + ext_pos++] = c;
+            if(!fat_is_short_name_char(c)){
+                c = '_';
             }
+
+            short_name[8 + ext_pos++] = c;
         }
     }
 
-    // check for name collision
-    for(int suffix=1; suffix<=999999; suffix++){
-        
-        // build test name
-        memset(short_name, ' ', 11);
-
-        if(suffix == 1){
-            memcpy(short_name, base_name, strlen(base_name));
-        } else {
-        
-            // name collision - add suffix
-            char suffix_str[8];
-            snprintf(suffix_str, sizeof(suffix_str), "~%d", suffix);
-
-            // calculate how much of the original name to keep
-            size_t suffix_len = strlen(suffix_str);
-            size_t keep_len = (8 > suffix_len) ? (8 - suffix_len) : 0;
-            size_t copy_len = (base_pos < keep_len) ? base_pos : keep_len;
-
-            // copy truncated base name + suffix
-            memcpy(short_name, base_name, copy_len);
-            memcpy(&short_name[copy_len], suffix_str, suffix_len);
-        }
+    // names that fit 8.3 exactly get no LFN and are stored without a tail
+    if(fat_calculate_entries_needed(long_name) == 1){
+        return FAT_OK;
+    }
 
-        // copy extension
-        if(strlen(ext_name)>0){
-            memcpy(&short_name[8], ext_name, strlen(ext_name));
-        }
+    uint8_t basis[11];
+    memcpy(basis, short_name, 11);
+
+    // hashed prefix: first 2 basis characters + 4 hex digits of the name hash
+    static const char hex_digits[] = "0123456789ABCDEF";
+    uint16_t hash = fat_short_name_hash(long_name);
+    uint8_t hashed[6];
+    memcpy(hashed, basis, 2);
+    if(base_pos < 2){
+        hashed[1] = '_';
+    }
+    for(int i=0; i<4; i++){
+        hashed[2 + i] = hex_digits[(hash >> (12 - 4 * i)) & 0x0F];
+    }
+
+    // collect every tail in use for this basis in one directory pass
+    fat_short_name_scan_t scan;
+    memset(&scan, 0, sizeof(scan));
+    scan.basis = basis;
+    scan.basis_len = base_pos;
+    scan.hashed = hashed;
+
+    fat_error_t err = fat_scan_directory_slots(volume, parent_cluster, 
+                                               fat_collect_short_name_tail, 
+                                               &scan);
+    if(err != FAT_OK){
+        free(scan.tails);
+        return err;
+    }
+
+    uint32_t tail = fat_first_free_tail(&scan);
+    free(scan.tails);
+    if(tail == 0){
+        return FAT_ERR_NO_MEMORY;
+    }
 
-        // test if name already exists
-        fat_dir_entry_t existing_entry;
-        uint32_t entry_index;
-
-        fat_error_t err = fat_find_entry(volume, 
-                                         parent_cluster, 
-                                         (char *)short_name, 
-                                         &existing_entry, 
-                                         &entry_index);
-        if(err == FAT_ERR_NOT_FOUND){
-            // name is unique
+    if(tail <= FAT_SHORT_NAME_NUMERIC_TAILS){
+        fat_apply_short_name_tail(short_name, basis, base_pos, tail);
+        return FAT_OK;
+    }
+
+    // large collision set: switch to the hashed form
+    for(uint32_t hashed_tail = 1; hashed_tail <= 9; hashed_tail++){
+        if(!(scan.hashed_used & (1u << hashed_tail))){
+            fat_apply_short_name_tail(short_name, hashed, 6, hashed_tail);
             return FAT_OK;
-        } else if(err != FAT_OK){
-            // other error
-            return err;
         }
-        // name collision - try next number for suffix
     }
-    // could not find a unique name
-    return FAT_ERR_ALREADY_EXISTS;
+
+    // hashed names exhausted as well - fall back to longer numeric tails
+    if(tail > FAT_SHORT_NAME_MAX_TAIL){
+        // could not find a unique name
+        return FAT_ERR_ALREADY_EXISTS;
+    }
+
+    fat_apply_short_name_tail(short_name, basis, base_pos, tail);
+    return FAT_OK;
 }
 
 fat_error_t fat_initialize_file_cluster(fat_volume_t *volume, cluster_t cluster){
@@ -282,7 +454,8 @@ fat_error_t fat_create_directory_entries(fat_volume_t *volume,
                                          const char *filename,
                                          const uint8_t *short_name, 
                                          cluster_t file_cluster,
-                                         uint8_t attributes){
+                                         uint8_t attributes,
+                                         fat_dir_loc_t *sfn_loc){
 
     // paramater validation
     if(!volume || !filename || !short_name){
@@ -290,73 +463,39 @@ fat_error_t fat_create_directory_entries(fat_volume_t *volume,
     }
 
     uint32_t entries_needed = fat_calculate_entries_needed(filename);
-    uint32_t current_index = entry_index;
+
+    // assemble the whole group (LFN entries, then the short entry) in memory
+    fat_dir_entry_t *group = calloc(entries_needed, sizeof(fat_dir_entry_t));
+    if(!group){
+        return FAT_ERR_NO_MEMORY;
+    }
+
+    uint32_t group_count = 1;
 
     // create LFN if necessary
     if(entries_needed > 1){
-        uint32_t lfn_entries = entries_needed - 1;
-        fat_lfn_entry_t *lfn_array = malloc(lfn_entries*sizeof(fat_lfn_entry_t));
-        if(!lfn_array){
-            return FAT_ERR_NO_MEMORY;
-        }
-
         uint8_t num_lfn_entries;
-        fat_error_t err = fat_create_lfn_entries(filename, short_name, lfn_array, 
+        fat_error_t err = fat_create_lfn_entries(filename, short_name, 
+                                                 (fat_lfn_entry_t*)group, 
                                                  &num_lfn_entries);
         if(err != FAT_OK){
-            free(lfn_array);
+            free(group);
             return err;
         }
 
-        // write LFN
-        for(uint32_t i=0; i<num_lfn_entries; i++){
-            uint32_t sector, offset;
-
-            if(parent_cluster==0 && volume->type != FAT_TYPE_FAT32){
-                //FAET12/16 root
-                uint32_t entries_per_sector = volume->bytes_per_sector / 32;
-                uint32_t root_start = volume->reserved_sector_count + 
-                                      (volume->num_fats*volume->fat_size_sectors);
-                sector = root_start + (current_index / entries_per_sector);
-                offset = (current_index & entries_per_sector) * 32;
-            } else {
-                // FAT32 or subdirectory
-                uint32_t entries_per_cluster = volume->bytes_per_cluster / 32;
-                uint32_t cluster_index = current_index / entries_per_cluster;
-
-                // walk cluster chain
-                cluster_t target_cluster = parent_cluster;
-                for(uint32_t j=0; j<cluster_index; j++){
-                    err = fat_get_next_cluster(volume, 
-                                               target_cluster, 
-                                               &target_cluster);
-                    if(err != FAT_OK){
-                        free(lfn_array);
-                        return err;
-                    }
-                }
-                sector = fat_cluster_to_sector(volume, target_cluster);
-                offset = (current_index % entries_per_cluster) * 32;
-            }
-            // write LFN 
-            err=fat_write_dir_entry(volume, sector, offset, 
-                                    (const fat_dir_entry_t *)&lfn_array[i]);
-            if(err != FAT_OK){
-                free(lfn_array);
-                return err;
-            }
-
-            current_index++;
+        if(num_lfn_entries != entries_needed - 1){
+            free(group);
+            return FAT_ERR_INVALID_PARAM;
         }
-        free(lfn_array);
+
+        group_count += num_lfn_entries;
     }
 
-    fat_dir_entry_t dir_entry;
-    memset(&dir_entry, 0, sizeof(dir_entry));
+    fat_dir_entry_t *dir_entry = &group[group_count - 1];
 
-    memcpy(dir_entry.name, short_name, 11);
+    memcpy(dir_entry->name, short_name, 11);
 
-    dir_entry.attr = attributes;
+    dir_entry->attr = attributes;
 
     // set timestamps
     time_t now = time(NULL);
@@ -369,49 +508,46 @@ fat_error_t fat_create_directory_entries(fat_volume_t *volume,
                             (((tm_info->tm_mon + 1) &0x0F) << 5)|
                             (tm_info->tm_mday & 0x1F);
 
-        dir_entry.create_time = fat_time;
-        dir_entry.create_date = fat_date;
-        dir_entry.write_time = fat_time;
-        dir_entry.write_date = fat_date;
-        dir_entry.access_date = fat_date;
+        dir_entry->create_time = fat_time;
+        dir_entry->create_date = fat_date;
+        dir_entry->write_time = fat_time;
+        dir_entry->write_date = fat_date;
+        dir_entry->access_date = fat_date;
     }
 
     // set cluster and size
-    fat_set_entry_cluster(volume, &dir_entry, file_cluster);
-    dir_entry.file_size = 0;
-
-    uint32_t sector, offset;
-    if(parent_cluster == 0 && volume->type != FAT_TYPE_FAT32){
-        // FAT12/16 root
-        uint32_t entries_per_sector = volume->bytes_per_sector / 32;
-        uint32_t root_start = volume->reserved_sector_count +
-                             (volume->num_fats * volume->fat_size_sectors); 
-        sector = root_start + (current_index / entries_per_sector);
-        offset = (current_index % entries_per_sector) * 32;
-    } else {
-        // FAT32 or subdirectory
-        uint32_t entries_per_cluster = volume->bytes_per_cluster / 32;
-        uint32_t cluster_index = current_index / entries_per_cluster;
-
-        cluster_t target_cluster = parent_cluster;
-        for(uint32_t i=0; i<cluster_index; i++){
-            fat_error_t err = fat_get_next_cluster(volume, target_cluster, 
-                                                   &target_cluster);
-            if(err != FAT_OK){
-                return err;
-            }
-        }
+    fat_set_entry_cluster(volume, dir_entry, file_cluster);
+    dir_entry->file_size = 0;
 
-        sector = fat_cluster_to_sector(volume, target_cluster);
-        offset = (current_index % entries_per_cluster) * 32;
+    // one read-modify-write per sector touched by the group
+    fat_dir_loc_t loc;
+    fat_error_t err = fat_dir_loc_from_index(volume, parent_cluster, entry_index, 
+                                             &loc);
+    if(err == FAT_OK){
+        err = fat_write_dir_entries(volume, &loc, group, group_count);
     }
-    return fat_write_dir_entry(volume, sector, offset, &dir_entry);
+
+    free(group);
+
+    if(err != FAT_OK){
+        // group may be half written - rebuild slot map from disk
+        fat_dir_slots_invalidate(volume, parent_cluster);
+        return err;
+    }
+
+    if(sfn_loc){
+        *sfn_loc = loc;
+    }
+
+    // slots are in use now
+    fat_dir_slots_claim(volume, parent_cluster, entry_index, group_count);
+    return FAT_OK;
 }
 
-fat_error_t fat_create(fat_volume_t *volume, 
-                       const char *path, 
-                       uint8_t attributes, 
-                       fat_file_t **file){
+static fat_error_t fat_create_locked(fat_volume_t *volume, 
+                                     const char *path, 
+                                     uint8_t attributes, 
+                                     fat_file_t **file){
 
     // parameter validation
     if(!volume || !path || !file){
@@ -484,6 +620,7 @@ fat_error_t fat_create(fat_volume_t *volume,
     cluster_t parent_dir_cluster = fat_get_entry_cluster(volume, &parent_entry);
 
     uint32_t entries_needed = fat_calculate_entries_needed(filename);
+    fat_dir_loc_t sfn_loc;
 
     // find free directory entry slots
     uint32_t entry_index;
@@ -494,9 +631,10 @@ fat_error_t fat_create(fat_volume_t *volume,
         return err;
     }
 
-    // allocate first cluster
+    // allocate first cluster, near the parent directory
     cluster_t file_cluster;
-    err = fat_allocate_cluster(volume, &file_cluster);
+    fat_alloc_hint_t hint = { 0, parent_dir_cluster, 1 };
+    err = fat_allocate_cluster_hint(volume, &hint, &file_cluster);
     if(err != FAT_OK){
         // drive full
         free(path_copy);
@@ -527,7 +665,8 @@ fat_error_t fat_create(fat_volume_t *volume,
                                        filename, 
                                        short_name, 
                                        file_cluster, 
-                                       attributes);
+                                       attributes,
+                                       &sfn_loc);
     if(err != FAT_OK){
         fat_write_entry(volume, file_cluster, FAT_FREE);
         free(path_copy);
@@ -547,7 +686,8 @@ fat_error_t fat_create(fat_volume_t *volume,
     new_file->position = 0;
     new_file->cluster_offset = 0;
     new_file->dir_cluster = parent_dir_cluster;
-    new_file->dir_entry_offset = entry_index + entries_needed - 1;
+    new_file->dir_entry_offset = sfn_loc.index;
+    new_file->dir_entry_loc = sfn_loc;
     new_file->flags = FAT_O_RDWR;
     new_file->modified = false;
 
@@ -572,7 +712,32 @@ fat_error_t fat_create(fat_volume_t *volume,
         new_file->dir_entry.access_date = fat_date;
     }
 
+    err = fat_lock_file_init(new_file);
+    if(err != FAT_OK){
+        free(new_file);
+        free(path_copy);
+        return err;
+    }
+
+    fat_register_open_file(new_file);
+
     free(path_copy);
     *file = new_file;
     return FAT_OK;
-}
\ No newline at end of file
+}
+
+fat_error_t fat_create(fat_volume_t *volume, 
+                       const char *path, 
+                       uint8_t attributes, 
+                       fat_file_t **file){
+
+    // parameter validation
+    if(!volume || !path || !file){
+        return FAT_ERR_INVALID_PARAM;
+    }
+
+    fat_lock_volume(volume);
+    fat_error_t err = fat_create_locked(volume, path, attributes, file);
+    fat_unlock_volume(volume);
+    return err;
+}
@@ -5,6 +5,9 @@
 #include "fat_table.h"
 #include "fat_lfn.h"
 #include "fat_root.h"
+#include "fat_dir_slots.h"
+#include "fat_commit.h"
+#include "fat_lock.h"
 #include <string.h>
 #include <stdlib.h>
 
@@ -50,95 +53,45 @@ fat_error_t fat_update_free_cluster_count(fat_volume_t *volume,
 
 fat_error_t fat_find_lfn_entries(fat_volume_t *volume, 
                                  cluster_t parent_cluster, 
-                                 uint32_t entry_index, 
-                                 uint32_t *lfn_start_index, 
+                                 const fat_dir_loc_t *loc, 
+                                 fat_dir_loc_t *lfn_start, 
                                  uint32_t *lfn_count){
 
     // parameter validation
-    if(!volume || !lfn_start_index || !lfn_count){
+    if(!volume || !loc || !lfn_start || !lfn_count){
         return FAT_ERR_INVALID_PARAM;
     }
 
-    *lfn_start_index = entry_index;
+    *lfn_start = *loc;
     *lfn_count = 0;
 
-    if(entry_index == 0){
+    if(loc->index == 0){
         return FAT_OK;
     }
 
     fat_dir_entry_t main_entry;
-    uint32_t sector, offset;
-
-    // calculate sector and offset for main entry
-    bool is_root_fat12 = (parent_cluster == 0 && volume->type != FAT_TYPE_FAT32);
-
-    if(is_root_fat12){
-        // FAT12/16
-        uint32_t entries_per_sector = volume->bytes_per_sector / 32;
-        uint32_t root_start = volume->reserved_sector_count +
-                              (volume->num_fats * volume->fat_size_sectors);
-        sector = root_start + (entry_index / entries_per_sector);
-        offset = (entry_index % entries_per_sector) * 32;
-    } else {
-        // FAT32
-        uint32_t entries_per_cluster = volume->bytes_per_cluster / 32;
-        uint32_t cluster_index = entry_index / entries_per_cluster;
-
-        cluster_t target_cluster = parent_cluster;
-        for(uint32_t i=0; i<cluster_index; i++){
-            fat_error_t err = fat_get_next_cluster(volume, target_cluster, 
-                                                   &target_cluster);
-            if(err != FAT_OK){
-                return err;
-            }
-        }
-
-        sector = fat_cluster_to_sector(volume, target_cluster);
-        offset = (entry_index % entries_per_cluster) * 32;
-    }
-
-    fat_error_t err = fat_read_dir_entry(volume, sector, offset, &main_entry);
+    fat_error_t err = fat_read_dir_entry(volume, loc->sector, loc->offset, 
+                                         &main_entry);
     if(err != FAT_OK){
         return err;
     }
 
     uint8_t expected_checksum = fat_calculate_lfn_checksum(main_entry.name);
 
-    uint32_t current_index = entry_index;
+    fat_dir_loc_t current = *loc;
     uint32_t lfn_entries_found = 0;
 
-    while(current_index > 0){
-        current_index--;
-
-        fat_lfn_entry_t lfn_entry;
-
-        if(is_root_fat12){
-            uint32_t entries_per_sector = volume->bytes_per_sector / 32;
-            uint32_t root_start = volume->reserved_sector_count +
-                                  (volume->num_fats * volume->fat_size_sectors);
-            sector = root_start + (current_index / entries_per_sector);
-            offset = (current_index % entries_per_sector) * 32;
-        } else {
-            uint32_t entries_per_cluster = volume->bytes_per_cluster / 32;
-            uint32_t cluster_index = current_index / entries_per_cluster;
-
-            cluster_t target_cluster = parent_cluster;
-            for(uint32_t i=0; i<cluster_index; i++){
-                err = fat_get_next_cluster(volume, 
-                                           target_cluster, 
-                                           &target_cluster);
-                if(err != FAT_OK){
-                    break;
-                }
-            }
-
-            sector = fat_cluster_to_sector(volume, target_cluster);
-            offset = (current_index % entries_per_cluster) * 32;
+    while(current.index > 0){
+        // step back - stays within the sector for all but the first entry
+        err = fat_dir_loc_prev(volume, parent_cluster, &current);
+        if(err != FAT_OK){
+            break;
         }
 
+        fat_lfn_entry_t lfn_entry;
         err = fat_read_dir_entry(volume, 
-                                 sector, 
-                                 offset, 
+                                 current.sector, 
+                                 current.offset, 
                                  (fat_dir_entry_t*)&lfn_entry);
         if(err != FAT_OK){
             break;
@@ -154,135 +107,70 @@ fat_error_t fat_find_lfn_entries(fat_volume_t *volume,
         }
 
         lfn_entries_found++;
+        *lfn_start = current;
 
         if(lfn_entry.order & 0x40){
             // found first LFN entry
-            *lfn_start_index = current_index;
             *lfn_count = lfn_entries_found;
             return FAT_OK;
         }
     }
 
     // no complete sequence of LFN entries found - possible corruption
-    if(lfn_entries_found > 0){
-        *lfn_start_index = current_index + 1;
-        *lfn_count = lfn_entries_found;
-    }
+    *lfn_count = lfn_entries_found;
 
     return FAT_OK;
 }
 
 fat_error_t fat_delete_directory_entries(fat_volume_t *volume, 
                                          cluster_t parent_cluster, 
-                                         uint32_t entry_index, 
+                                         const fat_dir_loc_t *loc, 
                                          bool has_lfn){
 
     // parameter validation
-    if(!volume){
+    if(!volume || !loc){
         return FAT_ERR_INVALID_PARAM;
     }
 
-    fat_error_t result = FAT_OK;
+    // synthetic locations (".", "..") carry only the entry index
+    fat_dir_loc_t main_loc = *loc;
+    if(main_loc.sector == 0){
+        fat_error_t err = fat_dir_loc_from_index(volume, parent_cluster, 
+                                                 loc->index, &main_loc);
+        if(err != FAT_OK){
+            return err;
+        }
+    }
+
+    // group starts at the first LFN entry, if any, and ends at the short entry
+    fat_dir_loc_t group_loc = main_loc;
+    uint32_t group_count = 1;
 
     if(has_lfn){
-        uint32_t lfn_start_index, lfn_count;
+        fat_dir_loc_t lfn_loc;
+        uint32_t lfn_count;
         fat_error_t err = fat_find_lfn_entries(volume, 
                                                parent_cluster, 
-                                               entry_index, 
-                                               &lfn_start_index, 
+                                               &main_loc, 
+                                               &lfn_loc, 
                                                &lfn_count);
         if(err == FAT_OK && lfn_count > 0){
-            for(uint32_t i=0; i<lfn_count; i++){
-                uint32_t lfn_index = lfn_start_index + i;
-
-                // read entry
-                fat_dir_entry_t entry;
-                uint32_t sector, offset;
-                bool is_root_fat12 = (parent_cluster == 0 && 
-                                      volume->type != FAT_TYPE_FAT32);
-                if(is_root_fat12){
-                    // FAT12/16
-                    uint32_t entries_per_sector = volume->bytes_per_sector/32;
-                    uint32_t root_start = volume->reserved_sector_count + 
-                                            (volume->num_fats * 
-                                            volume->fat_size_sectors);
-                    sector = root_start + (lfn_index / entries_per_sector);
-                    offset = (lfn_index % entries_per_sector) * 32;
-                } else {
-                    // FAT32
-                    uint32_t entries_per_cluster = volume->bytes_per_cluster/32;
-                    uint32_t cluster_index = lfn_index / entries_per_cluster;
-
-                    cluster_t target_cluster = parent_cluster;
-                    for(uint32_t j=0; j<cluster_index; j++){
-                        err = fat_get_next_cluster(volume, 
-                                                   target_cluster, 
-                                                   &target_cluster);
-                        if(err != FAT_OK){
-                            return err;
-                        }
-                    }
-
-                    sector = fat_cluster_to_sector(volume, target_cluster);
-                    offset = (lfn_index % entries_per_cluster) * 32;
-                }
-
-                err = fat_read_dir_entry(volume, sector, offset, &entry);
-                if(err != FAT_OK){
-                    if(result == FAT_OK){
-                        result = err;
-                    }
-                    continue;
-                }
-                // mark entry as deleted
-                entry.name[0] = FAT_DIR_ENTRY_DELETED;
-
-                err = fat_write_dir_entry(volume, sector, offset, &entry);
-                if(err != FAT_OK && result == FAT_OK){
-                    result = err;
-                }
-            }
+            group_loc = lfn_loc;
+            group_count += lfn_count;
         }
     }
 
-    // delete main directory entry
-    fat_dir_entry_t main_entry;
-    uint32_t sector, offset;
-    bool is_root_fat12 = (parent_cluster == 0 && volume->type != FAT_TYPE_FAT32);
-
-    if(is_root_fat12){
-        uint32_t entries_per_sector = volume->bytes_per_sector / 32;
-        uint32_t root_start = volume->reserved_sector_count + 
-                              (volume->num_fats * volume->fat_size_sectors);
-        sector = root_start + (entry_index / entries_per_sector);
-        offset = (entry_index % entries_per_sector) * 32;
-    } else {
-        uint32_t entries_per_cluster = volume->bytes_per_cluster / 32;
-        uint32_t cluster_index = entry_index / entries_per_cluster;
-        cluster_t target_cluster = parent_cluster;
-        for(uint32_t i=0; i<cluster_index; i++){
-            fat_error_t err = fat_get_next_cluster(volume, target_cluster, 
-                                                   &target_cluster);
-            if(err != FAT_OK){
-                return err;
-            }
-        }
-
-        sector = fat_cluster_to_sector(volume,target_cluster);
-        offset = (entry_index % entries_per_cluster) * 32;
-    }
+    uint32_t first_index = group_loc.index;
 
-    fat_error_t err = fat_read_dir_entry(volume, sector, offset, &main_entry);
-    if(err != FAT_OK){
-        return (result != FAT_OK) ? result : err;
-    }
+    // mark the whole group deleted, one read-modify-write per sector
+    fat_error_t result = fat_mark_dir_entries_deleted(volume, &group_loc, 
+                                                      group_count);
 
-    // set main entry to 0xE5
-    main_entry.name[0] = FAT_DIR_ENTRY_DELETED;
-
-    err = fat_write_dir_entry(volume, sector, offset, &main_entry);
-    if(err != FAT_OK && result == FAT_OK){
-        result = err;
+    // hand slots back to the directory's free-slot map
+    if(result == FAT_OK){
+        fat_dir_slots_release(volume, parent_cluster, first_index, group_count);
+    } else {
+        fat_dir_slots_invalidate(volume, parent_cluster);
     }
 
     return result;
@@ -338,7 +226,7 @@ fat_error_t fat_delete_file_clusters(fat_volume_t *volume,
     return FAT_OK;
 }
 
-fat_error_t fat_unlink(fat_volume_t *volume, const char *path){
+static fat_error_t fat_unlink_locked(fat_volume_t *volume, const char *path){
 
     // parameter validation
     if(!volume || !path){
@@ -347,13 +235,13 @@ fat_error_t fat_unlink(fat_volume_t *volume, const char *path){
 
     fat_dir_entry_t file_entry;
     cluster_t parent_cluster;
-    uint32_t entry_index;
+    fat_dir_loc_t entry_loc;
 
-    fat_error_t err = fat_resolve_path(volume, 
-                                       path, 
-                                       &file_entry, 
-                                       &parent_cluster, 
-                                       &entry_index);
+    fat_error_t err = fat_resolve_path_loc(volume, 
+                                           path, 
+                                           &file_entry, 
+                                           &parent_cluster, 
+                                           &entry_loc);
     if(err != FAT_OK){
         // file not found
         return err;
@@ -376,16 +264,29 @@ fat_error_t fat_unlink(fat_volume_t *volume, const char *path){
 
     err = fat_delete_directory_entries(volume, 
                                        parent_cluster, 
-                                       entry_index, 
+                                       &entry_loc, 
                                        has_lfn);
     if(err != FAT_OK){
         return err;
     }
 
-    err = fat_flush(volume);
+    err = fat_commit(volume);
     if(err != FAT_OK){
         return err;
     }
 
     return FAT_OK;
-}
\ No newline at end of file
+}
+
+fat_error_t fat_unlink(fat_volume_t *volume, const char *path){
+
+    // parameter validation
+    if(!volume || !path){
+        return FAT_ERR_INVALID_PARAM;
+    }
+
+    fat_lock_volume(volume);
+    fat_error_t err = fat_unlink_locked(volume, path);
+    fat_unlock_volume(volume);
+    return err;
+}
@@ -1,8 +1,13 @@
 #include "fat_table.h"
 #include "fat_root.h"
 #include "fat_file_read.h"
+#include "fat_lock.h"
+#include "fat_extent.h"
+#include "fat_file_buffer.h"
+#include "fat_iovec.h"
 #include <string.h>
 #include <stdlib.h>
+#include <limits.h>
 
 void fat_calculate_cluster_position(fat_volume_t *volume, 
                                     uint32_t position,
@@ -70,38 +75,34 @@ fat_error_t fat_seek_to_position(fat_file_t *file, uint32_t target_position){
                                     &target_cluster_index, 
                                     &target_cluster_offset);
     
-    uint32_t current_cluster_index = 0; 
-    uint32_t current_cluster_offset = 0;
-    fat_calculate_cluster_position (file->volume, 
-                                    file->position, 
-                                    &current_cluster_index, 
-                                    &current_cluster_offset);
+    // cluster the handle points at - a read or write ending on a cluster
+    // boundary leaves it at the end of the previous cluster
+    uint32_t current_cluster_index = (file->position - file->cluster_offset) / 
+                                        file->volume->bytes_per_cluster;
 
     cluster_t new_cluster;
 
     if(target_cluster_index == current_cluster_index){
         // same cluster - update offset
         new_cluster = file->current_cluster;
-    } else if(target_cluster_index > current_cluster_index){
-        // forward seek
-        uint32_t clusters_to_advance=target_cluster_index-current_cluster_index;
+    } else if(target_cluster_index == current_cluster_index + 1){
+        // next cluster
         fat_error_t err = fat_walk_cluster_chain(file->volume, 
                                                  file->current_cluster, 
-                                                 clusters_to_advance, 
+                                                 1, 
                                                  &new_cluster);
-
         if(err != FAT_OK){
             return err;
         }
     } else {
-        // backward seek
+        // any other distance - look it up in the handle's extent map
         cluster_t start_cluster = fat_get_entry_cluster(file->volume, 
                                                         &file->dir_entry);
-        fat_error_t err = fat_walk_cluster_chain(file->volume, 
-                                                 start_cluster, 
-                                                 target_cluster_index, 
-                                                 &new_cluster);
-        
+        fat_error_t err = fat_extent_lookup(file, 
+                                            start_cluster, 
+                                            target_cluster_index, 
+                                            &new_cluster, 
+                                            NULL);
         if(err != FAT_OK){
             return err;
         }
@@ -114,74 +115,266 @@ fat_error_t fat_seek_to_position(fat_file_t *file, uint32_t target_position){
     return FAT_OK;
 }
 
-fat_error_t fat_read_cluster_data(fat_volume_t *volume, 
-                                  cluster_t cluster, 
-                                  uint32_t offset, 
-                                  void *buffer, 
-                                  size_t length){
+fat_error_t fat_read_cluster_run(fat_volume_t *volume, 
+                                 cluster_t cluster, 
+                                 uint32_t offset, 
+                                 void *buffer, 
+                                 size_t length){
 
     // parameter validation
     if(!volume || !buffer || length == 0){
         return FAT_ERR_INVALID_PARAM;
     }
 
-    if(cluster<2 || cluster >= volume->total_clusters + 2){
+    // the run must stay inside the data area
+    uint64_t last_cluster = cluster + 
+                            ((uint64_t)offset + length - 1) / volume->bytes_per_cluster;
+    if(cluster < 2 || last_cluster >= (uint64_t)volume->total_clusters + 2){
         return FAT_ERR_INVALID_PARAM;
     }
 
-    if(offset >= volume->bytes_per_cluster){
+    uint16_t bytes_per_sector = volume->bytes_per_sector;
+    uint32_t sector = fat_cluster_to_sector(volume, cluster) + 
+                        offset / bytes_per_sector;
+    uint32_t sector_offset = offset % bytes_per_sector;
+    uint8_t *output_buffer = (uint8_t *)buffer;
+    uint8_t *sector_buffer = NULL;
+    fat_error_t err = FAT_OK;
+
+    // unaligned head - through a bounce buffer
+    if(sector_offset != 0 || length < bytes_per_sector){
+        sector_buffer = malloc(bytes_per_sector);
+        if(!sector_buffer){
+            return FAT_ERR_NO_MEMORY;
+        }
+
+        if(volume->device->read_sectors(volume->device->device_data, 
+                                        sector, 1, sector_buffer) != 0){
+            err = FAT_ERR_DEVICE_ERROR;
+            goto cleanup;
+        }
+
+        size_t chunk_size = bytes_per_sector - sector_offset;
+        if(chunk_size > length){
+            chunk_size = length;
+        }
+        memcpy(output_buffer, &sector_buffer[sector_offset], chunk_size);
+
+        output_buffer += chunk_size;
+        length -= chunk_size;
+        sector++;
+    }
+
+    // whole sectors - one request, straight into the caller's buffer
+    uint32_t full_sectors = length / bytes_per_sector;
+    if(full_sectors > 0){
+        if(volume->device->read_sectors(volume->device->device_data, 
+                                        sector, full_sectors, 
+                                        output_buffer) != 0){
+            err = FAT_ERR_DEVICE_ERROR;
+            goto cleanup;
+        }
+
+        output_buffer += (size_t)full_sectors * bytes_per_sector;
+        length -= (size_t)full_sectors * bytes_per_sector;
+        sector += full_sectors;
+    }
+
+    // unaligned tail
+    if(length > 0){
+        if(!sector_buffer){
+            sector_buffer = malloc(bytes_per_sector);
+            if(!sector_buffer){
+                return FAT_ERR_NO_MEMORY;
+            }
+        }
+
+        if(volume->device->read_sectors(volume->device->device_data, 
+                                        sector, 1, sector_buffer) != 0){
+            err = FAT_ERR_DEVICE_ERROR;
+            goto cleanup;
+        }
+        memcpy(output_buffer, sector_buffer, length);
+    }
+
+cleanup:
+    free(sector_buffer);
+    return err;
+}
+
+// one caller buffer at a time
+static fat_error_t fat_read_run_pieces(fat_volume_t *volume, 
+                                       cluster_t cluster, 
+                                       uint32_t offset, 
+                                       fat_iov_cursor_t *cursor, 
+                                       size_t length){
+
+    while(length > 0){
+        size_t span = fat_iov_span(cursor);
+        if(span == 0){
+            return FAT_ERR_INVALID_PARAM;
+        }
+
+        size_t chunk_size = (length < span) ? length : span;
+        fat_error_t err = fat_read_cluster_run(volume, cluster, offset, 
+                                               fat_iov_base(cursor), chunk_size);
+        if(err != FAT_OK){
+            return err;
+        }
+
+        fat_iov_advance(cursor, chunk_size);
+        offset += chunk_size;
+        length -= chunk_size;
+    }
+
+    return FAT_OK;
+}
+
+fat_error_t fat_read_cluster_runv(fat_volume_t *volume, 
+                                  cluster_t cluster, 
+                                  uint32_t offset, 
+                                  fat_iov_cursor_t *cursor, 
+                                  size_t length){
+
+    // parameter validation
+    if(!volume || !cursor || length == 0){
         return FAT_ERR_INVALID_PARAM;
     }
 
-    // limit length to cluster boundary
-    if(offset + length > volume->bytes_per_cluster){
-        length = volume->bytes_per_cluster - offset;
+    // one buffer takes it all, or the device cannot scatter
+    if(fat_iov_span(cursor) >= length || !volume->device->readv_sectors){
+        return fat_read_run_pieces(volume, cluster, offset, cursor, length);
     }
 
-    uint32_t first_sector = fat_cluster_to_sector(volume, cluster);
+    // the run must stay inside the data area
+    uint64_t last_cluster = cluster + 
+                            ((uint64_t)offset + length - 1) / volume->bytes_per_cluster;
+    if(cluster < 2 || last_cluster >= (uint64_t)volume->total_clusters + 2){
+        return FAT_ERR_INVALID_PARAM;
+    }
+
+    // partial head and tail sectors are bounced, the sectors between are
+    // scattered over the buffers by one device request
+    uint16_t bytes_per_sector = volume->bytes_per_sector;
+    uint32_t sector = fat_cluster_to_sector(volume, cluster) + 
+                        offset / bytes_per_sector;
+    uint32_t sector_offset = offset % bytes_per_sector;
+    uint8_t *sector_buffer = NULL;
+    fat_error_t err = FAT_OK;
+
+    if(sector_offset != 0 || length < bytes_per_sector){
+        sector_buffer = malloc(bytes_per_sector);
+        if(!sector_buffer){
+            return FAT_ERR_NO_MEMORY;
+        }
+
+        if(volume->device->read_sectors(volume->device->device_data, 
+                                        sector, 1, sector_buffer) != 0){
+            err = FAT_ERR_DEVICE_ERROR;
+            goto cleanup;
+        }
 
-    // calculate sector length for requested data
-    uint32_t start_sector = first_sector + (offset / volume->bytes_per_sector);
-    uint32_t end_sector = first_sector +
-                            ((offset + length - 1) / volume->bytes_per_sector);
-    uint32_t sectors_to_read = end_sector - start_sector + 1;
+        size_t chunk_size = bytes_per_sector - sector_offset;
+        if(chunk_size > length){
+            chunk_size = length;
+        }
+        fat_iov_copy_out(cursor, &sector_buffer[sector_offset], chunk_size);
 
-    uint8_t *sector_buffer = malloc(sectors_to_read * volume->bytes_per_sector);
-    if(!sector_buffer){
-        return FAT_ERR_NO_MEMORY;
+        length -= chunk_size;
+        sector++;
     }
 
-    int result = volume->device->read_sectors(volume->device->device_data, 
-                                              start_sector,
-                                              sectors_to_read, 
-                                              sector_buffer);
+    uint32_t full_sectors = length / bytes_per_sector;
+    if(full_sectors > 0){
+        size_t body = (size_t)full_sectors * bytes_per_sector;
+        fat_iovec_t *slice;
+        int slice_count;
+        err = fat_iov_slice(cursor, body, &slice, &slice_count);
+        if(err != FAT_OK){
+            goto cleanup;
+        }
+
+        int result = volume->device->readv_sectors(volume->device->device_data, 
+                                                   sector, full_sectors, 
+                                                   slice, slice_count);
+        free(slice);
+        if(result != 0){
+            err = FAT_ERR_DEVICE_ERROR;
+            goto cleanup;
+        }
 
-    if(result != 0){
-        free(sector_buffer);
-        return FAT_ERR_DEVICE_ERROR;
+        fat_iov_advance(cursor, body);
+        length -= body;
+        sector += full_sectors;
     }
 
-    // calculate offset within read buffer
-    uint32_t buffer_offset = offset % volume->bytes_per_sector;
+    if(length > 0){
+        if(!sector_buffer){
+            sector_buffer = malloc(bytes_per_sector);
+            if(!sector_buffer){
+                return FAT_ERR_NO_MEMORY;
+            }
+        }
 
-    memcpy(buffer, &sector_buffer[buffer_offset], length);
+        if(volume->device->read_sectors(volume->device->device_data, 
+                                        sector, 1, sector_buffer) != 0){
+            err = FAT_ERR_DEVICE_ERROR;
+            goto cleanup;
+        }
+        fat_iov_copy_out(cursor, sector_buffer, length);
+    }
 
+cleanup:
     free(sector_buffer);
-    return FAT_OK;
-    
+    return err;
 }
 
-int fat_read(fat_file_t *file, void *buffer, size_t size){
+fat_error_t fat_read_cluster_data(fat_volume_t *volume, 
+                                  cluster_t cluster, 
+                                  uint32_t offset, 
+                                  void *buffer, 
+                                  size_t length){
+
+    // parameter validation
+    if(!volume || !buffer || length == 0){
+        return FAT_ERR_INVALID_PARAM;
+    }
+
+    if(cluster<2 || cluster >= volume->total_clusters + 2){
+        return FAT_ERR_INVALID_PARAM;
+    }
+
+    if(offset >= volume->bytes_per_cluster){
+        return FAT_ERR_INVALID_PARAM;
+    }
+
+    // limit length to cluster boundary
+    if(offset + length > volume->bytes_per_cluster){
+        length = volume->bytes_per_cluster - offset;
+    }
+
+    return fat_read_cluster_run(volume, cluster, offset, buffer, length);
+}
+
+static fat_ssize_t fat_read_locked(fat_file_t *file, 
+                                   fat_iov_cursor_t *cursor, 
+                                   size_t size){
 
     // parameter validation
-    if(!file || !buffer || size == 0){
+    if(!file || !cursor || size == 0){
         return -FAT_ERR_INVALID_PARAM;
     }
 
-    if(!(file->flags & (FAT_O_RDONLY | FAT_O_RDWR))){
+    if(!(file->flags & FAT_O_RDONLY)){
         return -FAT_ERR_INVALID_PARAM;
     }
 
+    // buffered writes of this handle must be readable
+    fat_error_t err = fat_buffer_flush(file);
+    if(err != FAT_OK){
+        return -(fat_ssize_t)err;
+    }
+
     if(file->position >= file->dir_entry.file_size){
         return 0;
     }
@@ -197,46 +390,65 @@ int fat_read(fat_file_t *file, void *buffer, size_t size){
     }
 
     // check position
-    fat_error_t err = fat_seek_to_position(file,  file->position);
+    err = fat_seek_to_position(file,  file->position);
     if(err != FAT_OK){
-        return -err;
+        return -(fat_ssize_t)err;
     }
     
-    uint8_t *output_buffer = (uint8_t *)buffer;
+    fat_volume_t *volume = file->volume;
     size_t bytes_read = 0;
     size_t remaining = size;
     
     while(remaining > 0){
-        // calculate amount to read from current cluster
-        uint32_t cluster_remaining = file->volume->bytes_per_cluster - 
+        // physically contiguous clusters from the current one, as many as
+        // the rest of the request touches
+        uint32_t clusters_wanted = (uint32_t)((file->cluster_offset + remaining + 
+                                        volume->bytes_per_cluster - 1) / 
+                                        volume->bytes_per_cluster);
+        uint32_t run_length;
+        err = fat_contiguous_clusters(volume, file->current_cluster, 
+                                      clusters_wanted, &run_length);
+        if(err == FAT_OK){
+            size_t run_remaining = (size_t)run_length * volume->bytes_per_cluster - 
                                         file->cluster_offset;
-        size_t chunk_size = (remaining < cluster_remaining) ? remaining : 
-                                                              cluster_remaining;
-
-        err = fat_read_cluster_data(file->volume, 
-                                    file->current_cluster, 
-                                    file->cluster_offset, 
-                                    &output_buffer[bytes_read], 
-                                    chunk_size);
+            size_t chunk_size = (remaining < run_remaining) ? remaining : 
+                                                              run_remaining;
+
+            err = fat_read_cluster_runv(volume, 
+                                        file->current_cluster, 
+                                        file->cluster_offset, 
+                                        cursor, 
+                                        chunk_size);
+            if(err == FAT_OK){
+                bytes_read += chunk_size;
+                remaining -= chunk_size;
+
+                // stay on the last cluster touched, a read ending on a
+                // cluster boundary leaves the offset at its end
+                uint32_t end = file->cluster_offset + chunk_size;
+                uint32_t advanced = (end - 1) / volume->bytes_per_cluster;
+                file->current_cluster += advanced;
+                file->cluster_offset = end - advanced * volume->bytes_per_cluster;
+            }
+        }
 
         if(err != FAT_OK){
             // return bytes read or error if nothing was read
-            return bytes_read > 0 ? (uint32_t)bytes_read : -err;
+            if(bytes_read == 0){
+                return -(fat_ssize_t)err;
+            }
+            break;
         }
 
-        bytes_read += chunk_size;
-        remaining -= chunk_size;
-        file->cluster_offset += chunk_size;
-
-        if(file->cluster_offset >= file->volume->bytes_per_cluster &&
+        if(file->cluster_offset >= volume->bytes_per_cluster &&
            remaining > 0)
            {
             cluster_t next_cluster;
-            err = fat_get_next_cluster(file->volume, 
+            err = fat_get_next_cluster(volume, 
                                        file->current_cluster, 
                                        &next_cluster);
 
-            if(err != FAT_OK || fat_is_eoc(file->volume, next_cluster)) {
+            if(err != FAT_OK || fat_is_eoc(volume, next_cluster)) {
                 // should never happen if file size is correct
                 break;
             }
@@ -248,6 +460,160 @@ int fat_read(fat_file_t *file, void *buffer, size_t size){
 
     file->position += bytes_read;
 
-    return (int)bytes_read;
+    return (fat_ssize_t)bytes_read;
+
+}
+
+fat_ssize_t fat_read64(fat_file_t *file, void *buffer, size_t size){
+
+    // parameter validation
+    if(!file || !file->volume || !buffer){
+        return -FAT_ERR_INVALID_PARAM;
+    }
+
+    fat_iovec_t iov = { buffer, size };
+    fat_iov_cursor_t cursor;
+    fat_iov_init(&cursor, &iov, 1);
+
+    fat_lock_file(file);
+    fat_lock_volume_shared(file->volume);
+    fat_ssize_t result = fat_read_locked(file, &cursor, size);
+    fat_unlock_volume(file->volume);
+    fat_unlock_file(file);
+    return result;
+}
+
+fat_ssize_t fat_readv(fat_file_t *file, const fat_iovec_t *iov, int iovcnt){
+
+    // parameter validation
+    size_t size;
+    if(!file || !file->volume || !fat_iov_total(iov, iovcnt, &size)){
+        return -FAT_ERR_INVALID_PARAM;
+    }
+
+    if(size == 0){
+        return 0;
+    }
+
+    fat_iov_cursor_t cursor;
+    fat_iov_init(&cursor, iov, iovcnt);
 
-}
\ No newline at end of file
+    fat_lock_file(file);
+    fat_lock_volume_shared(file->volume);
+    fat_ssize_t result = fat_read_locked(file, &cursor, size);
+    fat_unlock_volume(file->volume);
+    fat_unlock_file(file);
+    return result;
+}
+
+int fat_read(fat_file_t *file, void *buffer, size_t size){
+
+    // the result must fit an int - larger requests end early
+    if(size > INT_MAX){
+        size = INT_MAX;
+    }
+
+    return (int)fat_read64(file, buffer, size);
+}
+
+static fat_ssize_t fat_pread_locked(fat_file_t *file, 
+                                    cluster_t start_cluster, 
+                                    void *buffer, 
+                                    size_t size, 
+                                    uint32_t offset){
+
+    fat_volume_t *volume = file->volume;
+    uint8_t *output_buffer = (uint8_t *)buffer;
+    size_t bytes_read = 0;
+
+    while(bytes_read < size){
+        uint32_t position = offset + bytes_read;
+        uint32_t cluster_index = position / volume->bytes_per_cluster;
+        uint32_t cluster_offset = position % volume->bytes_per_cluster;
+
+        // one lookup per contiguous run
+        cluster_t cluster;
+        uint32_t run_length;
+        fat_error_t err = fat_extent_lookup(file, start_cluster, cluster_index, 
+                                            &cluster, &run_length);
+
+        if(err == FAT_OK){
+            size_t run_remaining = (size_t)run_length * volume->bytes_per_cluster - 
+                                        cluster_offset;
+            size_t chunk_size = size - bytes_read;
+            if(chunk_size > run_remaining){
+                chunk_size = run_remaining;
+            }
+
+            err = fat_read_cluster_run(volume, cluster, cluster_offset, 
+                                       &output_buffer[bytes_read], chunk_size);
+            if(err == FAT_OK){
+                bytes_read += chunk_size;
+            }
+        }
+
+        if(err != FAT_OK){
+            // return bytes read or error if nothing was read
+            return bytes_read > 0 ? (fat_ssize_t)bytes_read : 
+                                    -(fat_ssize_t)err;
+        }
+    }
+
+    return (fat_ssize_t)bytes_read;
+}
+
+fat_ssize_t fat_pread64(fat_file_t *file, 
+                        void *buffer, 
+                        size_t size, 
+                        int64_t offset){
+
+    // parameter validation
+    if(!file || !file->volume || !buffer || size == 0 || offset < 0){
+        return -FAT_ERR_INVALID_PARAM;
+    }
+
+    // snapshot what a writer on this handle may change, then let go of the
+    // handle so positional readers of one handle run side by side. the
+    // volume lock stays held from the snapshot to the end of the read - a
+    // truncate or extending write through another handle rewrites this
+    // handle's entry under the exclusive lock only
+    fat_lock_file(file);
+    fat_lock_volume_shared(file->volume);
+    fat_error_t err = FAT_OK;
+    if(file->write_buffer){
+        // buffered writes of this handle must be readable
+        err = fat_buffer_flush(file);
+    }
+    int flags = file->flags;
+    uint32_t file_size = file->dir_entry.file_size;
+    cluster_t start_cluster = fat_get_entry_cluster(file->volume, 
+                                                    &file->dir_entry);
+    fat_unlock_file(file);
+
+    fat_ssize_t result = 0;
+    if(err != FAT_OK){
+        result = -(fat_ssize_t)err;
+    } else if(!(flags & FAT_O_RDONLY)){
+        result = -FAT_ERR_INVALID_PARAM;
+    } else if(offset < file_size){
+        uint32_t available = file_size - (uint32_t)offset;
+        if(size > available){
+            size = available;
+        }
+        result = fat_pread_locked(file, start_cluster, buffer, size, 
+                                  (uint32_t)offset);
+    }
+
+    fat_unlock_volume(file->volume);
+    return result;
+}
+
+int fat_pread(fat_file_t *file, void *buffer, size_t size, uint32_t offset){
+
+    // the result must fit an int - larger requests end early
+    if(size > INT_MAX){
+        size = INT_MAX;
+    }
+
+    return (int)fat_pread64(file, buffer, size, offset);
+}
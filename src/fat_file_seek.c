@@ -1,8 +1,11 @@
 #include "fat_file_seek.h"
 #include "fat_file_read.h"
+#include "fat_lock.h"
+#include "fat_extent.h"
+#include "fat_file_buffer.h"
 #include <limits.h>
 
-bool fat_validate_seek_parameters(fat_file_t *file, int32_t offset, int whence){
+bool fat_validate_seek_parameters(fat_file_t *file, int64_t offset, int whence){
 
     // parameter validation
     if(!file || !file->volume){
@@ -15,18 +18,17 @@ bool fat_validate_seek_parameters(fat_file_t *file, int32_t offset, int whence){
         return false;
     }
 
-    if(file->position > file->dir_entry.file_size){
+    // no position of a FAT file is further away than its largest size
+    if(offset > (int64_t)FAT_MAX_FILE_SIZE || 
+       offset < -(int64_t)FAT_MAX_FILE_SIZE){
         return false;
     }
 
-    // TODO add proper offset validation
-    offset = offset;
-
     return true;
 }
 
 fat_error_t fat_calculate_target_position(fat_file_t *file, 
-                                          int32_t offset, 
+                                          int64_t offset, 
                                           int whence, 
                                           uint32_t *target_position){
 
@@ -35,6 +37,12 @@ fat_error_t fat_calculate_target_position(fat_file_t *file,
         return FAT_ERR_INVALID_PARAM;
     }
 
+    // keeps the sums below in range
+    if(offset > (int64_t)FAT_MAX_FILE_SIZE || 
+       offset < -(int64_t)FAT_MAX_FILE_SIZE){
+        return FAT_ERR_INVALID_PARAM;
+    }
+
     int64_t new_position;
     switch(whence){
         case FAT_SEEK_SET:
@@ -58,8 +66,8 @@ fat_error_t fat_calculate_target_position(fat_file_t *file,
         return FAT_ERR_INVALID_PARAM;
     }
 
-    // check overflow
-    if(new_position > UINT32_MAX){
+    // no holes - a target past the end of file could not be written
+    if(new_position > file->dir_entry.file_size){
         return FAT_ERR_INVALID_PARAM;
     }
 
@@ -80,7 +88,15 @@ fat_error_t fat_optimize_cluster_seek(fat_file_t *file,
     uint32_t target_cluster_offset = target_position % 
                                         file->volume->bytes_per_cluster;
 
-    uint32_t current_cluster_index = file->position / 
+    // end of file on a cluster boundary has no cluster of its own - stay at
+    // the end of the last one, like a read or write ending there
+    if(target_cluster_offset == 0 && target_cluster_index > 0 && 
+       target_position == file->dir_entry.file_size){
+        target_cluster_index--;
+        target_cluster_offset = file->volume->bytes_per_cluster;
+    }
+
+    uint32_t current_cluster_index = (file->position - file->cluster_offset) / 
                                         file->volume->bytes_per_cluster;
 
     cluster_t new_cluster;
@@ -89,115 +105,50 @@ fat_error_t fat_optimize_cluster_seek(fat_file_t *file,
     if(target_cluster_index == current_cluster_index){
         // same cluster
         new_cluster = file->current_cluster;
-    } else if (target_cluster_index > current_cluster_index){
-        // forward seek
-        uint32_t clusters_to_advance = target_cluster_index - 
-                                            current_cluster_index;
-        if(current_cluster_index < clusters_to_advance / 2){
-            // very large forward seek - restart from beginning
-            cluster_t start_cluster = fat_get_entry_cluster(file->volume, 
-                                                             &file->dir_entry);
-            err = fat_walk_cluster_chain(file->volume, 
-                                         start_cluster, 
-                                         target_cluster_index, 
-                                         &new_cluster);
-        } else {
-            err = fat_walk_cluster_chain(file->volume, 
-                                         file->current_cluster, 
-                                         clusters_to_advance, 
-                                         &new_cluster);
-        }
-
-        if(err != FAT_OK){
-            return err;
-        }
-    } else {
-        // backward seek
-        cluster_t start_cluster = fat_get_entry_cluster(file->volume, 
-                                                        &file->dir_entry);
+    } else if(target_cluster_index == current_cluster_index + 1){
+        // next cluster
         err = fat_walk_cluster_chain(file->volume, 
-                                     start_cluster, 
-                                     target_cluster_index, 
+                                     file->current_cluster, 
+                                     1, 
                                      &new_cluster);
         if(err != FAT_OK){
             return err;
         }
-    }
-
-    file->current_cluster = new_cluster;
-    file->cluster_offset = target_cluster_offset;
-
-    return FAT_OK;
-}
-
-fat_error_t fat_seek_to_position(fat_file_t *file, uint32_t target_position){
-
-    // parameter validation
-    if(!file){
-        return FAT_ERR_INVALID_PARAM;
-    }
-
-    if(target_position > file->dir_entry.file_size){
-        return FAT_ERR_INVALID_PARAM;
-    }
-
-    uint32_t target_cluster_index = 0; 
-    uint32_t target_cluster_offset = 0;
-    fat_calculate_cluster_position(file->volume, 
-                                   target_position, 
-                                   &target_cluster_index, 
-                                   &target_cluster_offset);
-    uint32_t current_cluster_index = 0;
-    uint32_t current_cluster_offset = 0;
-    fat_calculate_cluster_position(file->volume, 
-                                   file->position, 
-                                   &current_cluster_index, 
-                                   &current_cluster_offset);
-    cluster_t new_cluster;
-    if(target_cluster_index == current_cluster_index){
-        // same cluster
-        new_cluster = file->current_cluster;
-    } else if(target_cluster_index > current_cluster_index){
-        // forward seek
-        uint32_t clusters_to_advance = target_cluster_index - 
-                                            current_cluster_index;
-        fat_error_t err = fat_walk_cluster_chain(file->volume, 
-                                                 file->current_cluster, 
-                                                 clusters_to_advance, 
-                                                 &new_cluster);
-        if(err != FAT_OK){
-            return err;
-        }
     } else {
-        // backward seek
+        // long forward or backward seek - the extent map has the cluster
         cluster_t start_cluster = fat_get_entry_cluster(file->volume, 
                                                         &file->dir_entry);
-        fat_error_t err = fat_walk_cluster_chain(file->volume, 
-                                                 start_cluster, 
-                                                 target_cluster_index, 
-                                                 &new_cluster);
+        err = fat_extent_lookup(file, 
+                                start_cluster, 
+                                target_cluster_index, 
+                                &new_cluster, 
+                                NULL);
         if(err != FAT_OK){
             return err;
         }
     }
 
-    // update
-    file->position = target_position;
     file->current_cluster = new_cluster;
     file->cluster_offset = target_cluster_offset;
 
     return FAT_OK;
 }
 
-fat_error_t fat_seek(fat_file_t *file, int32_t offset, int whence){
+static fat_error_t fat_seek_locked(fat_file_t *file, int64_t offset, int whence){
 
     // parameter validation
     if(!fat_validate_seek_parameters(file, offset, whence)){
         return FAT_ERR_INVALID_PARAM;
     }
 
+    // buffered data goes out before the position moves
+    fat_error_t err = fat_buffer_flush(file);
+    if(err != FAT_OK){
+        return err;
+    }
+
     uint32_t target_position;
-    fat_error_t err = fat_calculate_target_position(file, 
+    err = fat_calculate_target_position(file, 
                                                     offset, 
                                                     whence, 
                                                     &target_position);
@@ -211,17 +162,10 @@ fat_error_t fat_seek(fat_file_t *file, int32_t offset, int whence){
     }
 
     if(file->dir_entry.file_size == 0){
-        // seek in empty file
-        if(target_position == 0){
-            file->position = 0;
-            file->cluster_offset = 0;
-            return FAT_OK;
-        } else {
-            // seek beyond file_size
-            file->position = target_position;
-            file->cluster_offset = 0;
-            return FAT_OK;
-        }
+        // seek in empty file - only position 0 exists
+        file->position = 0;
+        file->cluster_offset = 0;
+        return FAT_OK;
     }
 
     // non-empty files
@@ -234,10 +178,44 @@ fat_error_t fat_seek(fat_file_t *file, int32_t offset, int whence){
     return FAT_OK;
 }
 
+fat_error_t fat_seek64(fat_file_t *file, int64_t offset, int whence){
+
+    // parameter validation
+    if(!file || !file->volume){
+        return FAT_ERR_INVALID_PARAM;
+    }
+
+    fat_lock_file(file);
+    fat_lock_volume_shared(file->volume);
+    fat_error_t err = fat_seek_locked(file, offset, whence);
+    fat_unlock_volume(file->volume);
+    fat_unlock_file(file);
+    return err;
+}
+
+
+fat_error_t fat_seek(fat_file_t *file, int32_t offset, int whence){
+    return fat_seek64(file, offset, whence);
+}
+
 uint32_t fat_tell(fat_file_t *file){
-    if(!file){
-        return 0;
+    int64_t position = fat_tell64(file);
+    return (position < 0) ? 0 : (uint32_t)position;
+}
+
+int64_t fat_tell64(fat_file_t *file){
+
+    // parameter validation
+    if(!file || !file->volume){
+        return -FAT_ERR_INVALID_PARAM;
     }
 
-    return file->position;
-}
\ No newline at end of file
+    // a truncate through another handle moves the position under the
+    // exclusive volume lock
+    fat_lock_file(file);
+    fat_lock_volume_shared(file->volume);
+    int64_t position = file->position;
+    fat_unlock_volume(file->volume);
+    fat_unlock_file(file);
+    return position;
+}
@@ -0,0 +1,235 @@
+#include "fat_file_truncate.h"
+#include "fat_file_write.h"
+#include "fat_file_seek.h"
+#include "fat_file_close.h"
+#include "fat_file_delete.h"
+#include "fat_file_buffer.h"
+#include "fat_cluster.h"
+#include "fat_table.h"
+#include "fat_commit.h"
+#include "fat_extent.h"
+#include "fat_lock.h"
+#include <stdlib.h>
+
+// clusters zero-filled per device request when a file grows
+#define FAT_TRUNCATE_ZERO_CLUSTERS 16
+
+// buffered data past the new end of file is dropped
+static void fat_truncate_buffer(fat_file_t *file, uint32_t length){
+
+    fat_write_buffer_t *wb = file->write_buffer;
+    if(!wb || wb->length == 0){
+        return;
+    }
+
+    if(wb->start >= length){
+        wb->length = 0;
+    } else if(wb->start + wb->length > length){
+        wb->length = length - wb->start;
+    }
+}
+
+// cursor rebuilt from the start of the chain - the cluster it pointed at
+// may be gone
+static void fat_truncate_cursor(fat_file_t *file){
+
+    uint32_t target = file->position;
+    if(target > file->dir_entry.file_size){
+        target = file->dir_entry.file_size;
+    }
+
+    file->position = 0;
+    file->cluster_offset = 0;
+    file->current_cluster = fat_get_entry_cluster(file->volume,
+                                                  &file->dir_entry);
+
+    if(target != 0 && fat_optimize_cluster_seek(file, target) == FAT_OK){
+        file->position = target;
+    }
+}
+
+static fat_error_t fat_truncate_grow(fat_file_t *file, uint32_t length){
+
+    fat_volume_t *volume = file->volume;
+
+    // clusters first - a full disk leaves the size alone
+    fat_error_t err = fat_extend_file(file, length, 0);
+    if(err != FAT_OK){
+        return err;
+    }
+
+    // zeros from the old end of file, including the rest of its last cluster
+    uint32_t chunk = FAT_TRUNCATE_ZERO_CLUSTERS * volume->bytes_per_cluster;
+    if(chunk > length - file->dir_entry.file_size){
+        chunk = length - file->dir_entry.file_size;
+    }
+
+    uint8_t *zeros = calloc(1, chunk);
+    if(!zeros){
+        return FAT_ERR_NO_MEMORY;
+    }
+
+    while(file->dir_entry.file_size < length){
+        uint32_t size = length - file->dir_entry.file_size;
+        if(size > chunk){
+            size = chunk;
+        }
+
+        fat_ssize_t written = fat_write_at(file, zeros, size, 
+                                           file->dir_entry.file_size);
+        if(written <= 0){
+            err = (written < 0) ? (fat_error_t)-written : FAT_ERR_DEVICE_ERROR;
+            break;
+        }
+    }
+
+    free(zeros);
+    return err;
+}
+
+static fat_error_t fat_truncate_shrink(fat_file_t *file, uint32_t length){
+
+    fat_volume_t *volume = file->volume;
+    cluster_t start_cluster = fat_get_entry_cluster(volume, &file->dir_entry);
+    cluster_t last_kept = 0;
+    cluster_t first_released = 0;
+    uint32_t old_link = 0;
+    uint32_t keep = 0;
+    fat_error_t err;
+
+    if(length == 0){
+        // an empty file owns no clusters
+        first_released = start_cluster;
+        fat_set_entry_cluster(volume, &file->dir_entry, 0);
+    } else if(start_cluster != 0){
+        // end the chain after the last cluster the new size needs
+        keep = fat_calculate_clusters_needed(volume, length);
+        err = fat_extent_lookup(file, start_cluster, keep - 1, &last_kept, NULL);
+        if(err != FAT_OK){
+            return err;
+        }
+
+        err = fat_read_entry(volume, last_kept, &old_link);
+        if(err != FAT_OK){
+            return err;
+        }
+
+        if(!fat_is_eoc(volume, old_link)){
+            err = fat_commit_cut_chain(volume, last_kept);
+            if(err != FAT_OK){
+                return err;
+            }
+            if(!fat_is_bad(volume, old_link)){
+                first_released = old_link;
+            }
+        }
+    }
+
+    // the entry goes out before the clusters are free
+    uint32_t old_size = file->dir_entry.file_size;
+    file->dir_entry.file_size = length;
+    fat_update_file_timestamps(&file->dir_entry);
+
+    err = fat_update_directory_entry(file, &file->dir_entry);
+    if(err != FAT_OK){
+        // chain and entry unchanged
+        file->dir_entry.file_size = old_size;
+        if(length == 0){
+            fat_set_entry_cluster(volume, &file->dir_entry, start_cluster);
+        } else if(last_kept != 0 && !fat_is_eoc(volume, old_link)){
+            fat_write_entry(volume, last_kept, old_link);
+        }
+        return err;
+    }
+    file->modified = true;
+
+    // mapped runs past the new end are gone
+    fat_extent_free(file);
+    file->tail_cluster = last_kept;
+    file->chain_clusters = keep;
+
+    if(first_released == 0){
+        return FAT_OK;
+    }
+
+    // one pass over the released chain
+    uint32_t clusters_freed = 0;
+    err = fat_release_chain(volume, first_released, volume->discard,
+                            &clusters_freed);
+    if(clusters_freed > 0){
+        fat_update_free_cluster_count(volume, clusters_freed);
+    }
+    return err;
+}
+
+fat_error_t fat_truncate_file(fat_file_t *file, uint32_t length){
+
+    // parameter validation
+    if(!file || !file->volume){
+        return FAT_ERR_INVALID_PARAM;
+    }
+
+    if(!(file->flags & FAT_O_WRONLY)){
+        return FAT_ERR_READ_ONLY;
+    }
+
+    fat_volume_t *volume = file->volume;
+
+    // buffered data past the new end is dropped, the rest goes out first
+    for(fat_file_t *open = volume->open_files; open; open = open->next_open){
+        if(fat_same_file(open, file)){
+            fat_truncate_buffer(open, length);
+        }
+    }
+    fat_truncate_buffer(file, length);
+
+    fat_error_t err = fat_buffer_flush(file);
+    if(err != FAT_OK){
+        return err;
+    }
+
+    if(length == file->dir_entry.file_size){
+        return FAT_OK;
+    }
+
+    if(length > file->dir_entry.file_size){
+        err = fat_truncate_grow(file, length);
+    } else {
+        err = fat_truncate_shrink(file, length);
+    }
+
+    // other handles of the file see the new size and chain
+    for(fat_file_t *open = volume->open_files; open; open = open->next_open){
+        if(open == file || !fat_same_file(open, file)){
+            continue;
+        }
+
+        open->dir_entry = file->dir_entry;
+        open->tail_cluster = 0;
+        fat_extent_free(open);
+        fat_truncate_cursor(open);
+    }
+    fat_truncate_cursor(file);
+
+    if(err != FAT_OK){
+        return err;
+    }
+
+    return fat_commit(volume);
+}
+
+fat_error_t fat_ftruncate(fat_file_t *file, uint32_t length){
+
+    // parameter validation
+    if(!file || !file->volume){
+        return FAT_ERR_INVALID_PARAM;
+    }
+
+    // chain and directory entry change - exclusive
+    fat_lock_file(file);
+    fat_lock_volume(file->volume);
+    fat_error_t err = fat_truncate_file(file, length);
+    fat_unlock_volume(file->volume);
+    fat_unlock_file(file);
+    return err;
+}
@@ -1,7 +1,13 @@
 #include "fat_file_write.h"
 #include "fat_file_seek.h"
 #include "fat_root.h"
+#include "fat_lock.h"
+#include "fat_extent.h"
+#include "fat_file_buffer.h"
+#include "fat_file_advise.h"
+#include "fat_iovec.h"
 #include <string.h>
+#include <limits.h>
 
 uint32_t fat_calculate_clusters_needed(fat_volume_t *volume, uint32_t file_size){
 
@@ -15,20 +21,23 @@ uint32_t fat_calculate_clusters_needed(fat_volume_t *volume, uint32_t file_size)
         return 1;
     }
 
-    // round up to cluster boundary
-    return (file_size + volume->bytes_per_cluster-1) / volume->bytes_per_cluster;
+    // round up to cluster boundary - sizes near 4 GiB would overflow the sum
+    return (uint32_t)(((uint64_t)file_size + volume->bytes_per_cluster - 1) / 
+                      volume->bytes_per_cluster);
 }
 
-fat_error_t fat_find_last_cluster(fat_volume_t *volume, 
-                                  cluster_t start_cluster,
-                                  cluster_t *last_cluster){
+fat_error_t fat_find_chain_tail(fat_volume_t *volume, 
+                               cluster_t start_cluster,
+                               cluster_t *last_cluster, 
+                               uint32_t *chain_clusters){
 
     // parameter validation
-    if(!volume || !last_cluster || start_cluster){
+    if(!volume || !last_cluster || start_cluster < FAT_FIRST_VALID_CLUSTER){
         return FAT_ERR_INVALID_PARAM;
     }
 
     cluster_t current_cluster = start_cluster;
+    uint32_t count = 1;
 
     while(1){
         uint32_t fat_entry;
@@ -40,30 +49,106 @@ fat_error_t fat_find_last_cluster(fat_volume_t *volume,
         // check if current cluster is EOC (= last cluster)
         if(fat_is_eoc(volume, fat_entry)){
             *last_cluster = current_cluster;
+            if(chain_clusters){
+                *chain_clusters = count;
+            }
             return FAT_OK;
         }
 
         current_cluster = fat_entry;
 
-        // validate cluster number
-        if(current_cluster < 2 || current_cluster >= volume->total_clusters + 2){
+        // validate cluster number, a chain longer than the volume loops
+        if(current_cluster < 2 || current_cluster >= volume->total_clusters + 2 || 
+           count >= volume->total_clusters){
             return  FAT_ERR_CORRUPTED;
         }
+        count++;
+    }
+}
+
+fat_error_t fat_find_last_cluster(fat_volume_t *volume, 
+                                  cluster_t start_cluster,
+                                  cluster_t *last_cluster){
+    return fat_find_chain_tail(volume, start_cluster, last_cluster, NULL);
+}
+
+// cached tail still ends the chain - another handle growing the file moves it
+static bool fat_file_tail_valid(fat_file_t *file){
+
+    if(file->tail_cluster == 0){
+        return false;
+    }
+
+    uint32_t value;
+    return fat_read_entry(file->volume, file->tail_cluster, &value) == FAT_OK && 
+           fat_is_eoc(file->volume, value);
+}
+
+fat_error_t fat_position_at_end(fat_file_t *file){
+
+    // parameter validation
+    if(!file || !file->volume){
+        return FAT_ERR_INVALID_PARAM;
+    }
+
+    uint32_t file_size = file->dir_entry.file_size;
+    if(file->position == file_size){
+        return FAT_OK;
+    }
+
+    cluster_t start_cluster = fat_get_entry_cluster(file->volume, 
+                                                    &file->dir_entry);
+    if(start_cluster == 0){
+        return fat_seek_to_position(file, file_size);
+    }
+
+    // walk the chain once, the handle keeps its tail from here on
+    if(!fat_file_tail_valid(file)){
+        fat_error_t err = fat_find_chain_tail(file->volume, start_cluster, 
+                                              &file->tail_cluster, 
+                                              &file->chain_clusters);
+        if(err != FAT_OK){
+            file->tail_cluster = 0;
+            return err;
+        }
+    }
+
+    // the tail holds the end of file when the chain is exactly as long as
+    // the size needs
+    if(file->chain_clusters == fat_calculate_clusters_needed(file->volume, 
+                                                             file_size)){
+        file->position = file_size;
+        file->current_cluster = file->tail_cluster;
+        file->cluster_offset = file_size - 
+                        (file->chain_clusters - 1) * file->volume->bytes_per_cluster;
+        return FAT_OK;
     }
+
+    return fat_seek_to_position(file, file_size);
 }
 
 fat_error_t fat_allocate_and_link_cluster(fat_volume_t *volume, 
                                           cluster_t prev_cluster, 
                                           cluster_t *new_cluster){
+    fat_alloc_hint_t hint = { prev_cluster, 0, 1 };
+    return fat_allocate_and_link_cluster_hint(volume, prev_cluster, &hint, 
+                                              new_cluster);
+}
+
+fat_error_t fat_allocate_and_link_cluster_hint(fat_volume_t *volume, 
+                                               cluster_t prev_cluster, 
+                                               const fat_alloc_hint_t *hint, 
+                                               cluster_t *new_cluster){
 
     // parameter validation
-    if(!volume || !new_cluster || prev_cluster <2){
+    if(!volume || !hint || !new_cluster || prev_cluster <2){
         return FAT_ERR_INVALID_PARAM;
     }
 
-    // allocate new cluster
+    // allocate new cluster where the policy puts it
     cluster_t allocated_cluster;
-    fat_error_t err = fat_allocate_cluster(volume, &allocated_cluster);
+    fat_error_t err = fat_allocate_cluster_hint(volume, hint, 
+                                                &allocated_cluster);
     if(err != FAT_OK){
         return err;
     }
@@ -103,31 +188,42 @@ fat_error_t fat_allocate_and_link_cluster(fat_volume_t *volume,
     return FAT_OK;
 }
 
-fat_error_t fat_extend_file(fat_file_t *file, uint32_t new_size){
+// run size the allocator is asked for - a file read and written
+// sequentially asks for room to keep growing in place
+static uint32_t fat_extend_run_hint(const fat_file_t *file, uint32_t clusters){
+    if(file->advice == FAT_FADV_SEQUENTIAL && clusters < FAT_FADV_SEQUENTIAL_RUN){
+        return FAT_FADV_SEQUENTIAL_RUN;
+    }
+    return clusters;
+}
+
+fat_error_t fat_extend_file(fat_file_t *file, uint32_t new_size, cluster_t goal){
 
     // parameter validation
     if(!file || new_size <= file->dir_entry.file_size){
         return FAT_ERR_INVALID_PARAM;
     }
 
+    cluster_t start_cluster = fat_get_entry_cluster(file->volume, 
+                                                    &file->dir_entry);
+
+    // an empty file may have no chain yet - count one cluster only if it does
     uint32_t clusters_needed = fat_calculate_clusters_needed(file->volume, 
                                                              new_size);
-    uint32_t current_clusters = fat_calculate_clusters_needed(file->volume, 
+    uint32_t current_clusters = (start_cluster == 0) ? 0 :
+                                fat_calculate_clusters_needed(file->volume, 
                                                               file->dir_entry.file_size);
     if(clusters_needed <= current_clusters){
         // no additional clusters required
         return FAT_OK;
     }
 
-    uint32_t clusters_to_add = clusters_needed - current_clusters;
-
-    cluster_t last_cluster;
-    cluster_t start_cluster = fat_get_entry_cluster(file->volume, 
-                                                    &file->dir_entry);
-
     if(start_cluster == 0){
         // no clusters allocated yet 
-        fat_error_t err = fat_allocate_cluster(file->volume, &start_cluster);
+        fat_alloc_hint_t hint = { goal, file->dir_cluster, 
+                                  fat_extend_run_hint(file, clusters_needed) };
+        fat_error_t err = fat_allocate_cluster_hint(file->volume, &hint, 
+                                                    &start_cluster);
         if (err != FAT_OK){
             return err;
         }
@@ -142,32 +238,268 @@ fat_error_t fat_extend_file(fat_file_t *file, uint32_t new_size){
         fat_set_entry_cluster(file->volume, &file->dir_entry, start_cluster);
         file->current_cluster = start_cluster;
 
-        clusters_to_add--;
-        last_cluster = start_cluster;
-    } else {
-        fat_error_t err = fat_find_last_cluster(file->volume, start_cluster, 
-                                                &last_cluster);
+        file->tail_cluster = start_cluster;
+        file->chain_clusters = 1;
+        goal = 0;
+    } else if(!fat_file_tail_valid(file)){
+        // walk the chain once, the handle keeps its tail from here on
+        fat_error_t err = fat_find_chain_tail(file->volume, start_cluster, 
+                                              &file->tail_cluster, 
+                                              &file->chain_clusters);
         if(err != FAT_OK){
+            file->tail_cluster = 0;
             return err;
         }
     }
 
-    // allocate and link additional clusters
-    cluster_t current_last = last_cluster;
-    for(uint32_t i=0; i<clusters_to_add; i++){
+    // allocate and link additional clusters - the chain may already be
+    // longer than the size needs
+    while(file->chain_clusters < clusters_needed){
         cluster_t new_cluster;
-        fat_error_t err = fat_allocate_and_link_cluster(file->volume, 
-                                                        current_last, 
-                                                        &new_cluster);
+        // the caller's goal places the first new cluster, the rest follow it
+        fat_alloc_hint_t hint = { goal ? goal : file->tail_cluster, 
+                                  file->dir_cluster, 
+                                  fat_extend_run_hint(file, clusters_needed - 
+                                                      file->chain_clusters) };
+        fat_error_t err = fat_allocate_and_link_cluster_hint(file->volume, 
+                                                             file->tail_cluster, 
+                                                             &hint, 
+                                                             &new_cluster);
         if(err != FAT_OK){
             return err;
         }
-        current_last = new_cluster;
+        file->tail_cluster = new_cluster;
+        file->chain_clusters++;
+        goal = 0;
+    }
+
+    return FAT_OK;
+}
+
+// read-modify-write of length bytes at sector_offset inside one sector
+static fat_error_t fat_write_partial_sector(fat_volume_t *volume, 
+                                            uint32_t sector, 
+                                            uint32_t sector_offset, 
+                                            const void *buffer, 
+                                            size_t length, 
+                                            uint8_t **sector_buffer){
+
+    if(!*sector_buffer){
+        *sector_buffer = malloc(volume->bytes_per_sector);
+        if(!*sector_buffer){
+            return FAT_ERR_NO_MEMORY;
+        }
+    }
+
+    if(volume->device->read_sectors(volume->device->device_data, 
+                                    sector, 1, *sector_buffer) != 0){
+        return FAT_ERR_DEVICE_ERROR;
+    }
+
+    memcpy(&(*sector_buffer)[sector_offset], buffer, length);
+
+    if(volume->device->write_sectors(volume->device->device_data, 
+                                     sector, 1, *sector_buffer) != 0){
+        return FAT_ERR_DEVICE_ERROR;
     }
 
     return FAT_OK;
 }
 
+fat_error_t fat_write_cluster_run(fat_volume_t *volume, 
+                                  cluster_t cluster, 
+                                  uint32_t offset, 
+                                  const void *buffer, 
+                                  size_t length){
+
+    // parameter validation
+    if(!volume || !buffer || length == 0){
+        return FAT_ERR_INVALID_PARAM;
+    }
+
+    // the run must stay inside the data area
+    uint64_t last_cluster = cluster + 
+                            ((uint64_t)offset + length - 1) / volume->bytes_per_cluster;
+    if(cluster < 2 || last_cluster >= (uint64_t)volume->total_clusters + 2){
+        return FAT_ERR_INVALID_CLUSTER;
+    }
+
+    uint16_t bytes_per_sector = volume->bytes_per_sector;
+    uint32_t sector = fat_cluster_to_sector(volume, cluster) + 
+                        offset / bytes_per_sector;
+    uint32_t sector_offset = offset % bytes_per_sector;
+    const uint8_t *input_buffer = (const uint8_t *)buffer;
+    uint8_t *sector_buffer = NULL;
+    fat_error_t err = FAT_OK;
+
+    // partial head sector - read-modify-write
+    if(sector_offset != 0 || length < bytes_per_sector){
+        size_t chunk_size = bytes_per_sector - sector_offset;
+        if(chunk_size > length){
+            chunk_size = length;
+        }
+
+        err = fat_write_partial_sector(volume, sector, sector_offset, 
+                                       input_buffer, chunk_size, 
+                                       &sector_buffer);
+        if(err != FAT_OK){
+            goto cleanup;
+        }
+
+        input_buffer += chunk_size;
+        length -= chunk_size;
+        sector++;
+    }
+
+    // whole sectors - one request, straight from the caller's buffer
+    uint32_t full_sectors = length / bytes_per_sector;
+    if(full_sectors > 0){
+        if(volume->device->write_sectors(volume->device->device_data, 
+                                         sector, full_sectors, 
+                                         input_buffer) != 0){
+            err = FAT_ERR_DEVICE_ERROR;
+            goto cleanup;
+        }
+
+        input_buffer += (size_t)full_sectors * bytes_per_sector;
+        length -= (size_t)full_sectors * bytes_per_sector;
+        sector += full_sectors;
+    }
+
+    // partial tail sector
+    if(length > 0){
+        err = fat_write_partial_sector(volume, sector, 0, input_buffer, 
+                                       length, &sector_buffer);
+    }
+
+cleanup:
+    free(sector_buffer);
+    return err;
+}
+
+fat_error_t fat_write_cluster_runv(fat_volume_t *volume, 
+                                   cluster_t cluster, 
+                                   uint32_t offset, 
+                                   fat_iov_cursor_t *cursor, 
+                                   size_t length){
+
+    // parameter validation
+    if(!volume || !cursor || length == 0){
+        return FAT_ERR_INVALID_PARAM;
+    }
+
+    // one buffer holds it all
+    if(fat_iov_span(cursor) >= length){
+        fat_error_t err = fat_write_cluster_run(volume, cluster, offset, 
+                                                fat_iov_base(cursor), length);
+        if(err == FAT_OK){
+            fat_iov_advance(cursor, length);
+        }
+        return err;
+    }
+
+    // the device cannot gather - one buffer at a time
+    if(!volume->device->writev_sectors){
+        while(length > 0){
+            size_t span = fat_iov_span(cursor);
+            if(span == 0){
+                return FAT_ERR_INVALID_PARAM;
+            }
+
+            size_t chunk_size = (length < span) ? length : span;
+            fat_error_t err = fat_write_cluster_run(volume, cluster, offset, 
+                                                    fat_iov_base(cursor), 
+                                                    chunk_size);
+            if(err != FAT_OK){
+                return err;
+            }
+
+            fat_iov_advance(cursor, chunk_size);
+            offset += chunk_size;
+            length -= chunk_size;
+        }
+        return FAT_OK;
+    }
+
+    // the run must stay inside the data area
+    uint64_t last_cluster = cluster + 
+                            ((uint64_t)offset + length - 1) / volume->bytes_per_cluster;
+    if(cluster < 2 || last_cluster >= (uint64_t)volume->total_clusters + 2){
+        return FAT_ERR_INVALID_CLUSTER;
+    }
+
+    // partial head and tail sectors are gathered and read-modify-written,
+    // the sectors between go out in one gathering request
+    uint16_t bytes_per_sector = volume->bytes_per_sector;
+    uint32_t sector = fat_cluster_to_sector(volume, cluster) + 
+                        offset / bytes_per_sector;
+    uint32_t sector_offset = offset % bytes_per_sector;
+    uint8_t *sector_buffer = NULL;
+    uint8_t *gather = malloc(bytes_per_sector);
+    if(!gather){
+        return FAT_ERR_NO_MEMORY;
+    }
+    fat_error_t err = FAT_OK;
+
+    if(sector_offset != 0 || length < bytes_per_sector){
+        size_t chunk_size = bytes_per_sector - sector_offset;
+        if(chunk_size > length){
+            chunk_size = length;
+        }
+
+        fat_iov_cursor_t peek = *cursor;
+        fat_iov_copy_in(&peek, gather, chunk_size);
+        err = fat_write_partial_sector(volume, sector, sector_offset, gather, 
+                                       chunk_size, &sector_buffer);
+        if(err != FAT_OK){
+            goto cleanup;
+        }
+
+        *cursor = peek;
+        length -= chunk_size;
+        sector++;
+    }
+
+    uint32_t full_sectors = length / bytes_per_sector;
+    if(full_sectors > 0){
+        size_t body = (size_t)full_sectors * bytes_per_sector;
+        fat_iovec_t *slice;
+        int slice_count;
+        err = fat_iov_slice(cursor, body, &slice, &slice_count);
+        if(err != FAT_OK){
+            goto cleanup;
+        }
+
+        int result = volume->device->writev_sectors(volume->device->device_data, 
+                                                    sector, full_sectors, 
+                                                    slice, slice_count);
+        free(slice);
+        if(result != 0){
+            err = FAT_ERR_DEVICE_ERROR;
+            goto cleanup;
+        }
+
+        fat_iov_advance(cursor, body);
+        length -= body;
+        sector += full_sectors;
+    }
+
+    if(length > 0){
+        fat_iov_cursor_t peek = *cursor;
+        fat_iov_copy_in(&peek, gather, length);
+        err = fat_write_partial_sector(volume, sector, 0, gather, length, 
+                                       &sector_buffer);
+        if(err == FAT_OK){
+            *cursor = peek;
+        }
+    }
+
+cleanup:
+    free(gather);
+    free(sector_buffer);
+    return err;
+}
+
 fat_error_t fat_write_cluster_data(fat_volume_t *volume, 
                                    cluster_t cluster, 
                                    uint32_t offset, 
@@ -192,74 +524,60 @@ fat_error_t fat_write_cluster_data(fat_volume_t *volume,
         length = volume->bytes_per_cluster - offset;
     }
 
-    uint32_t first_sector = fat_cluster_to_sector(volume, cluster);
-
-    uint32_t start_sector = first_sector + (offset / volume->bytes_per_sector);
-    uint32_t end_sector = first_sector + 
-                            ((offset + length - 1) / volume->bytes_per_sector);
-    uint32_t sectors_to_write = end_sector - start_sector + 1;
-
-    // check if we are writing complete sectors
-    uint32_t sector_start_offset = offset * volume->bytes_per_sector;
-    bool complete_sectors = (sector_start_offset == 0) && 
-                            (length==sectors_to_write*volume->bytes_per_sector);
-    if(complete_sectors){
-        // direct write
-        int result = volume->device->write_sectors(volume->device->device_data, 
-                                                   start_sector, 
-                                                   sectors_to_write, 
-                                                   buffer);
-        return (result == 0) ? FAT_OK : FAT_ERR_DEVICE_ERROR;
-    } else {
-        // partial sector write
-        uint8_t *sector_buffer = malloc(sectors_to_write * 
-                                            volume->bytes_per_sector);
-        if(!sector_buffer){
-            return FAT_ERR_NO_MEMORY;
-        }
-
-        // read current sector data
-        int result = volume->device->read_sectors(volume->device->device_data, 
-                                                  start_sector, 
-                                                  sectors_to_write, 
-                                                  sector_buffer);
-        if(result != 0){
-            free(sector_buffer);
-            return FAT_ERR_DEVICE_ERROR;
-        }
-
-        // modify relevant bytes 
-        memcpy(&sector_buffer[sector_start_offset], buffer, length);
-
-        // write modified buffer to drive
-        result = volume->device->write_sectors(volume->device->device_data,
-                                               start_sector, 
-                                               sectors_to_write,
-                                               sector_buffer);
-        free(sector_buffer);
-        return(result == 0) ? FAT_OK : FAT_ERR_DEVICE_ERROR;
-    }
+    return fat_write_cluster_run(volume, cluster, offset, buffer, length);
 }
 
-int fat_write(fat_file_t *file, const void *buffer, size_t size){
+static fat_ssize_t fat_write_locked(fat_file_t *file, 
+                                    fat_iov_cursor_t *cursor, 
+                                    size_t size){
 
     // parameter validation
-    if(!file || !buffer || size == 0){
+    if(!file || !cursor || size == 0){
         return -FAT_ERR_INVALID_PARAM;
     }
 
-    if(!(file->flags & (FAT_O_WRONLY | FAT_O_RDWR))){
+    if(!(file->flags & FAT_O_WRONLY)){
         return -FAT_ERR_INVALID_PARAM;
     }
 
+    // append mode - every write goes to the end of file
+    if(file->flags & FAT_O_APPEND){
+        fat_error_t err = fat_position_at_end(file);
+        if(err != FAT_OK){
+            return -(fat_ssize_t)err;
+        }
+    }
+
+    // a FAT file ends at 4 GiB - 1, write what fits
+    if(size > FAT_MAX_FILE_SIZE - file->position){
+        if(file->position == FAT_MAX_FILE_SIZE){
+            return -FAT_ERR_FILE_TOO_LARGE;
+        }
+        size = FAT_MAX_FILE_SIZE - file->position;
+    }
+
+    // small sequential writes gather in the handle's buffer, a write from
+    // several buffers goes out at once
+    if(fat_iov_span(cursor) >= size){
+        int buffered = fat_buffer_write(file, fat_iov_base(cursor), size);
+        if(buffered != FAT_BUFFER_BYPASS){
+            return buffered;
+        }
+    } else {
+        fat_error_t err = fat_buffer_flush(file);
+        if(err != FAT_OK){
+            return -(fat_ssize_t)err;
+        }
+    }
+
     // check if we must extended the file
-    uint32_t write_end_position = file->position + size;
+    uint32_t write_end_position = file->position + (uint32_t)size;
     if(write_end_position > file->dir_entry.file_size){
-        fat_error_t err = fat_extend_file(file, write_end_position);
+        fat_error_t err = fat_extend_file(file, write_end_position, 0);
         if(err != FAT_OK){
             // try to write what we can
             if(file->position >= file->dir_entry.file_size){
-                return -err;
+                return -(fat_ssize_t)err;
             }
             // limit write to current file size
             size = file->dir_entry.file_size - file->position;
@@ -270,45 +588,64 @@ int fat_write(fat_file_t *file, const void *buffer, size_t size){
     // check position
     fat_error_t err = fat_seek_to_position(file, file->position);
     if(err != FAT_OK){
-        return -err;
+        return -(fat_ssize_t)err;
     }
 
-    const uint8_t *input_buffer = (const uint8_t *)buffer;
+    fat_volume_t *volume = file->volume;
     size_t bytes_written = 0;
     size_t remaining = size;
 
     // write data
     while(remaining > 0){
-        // calculate how much space is left in current cluster
-        uint32_t cluster_remaining = file->volume->bytes_per_cluster - 
+        // physically contiguous clusters from the current one, as many as
+        // the rest of the write touches
+        uint32_t clusters_wanted = (uint32_t)((file->cluster_offset + remaining + 
+                                        volume->bytes_per_cluster - 1) / 
+                                        volume->bytes_per_cluster);
+        uint32_t run_length;
+        err = fat_contiguous_clusters(volume, file->current_cluster, 
+                                      clusters_wanted, &run_length);
+        if(err == FAT_OK){
+            size_t run_remaining = (size_t)run_length * volume->bytes_per_cluster - 
                                         file->cluster_offset;
-        size_t chunk_size = (remaining < cluster_remaining) ? remaining : 
-                                                              cluster_remaining;
-
-        err = fat_write_cluster_data(file->volume, 
-                                     file->current_cluster, 
-                                     file->cluster_offset, 
-                                     &input_buffer[bytes_written], 
-                                     chunk_size);
+            size_t chunk_size = (remaining < run_remaining) ? remaining : 
+                                                              run_remaining;
+
+            err = fat_write_cluster_runv(volume, 
+                                         file->current_cluster, 
+                                         file->cluster_offset, 
+                                         cursor, 
+                                         chunk_size);
+            if(err == FAT_OK){
+                bytes_written += chunk_size;
+                remaining -= chunk_size;
+
+                // stay on the last cluster touched, a write ending on a
+                // cluster boundary leaves the offset at its end
+                uint32_t end = file->cluster_offset + chunk_size;
+                uint32_t advanced = (end - 1) / volume->bytes_per_cluster;
+                file->current_cluster += advanced;
+                file->cluster_offset = end - advanced * volume->bytes_per_cluster;
+            }
+        }
+
         if(err != FAT_OK){
             // return bytes written / error
-            return bytes_written > 0 ? (uint32_t)bytes_written : -err;
+            if(bytes_written == 0){
+                return -(fat_ssize_t)err;
+            }
+            break;
         }
 
-        //update counters
-        bytes_written += chunk_size;
-        remaining -= chunk_size;
-        file->cluster_offset += chunk_size;
-
-        if(file->cluster_offset >= file->volume->bytes_per_cluster && 
+        if(file->cluster_offset >= volume->bytes_per_cluster && 
            remaining > 0)
         {
             // move to next cluster
             cluster_t next_cluster;
-            err = fat_get_next_cluster(file->volume, 
+            err = fat_get_next_cluster(volume, 
                                        file->current_cluster, 
                                        &next_cluster);
-            if(err != FAT_OK || fat_is_eoc(file->volume, next_cluster)){
+            if(err != FAT_OK || fat_is_eoc(volume, next_cluster)){
                 // should never happen if extension worked properly
                 break;
             }
@@ -322,8 +659,233 @@ int fat_write(fat_file_t *file, const void *buffer, size_t size){
 
     if(file->position > file->dir_entry.file_size){
         file->dir_entry.file_size = file->position;
+        fat_share_file_size(file);
     }
 
     file->modified = true;
-    return (int)bytes_written;
-}
\ No newline at end of file
+    return (fat_ssize_t)bytes_written;
+}
+
+// bytes the file's cluster chain can hold without touching the FAT
+static uint64_t fat_allocated_bytes(fat_file_t *file){
+
+    if(fat_get_entry_cluster(file->volume, &file->dir_entry) == 0){
+        return 0;
+    }
+
+    return (uint64_t)fat_calculate_clusters_needed(file->volume, 
+                                        file->dir_entry.file_size) * 
+                                        file->volume->bytes_per_cluster;
+}
+
+// where a write through the handle begins - appends go to end of file
+static uint32_t fat_write_start(const fat_file_t *file){
+    return (file->flags & FAT_O_APPEND) ? file->dir_entry.file_size : 
+                                          file->position;
+}
+
+// volume lock for a write of size bytes at the handle's cursor or at offset
+// - shared while the write stays inside the file, or inside the clusters it
+// owns with no other handle open on it, exclusive otherwise. an extending
+// write through another handle changes the cached entry, so the decision is
+// made under the shared lock
+static void fat_lock_volume_for_write(fat_file_t *file, 
+                                      bool at_cursor, 
+                                      int64_t offset, 
+                                      size_t size){
+
+    fat_lock_volume_shared(file->volume);
+
+    uint64_t start = at_cursor ? fat_write_start(file) : (uint64_t)offset;
+    uint64_t end = start + size;
+    if(end <= file->dir_entry.file_size || 
+       (end <= fat_allocated_bytes(file) && !fat_file_is_shared(file))){
+        return;
+    }
+
+    fat_unlock_volume(file->volume);
+    fat_lock_volume(file->volume);
+}
+
+fat_ssize_t fat_write64(fat_file_t *file, const void *buffer, size_t size){
+
+    // parameter validation
+    if(!file || !file->volume || !buffer){
+        return -FAT_ERR_INVALID_PARAM;
+    }
+
+    fat_iovec_t iov = { (void *)buffer, size };
+    fat_iov_cursor_t cursor;
+    fat_iov_init(&cursor, &iov, 1);
+
+    fat_lock_file(file);
+    fat_lock_volume_for_write(file, true, 0, size);
+
+    fat_ssize_t result = fat_write_locked(file, &cursor, size);
+    fat_unlock_volume(file->volume);
+    fat_unlock_file(file);
+    return result;
+}
+
+fat_ssize_t fat_writev(fat_file_t *file, const fat_iovec_t *iov, int iovcnt){
+
+    // parameter validation
+    size_t size;
+    if(!file || !file->volume || !fat_iov_total(iov, iovcnt, &size)){
+        return -FAT_ERR_INVALID_PARAM;
+    }
+
+    if(size == 0){
+        return 0;
+    }
+
+    fat_iov_cursor_t cursor;
+    fat_iov_init(&cursor, iov, iovcnt);
+
+    fat_lock_file(file);
+    fat_lock_volume_for_write(file, true, 0, size);
+
+    fat_ssize_t result = fat_write_locked(file, &cursor, size);
+    fat_unlock_volume(file->volume);
+    fat_unlock_file(file);
+    return result;
+}
+
+int fat_write(fat_file_t *file, const void *buffer, size_t size){
+
+    // the result must fit an int - larger requests end early
+    if(size > INT_MAX){
+        size = INT_MAX;
+    }
+
+    return (int)fat_write64(file, buffer, size);
+}
+
+fat_ssize_t fat_write_at(fat_file_t *file, 
+                         const void *buffer, 
+                         size_t size, 
+                         uint32_t offset){
+
+    // parameter validation
+    if(!buffer || size == 0){
+        return -FAT_ERR_INVALID_PARAM;
+    }
+
+    if(!(file->flags & FAT_O_WRONLY)){
+        return -FAT_ERR_INVALID_PARAM;
+    }
+
+    // no holes - the write starts inside the file or right at its end
+    if(offset > file->dir_entry.file_size){
+        return -FAT_ERR_INVALID_PARAM;
+    }
+
+    // a FAT file ends at 4 GiB - 1, write what fits
+    if(size > FAT_MAX_FILE_SIZE - offset){
+        if(offset == FAT_MAX_FILE_SIZE){
+            return -FAT_ERR_FILE_TOO_LARGE;
+        }
+        size = FAT_MAX_FILE_SIZE - offset;
+    }
+
+    // extend first, same fallback as fat_write
+    if(offset + size > file->dir_entry.file_size){
+        fat_error_t err = fat_extend_file(file, offset + size, 0);
+        if(err != FAT_OK){
+            if(offset >= file->dir_entry.file_size){
+                return -(fat_ssize_t)err;
+            }
+            size = file->dir_entry.file_size - offset;
+        }
+    }
+
+    fat_volume_t *volume = file->volume;
+    cluster_t start_cluster = fat_get_entry_cluster(volume, &file->dir_entry);
+    const uint8_t *input_buffer = (const uint8_t *)buffer;
+    size_t bytes_written = 0;
+
+    while(bytes_written < size){
+        uint32_t position = offset + bytes_written;
+        uint32_t cluster_index = position / volume->bytes_per_cluster;
+        uint32_t cluster_offset = position % volume->bytes_per_cluster;
+
+        // one lookup per contiguous run
+        cluster_t cluster;
+        uint32_t run_length;
+        fat_error_t err = fat_extent_lookup(file, start_cluster, cluster_index, 
+                                            &cluster, &run_length);
+
+        if(err == FAT_OK){
+            size_t run_remaining = (size_t)run_length * volume->bytes_per_cluster - 
+                                        cluster_offset;
+            size_t chunk_size = size - bytes_written;
+            if(chunk_size > run_remaining){
+                chunk_size = run_remaining;
+            }
+
+            err = fat_write_cluster_run(volume, cluster, cluster_offset, 
+                                        &input_buffer[bytes_written], 
+                                        chunk_size);
+            if(err == FAT_OK){
+                bytes_written += chunk_size;
+            }
+        }
+
+        if(err != FAT_OK){
+            if(bytes_written == 0){
+                return -(fat_ssize_t)err;
+            }
+            break;
+        }
+    }
+
+    if(offset + bytes_written > file->dir_entry.file_size){
+        file->dir_entry.file_size = offset + bytes_written;
+        fat_share_file_size(file);
+    }
+
+    file->modified = true;
+    return (fat_ssize_t)bytes_written;
+}
+
+fat_ssize_t fat_pwrite64(fat_file_t *file, 
+                         const void *buffer, 
+                         size_t size, 
+                         int64_t offset){
+
+    // parameter validation
+    if(!file || !file->volume){
+        return -FAT_ERR_INVALID_PARAM;
+    }
+
+    // past the end of any FAT file, so past this one's
+    if(offset < 0 || offset > FAT_MAX_FILE_SIZE){
+        return -FAT_ERR_INVALID_PARAM;
+    }
+
+    // the handle lock covers the cached entry, the position is left alone
+    fat_lock_file(file);
+    fat_lock_volume_for_write(file, false, offset, size);
+
+    // buffered data may overlap
+    fat_ssize_t result = -(fat_ssize_t)fat_buffer_flush(file);
+    if(result == 0){
+        result = fat_write_at(file, buffer, size, (uint32_t)offset);
+    }
+    fat_unlock_volume(file->volume);
+    fat_unlock_file(file);
+    return result;
+}
+
+int fat_pwrite(fat_file_t *file, 
+               const void *buffer, 
+               size_t size, 
+               uint32_t offset){
+
+    // the result must fit an int - larger requests end early
+    if(size > INT_MAX){
+        size = INT_MAX;
+    }
+
+    return (int)fat_pwrite64(file, buffer, size, offset);
+}
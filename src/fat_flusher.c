@@ -0,0 +1,263 @@
+#ifdef FAT_THREAD_SAFE
+#define _XOPEN_SOURCE 700           // clock_gettime
+#endif
+
+#include "fat_flusher.h"
+#include "fat_commit.h"
+#include "fat_lock.h"
+#include "fat_file.h"
+#include "fat_file_buffer.h"
+#include <stdlib.h>
+
+#ifdef FAT_THREAD_SAFE
+
+#include <pthread.h>
+#include <time.h>
+
+struct fat_flusher {
+    fat_volume_t *volume;
+    fat_flusher_params_t params;
+    bool owns_commit;                   // group commit enabled by the flusher
+
+    pthread_t thread;
+    pthread_mutex_t mutex;              // protects stop, wake
+    pthread_cond_t cond;
+    bool stop;
+    bool wake;
+
+    fat_error_t last_error;             // volume lock held
+};
+
+// buffered file data of open handles (volume lock held). file locks are
+// only tried - a handle in use flushes on its next operation anyway
+static void fat_flusher_write_buffers(struct fat_flusher *flusher, bool all){
+
+    fat_volume_t *volume = flusher->volume;
+    const fat_flusher_params_t *params = &flusher->params;
+
+    // the size threshold counts the data of all handles together
+    if(!all && params->max_dirty_bytes != 0){
+        uint64_t buffered = 0;
+        for(fat_file_t *file = volume->open_files; file; file = file->next_open){
+            if(fat_trylock_file(file)){
+                if(file->write_buffer){
+                    buffered += file->write_buffer->length;
+                }
+                fat_unlock_file(file);
+            }
+        }
+        all = (buffered >= params->max_dirty_bytes);
+    }
+
+    time_t now = time(NULL);
+    for(fat_file_t *file = volume->open_files; file; file = file->next_open){
+        if(!fat_trylock_file(file)){
+            continue;
+        }
+
+        fat_write_buffer_t *wb = file->write_buffer;
+        if(wb && wb->length > 0 &&
+           (all || now - wb->since >= (time_t)params->max_age_seconds)){
+            fat_error_t err = fat_buffer_flush(file);
+            if(err != FAT_OK){
+                flusher->last_error = err;
+            }
+        }
+        fat_unlock_file(file);
+    }
+}
+
+static void *fat_flusher_main(void *arg){
+
+    struct fat_flusher *flusher = (struct fat_flusher*)arg;
+    fat_volume_t *volume = flusher->volume;
+
+    pthread_mutex_lock(&flusher->mutex);
+    while(!flusher->stop){
+        if(!flusher->wake){
+            struct timespec deadline;
+            clock_gettime(CLOCK_REALTIME, &deadline);
+            deadline.tv_sec += flusher->params.interval_ms / 1000;
+            deadline.tv_nsec += (long)(flusher->params.interval_ms % 1000) * 1000000L;
+            if(deadline.tv_nsec >= 1000000000L){
+                deadline.tv_sec++;
+                deadline.tv_nsec -= 1000000000L;
+            }
+            pthread_cond_timedwait(&flusher->cond, &flusher->mutex, &deadline);
+        }
+
+        bool woken = flusher->wake;
+        flusher->wake = false;
+        if(flusher->stop){
+            break;
+        }
+
+        // never hold the flusher mutex while waiting for the volume
+        pthread_mutex_unlock(&flusher->mutex);
+
+        fat_lock_volume(volume);
+        bool due = woken || fat_flusher_due(volume);
+        fat_flusher_write_buffers(flusher, due);
+        if(due){
+            fat_error_t err = fat_sync(volume);
+            if(err != FAT_OK){
+                flusher->last_error = err;
+            }
+        }
+        fat_unlock_volume(volume);
+
+        pthread_mutex_lock(&flusher->mutex);
+    }
+    pthread_mutex_unlock(&flusher->mutex);
+
+    return NULL;
+}
+
+fat_error_t fat_start_flusher(fat_volume_t *volume,
+                              const fat_flusher_params_t *params){
+
+    // parameter validation
+    if(!volume || !params || params->interval_ms == 0){
+        return FAT_ERR_INVALID_PARAM;
+    }
+
+    if(volume->flusher){
+        return FAT_ERR_INVALID_PARAM; // already running
+    }
+
+    struct fat_flusher *flusher = calloc(1, sizeof(struct fat_flusher));
+    if(!flusher){
+        return FAT_ERR_NO_MEMORY;
+    }
+
+    flusher->volume = volume;
+    flusher->params = *params;
+    flusher->last_error = FAT_OK;
+
+    // foreground operations queue their changes from now on
+    if(!volume->commit){
+        fat_commit_params_t no_limits = {0, 0};
+        fat_error_t err = fat_enable_group_commit(volume, &no_limits);
+        if(err != FAT_OK){
+            free(flusher);
+            return err;
+        }
+        flusher->owns_commit = true;
+    }
+
+    pthread_mutex_init(&flusher->mutex, NULL);
+    pthread_cond_init(&flusher->cond, NULL);
+
+    fat_lock_volume(volume);
+    volume->flusher = flusher;
+    fat_unlock_volume(volume);
+
+    if(pthread_create(&flusher->thread, NULL, fat_flusher_main, flusher) != 0){
+        fat_lock_volume(volume);
+        volume->flusher = NULL;
+        fat_unlock_volume(volume);
+
+        pthread_cond_destroy(&flusher->cond);
+        pthread_mutex_destroy(&flusher->mutex);
+        if(flusher->owns_commit){
+            fat_disable_group_commit(volume);
+        }
+        free(flusher);
+        return FAT_ERR_NO_MEMORY;
+    }
+
+    return FAT_OK;
+}
+
+fat_error_t fat_stop_flusher(fat_volume_t *volume){
+
+    // parameter validation
+    if(!volume){
+        return FAT_ERR_INVALID_PARAM;
+    }
+
+    struct fat_flusher *flusher = volume->flusher;
+    if(!flusher){
+        return FAT_OK;
+    }
+
+    pthread_mutex_lock(&flusher->mutex);
+    flusher->stop = true;
+    pthread_cond_signal(&flusher->cond);
+    pthread_mutex_unlock(&flusher->mutex);
+
+    pthread_join(flusher->thread, NULL);
+
+    fat_lock_volume(volume);
+    volume->flusher = NULL;
+
+    // write back what is left, drop group commit if we enabled it
+    fat_error_t err = flusher->owns_commit ? fat_disable_group_commit(volume) :
+                                             fat_sync(volume);
+    if(err == FAT_OK){
+        err = flusher->last_error;
+    }
+    fat_unlock_volume(volume);
+
+    pthread_cond_destroy(&flusher->cond);
+    pthread_mutex_destroy(&flusher->mutex);
+    free(flusher);
+    return err;
+}
+
+bool fat_flusher_due(fat_volume_t *volume){
+
+    // parameter validation
+    if(!volume || !volume->flusher){
+        return false;
+    }
+
+    const fat_flusher_params_t *params = &volume->flusher->params;
+    fat_commit_params_t limits;
+    limits.max_dirty_sectors = (params->max_dirty_bytes + 
+                                volume->bytes_per_sector - 1) / 
+                                volume->bytes_per_sector;
+    limits.max_age_seconds = params->max_age_seconds;
+
+    return fat_commit_due(volume, &limits);
+}
+
+void fat_flusher_wake(fat_volume_t *volume){
+
+    // parameter validation
+    if(!volume || !volume->flusher){
+        return;
+    }
+
+    struct fat_flusher *flusher = volume->flusher;
+    pthread_mutex_lock(&flusher->mutex);
+    flusher->wake = true;
+    pthread_cond_signal(&flusher->cond);
+    pthread_mutex_unlock(&flusher->mutex);
+}
+
+#else
+
+// single threaded build - all write-back happens in fat_commit()/fat_sync()
+
+fat_error_t fat_start_flusher(fat_volume_t *volume,
+                              const fat_flusher_params_t *params){
+    (void)volume;
+    (void)params;
+    return FAT_ERR_NOT_SUPPORTED;
+}
+
+fat_error_t fat_stop_flusher(fat_volume_t *volume){
+    return volume ? FAT_OK : FAT_ERR_INVALID_PARAM;
+}
+
+bool fat_flusher_due(fat_volume_t *volume){
+    (void)volume;
+    return false;
+}
+
+void fat_flusher_wake(fat_volume_t *volume){
+    (void)volume;
+}
+
+#endif
@@ -0,0 +1,539 @@
+#include "fat_intent.h"
+#include "fat_commit.h"
+#include "fat_table.h"
+#include "fat_cluster.h"
+#include "fat_root.h"
+#include "fat_path.h"
+#include "fat_dir_slots.h"
+#include "fat_file.h"
+#include "fat_file_create.h"
+#include "fat_file_write.h"
+#include "fat_file_close.h"
+#include "fat_lock.h"
+#include <string.h>
+#include <stdlib.h>
+#include <stddef.h>
+
+static const uint8_t fat_intent_magic[8] = {'F','A','T','I','L','O','G','1'};
+
+struct fat_intent_log {
+    cluster_t *clusters;                // chain of the log file
+    uint32_t cluster_count;
+    uint32_t sequence;
+
+    // records of the transaction being built, capacity fills the log
+    uint8_t *records;
+    uint32_t record_bytes;
+    uint32_t capacity;
+};
+
+// FNV-1a, enough to tell a torn or stale log from a committed one
+static uint32_t fat_intent_checksum(const void *data, uint32_t length){
+    const uint8_t *bytes = (const uint8_t*)data;
+    uint32_t hash = 2166136261u;
+    for(uint32_t i = 0; i < length; i++){
+        hash = (hash ^ bytes[i]) * 16777619u;
+    }
+    return hash;
+}
+
+// read or write count log sectors starting at log sector first
+static fat_error_t fat_intent_io(fat_volume_t *volume,
+                                 const struct fat_intent_log *log,
+                                 uint32_t first,
+                                 uint32_t count,
+                                 uint8_t *buffer,
+                                 bool write){
+
+    while(count > 0){
+        uint32_t within = first % volume->sectors_per_cluster;
+        uint32_t run = volume->sectors_per_cluster - within;
+        if(run > count){
+            run = count;
+        }
+
+        uint32_t sector = fat_cluster_to_sector(volume,
+                            log->clusters[first / volume->sectors_per_cluster]) +
+                            within;
+
+        int result = write ?
+            volume->device->write_sectors(volume->device->device_data,
+                                          sector, run, buffer) :
+            volume->device->read_sectors(volume->device->device_data,
+                                         sector, run, buffer);
+        if(result != 0){
+            return FAT_ERR_DEVICE_ERROR;
+        }
+
+        first += run;
+        count -= run;
+        buffer += (size_t)run * volume->bytes_per_sector;
+    }
+
+    return FAT_OK;
+}
+
+static fat_error_t fat_intent_write_header(fat_volume_t *volume,
+                                           const struct fat_intent_log *log,
+                                           uint32_t record_bytes,
+                                           uint32_t record_checksum){
+
+    uint8_t *sector = calloc(1, volume->bytes_per_sector);
+    if(!sector){
+        return FAT_ERR_NO_MEMORY;
+    }
+
+    fat_intent_header_t header;
+    memcpy(header.magic, fat_intent_magic, sizeof(header.magic));
+    header.sequence = log->sequence;
+    header.record_bytes = record_bytes;
+    header.record_checksum = record_checksum;
+    header.header_checksum = fat_intent_checksum(&header,
+                                    offsetof(fat_intent_header_t, header_checksum));
+    memcpy(sector, &header, sizeof(header));
+
+    fat_error_t err = fat_intent_io(volume, log, 0, 1, sector, true);
+    free(sector);
+    return err;
+}
+
+// false unless the header sector holds an intact header
+static bool fat_intent_read_header(fat_volume_t *volume,
+                                   const struct fat_intent_log *log,
+                                   fat_intent_header_t *header,
+                                   fat_error_t *err){
+
+    uint8_t *sector = malloc(volume->bytes_per_sector);
+    if(!sector){
+        *err = FAT_ERR_NO_MEMORY;
+        return false;
+    }
+
+    *err = fat_intent_io(volume, log, 0, 1, sector, false);
+    memcpy(header, sector, sizeof(*header));
+    free(sector);
+
+    return *err == FAT_OK &&
+           memcmp(header->magic, fat_intent_magic, sizeof(header->magic)) == 0 &&
+           header->header_checksum == fat_intent_checksum(header,
+                                    offsetof(fat_intent_header_t, header_checksum));
+}
+
+// map the log file, entry is its directory entry
+static fat_error_t fat_intent_open(fat_volume_t *volume,
+                                   const fat_dir_entry_t *entry,
+                                   struct fat_intent_log **out){
+
+    if(entry->attr & FAT_ATTR_DIRECTORY){
+        return FAT_ERR_IS_A_DIRECTORY;
+    }
+
+    uint32_t cluster_count = (entry->file_size + volume->bytes_per_cluster - 1) /
+                             volume->bytes_per_cluster;
+    if((uint64_t)cluster_count * volume->sectors_per_cluster < 2){
+        return FAT_ERR_CORRUPTED; // no room behind the header
+    }
+
+    struct fat_intent_log *log = calloc(1, sizeof(struct fat_intent_log));
+    if(!log){
+        return FAT_ERR_NO_MEMORY;
+    }
+
+    log->clusters = malloc(cluster_count * sizeof(cluster_t));
+    if(!log->clusters){
+        free(log);
+        return FAT_ERR_NO_MEMORY;
+    }
+
+    // walk the chain once, the log never moves while it is in use
+    cluster_t cluster = fat_get_entry_cluster(volume, entry);
+    for(uint32_t i = 0; i < cluster_count; i++){
+        if(cluster < FAT_FIRST_VALID_CLUSTER || fat_is_eoc(volume, cluster) ||
+           fat_is_bad(volume, cluster)){
+            free(log->clusters);
+            free(log);
+            return FAT_ERR_CORRUPTED;
+        }
+        log->clusters[i] = cluster;
+
+        fat_error_t err = fat_get_next_cluster(volume, cluster, &cluster);
+        if(err != FAT_OK){
+            free(log->clusters);
+            free(log);
+            return err;
+        }
+    }
+    log->cluster_count = cluster_count;
+
+    log->capacity = (cluster_count * volume->sectors_per_cluster - 1) *
+                    volume->bytes_per_sector;
+    log->records = malloc(log->capacity);
+    if(!log->records){
+        free(log->clusters);
+        free(log);
+        return FAT_ERR_NO_MEMORY;
+    }
+
+    *out = log;
+    return FAT_OK;
+}
+
+static void fat_intent_close(struct fat_intent_log *log){
+    free(log->records);
+    free(log->clusters);
+    free(log);
+}
+
+// create the log file and get it to the disk before anything relies on it
+static fat_error_t fat_intent_create(fat_volume_t *volume, uint32_t log_bytes){
+
+    // header plus at least one sector of records, whole clusters
+    uint32_t minimum = 2 * volume->bytes_per_sector;
+    if(log_bytes < minimum){
+        log_bytes = minimum;
+    }
+    log_bytes = ((log_bytes + volume->bytes_per_cluster - 1) /
+                 volume->bytes_per_cluster) * volume->bytes_per_cluster;
+
+    uint8_t *zero = calloc(1, log_bytes);
+    if(!zero){
+        return FAT_ERR_NO_MEMORY;
+    }
+
+    fat_file_t *file;
+    fat_error_t err = fat_create(volume, FAT_INTENT_LOG_PATH,
+                                 FAT_ATTR_READ_ONLY | FAT_ATTR_HIDDEN |
+                                 FAT_ATTR_SYSTEM, &file);
+    if(err != FAT_OK){
+        free(zero);
+        return err;
+    }
+
+    int written = fat_write(file, zero, log_bytes);
+    free(zero);
+
+    err = fat_close(file);
+    if(written != (int)log_bytes){
+        return written < 0 ? (fat_error_t)-written : FAT_ERR_DISK_FULL;
+    }
+    if(err != FAT_OK){
+        return err;
+    }
+
+    return fat_sync(volume);
+}
+
+fat_error_t fat_enable_intent_log(fat_volume_t *volume, uint32_t log_bytes){
+
+    // parameter validation
+    if(!volume){
+        return FAT_ERR_INVALID_PARAM;
+    }
+
+    if(log_bytes == 0){
+        log_bytes = FAT_INTENT_DEFAULT_BYTES;
+    }
+
+    fat_lock_volume(volume);
+
+    if(volume->intent){
+        fat_unlock_volume(volume);
+        return FAT_OK;
+    }
+
+    fat_dir_entry_t entry;
+    fat_error_t err = fat_resolve_path(volume, FAT_INTENT_LOG_PATH, &entry,
+                                       NULL, NULL);
+    if(err == FAT_ERR_NOT_FOUND){
+        err = fat_intent_create(volume, log_bytes);
+        if(err == FAT_OK){
+            err = fat_resolve_path(volume, FAT_INTENT_LOG_PATH, &entry,
+                                   NULL, NULL);
+        }
+    }
+    if(err != FAT_OK){
+        fat_unlock_volume(volume);
+        return err;
+    }
+
+    struct fat_intent_log *log;
+    err = fat_intent_open(volume, &entry, &log);
+    if(err != FAT_OK){
+        fat_unlock_volume(volume);
+        return err;
+    }
+
+    // continue the sequence of an existing log, start clean
+    fat_intent_header_t header;
+    if(fat_intent_read_header(volume, log, &header, &err)){
+        log->sequence = header.sequence;
+    }
+    if(err == FAT_OK){
+        err = fat_intent_write_header(volume, log, 0, 0);
+    }
+    if(err != FAT_OK){
+        fat_intent_close(log);
+        fat_unlock_volume(volume);
+        return err;
+    }
+
+    volume->intent = log;
+
+    fat_unlock_volume(volume);
+    return FAT_OK;
+}
+
+fat_error_t fat_disable_intent_log(fat_volume_t *volume){
+
+    // parameter validation
+    if(!volume){
+        return FAT_ERR_INVALID_PARAM;
+    }
+
+    fat_lock_volume(volume);
+
+    fat_error_t err = fat_sync(volume);
+    if(err == FAT_OK){
+        fat_intent_release(volume);
+    } // else keep logging, nothing is lost
+
+    fat_unlock_volume(volume);
+    return err;
+}
+
+fat_error_t fat_replay_intent_log(fat_volume_t *volume){
+
+    // parameter validation
+    if(!volume){
+        return FAT_ERR_INVALID_PARAM;
+    }
+
+    if(volume->intent){
+        return FAT_OK; // log in use, nothing left behind by a crash
+    }
+
+    fat_dir_entry_t entry;
+    fat_error_t err = fat_resolve_path(volume, FAT_INTENT_LOG_PATH, &entry,
+                                       NULL, NULL);
+    if(err == FAT_ERR_NOT_FOUND){
+        return FAT_OK;
+    }
+    if(err != FAT_OK){
+        return err;
+    }
+
+    struct fat_intent_log *log;
+    err = fat_intent_open(volume, &entry, &log);
+    if(err != FAT_OK){
+        return err;
+    }
+
+    fat_intent_header_t header;
+    if(!fat_intent_read_header(volume, log, &header, &err) ||
+       header.record_bytes == 0){
+        fat_intent_close(log);
+        return err; // no log written yet, or checkpointed
+    }
+    log->sequence = header.sequence;
+
+    uint8_t *sector_data = NULL;
+    uint32_t record_sectors = (header.record_bytes + volume->bytes_per_sector - 1) /
+                              volume->bytes_per_sector;
+    if(header.record_bytes > log->capacity){
+        goto clear; // damaged header
+    }
+
+    err = fat_intent_io(volume, log, 1, record_sectors, log->records, false);
+    if(err != FAT_OK){
+        goto cleanup;
+    }
+
+    // damaged records - metadata stays as the in place writes left it
+    if(fat_intent_checksum(log->records, header.record_bytes) !=
+       header.record_checksum){
+        goto clear;
+    }
+
+    sector_data = malloc(volume->bytes_per_sector);
+    if(!sector_data){
+        err = FAT_ERR_NO_MEMORY;
+        goto cleanup;
+    }
+
+    // records are idempotent, replaying a replayed log is harmless
+    uint32_t position = 0;
+    while(position + sizeof(fat_intent_record_t) <= header.record_bytes){
+        fat_intent_record_t record;
+        memcpy(&record, &log->records[position], sizeof(record));
+        position += sizeof(record);
+
+        const uint8_t *data = &log->records[position];
+        position += record.length;
+
+        if(position > header.record_bytes ||
+           (uint32_t)record.offset + record.length > volume->bytes_per_sector){
+            break;
+        }
+
+        if(record.area == FAT_INTENT_AREA_FAT &&
+           record.sector < volume->fat_size_sectors){
+            err = fat_write_table_bytes(volume,
+                        record.sector * volume->bytes_per_sector + record.offset,
+                        data, record.length);
+        } else if(record.area == FAT_INTENT_AREA_DIR &&
+                  record.sector < volume->total_sectors){
+            int result = volume->device->read_sectors(volume->device->device_data,
+                                                      record.sector, 1,
+                                                      sector_data);
+            if(result == 0){
+                memcpy(&sector_data[record.offset], data, record.length);
+                result = volume->device->write_sectors(
+                                volume->device->device_data,
+                                record.sector, 1, sector_data);
+            }
+            err = (result != 0) ? FAT_ERR_DEVICE_ERROR : FAT_OK;
+        }
+
+        if(err != FAT_OK){
+            goto cleanup; // log stays committed, replayed at the next mount
+        }
+    }
+
+    // every FAT copy gets the replayed sectors
+    err = fat_flush(volume);
+    if(err != FAT_OK){
+        goto cleanup;
+    }
+
+    // free-slot maps may predate the replayed entries
+    fat_dir_slots_free_all(volume);
+
+clear:
+    err = fat_intent_write_header(volume, log, 0, 0);
+
+cleanup:
+    free(sector_data);
+    fat_intent_close(log);
+    return err;
+}
+
+bool fat_intent_active(fat_volume_t *volume){
+    return volume && volume->intent;
+}
+
+void fat_intent_begin(fat_volume_t *volume){
+
+    // parameter validation
+    if(!volume || !volume->intent){
+        return;
+    }
+
+    volume->intent->record_bytes = 0;
+}
+
+bool fat_intent_add(fat_volume_t *volume,
+                    uint8_t area,
+                    uint32_t sector,
+                    const uint8_t *old_data,
+                    const uint8_t *new_data){
+
+    // parameter validation
+    if(!volume || !volume->intent || !old_data || !new_data){
+        return false;
+    }
+
+    struct fat_intent_log *log = volume->intent;
+    uint32_t i = 0;
+
+    while(i < volume->bytes_per_sector){
+        if(old_data[i] == new_data[i]){
+            i++;
+            continue;
+        }
+
+        // one run per change, gaps shorter than a record header are merged
+        uint32_t start = i;
+        uint32_t end = i + 1;
+        for(uint32_t j = end; j < volume->bytes_per_sector; j++){
+            if(old_data[j] != new_data[j]){
+                end = j + 1;
+            } else if(j - end >= sizeof(fat_intent_record_t)){
+                break;
+            }
+        }
+
+        uint32_t length = end - start;
+        if(log->record_bytes + sizeof(fat_intent_record_t) + length >
+           log->capacity){
+            return false;
+        }
+
+        fat_intent_record_t record;
+        memset(&record, 0, sizeof(record));
+        record.area = area;
+        record.offset = (uint16_t)start;
+        record.sector = sector;
+        record.length = (uint16_t)length;
+
+        memcpy(&log->records[log->record_bytes], &record, sizeof(record));
+        log->record_bytes += sizeof(record);
+        memcpy(&log->records[log->record_bytes], &new_data[start], length);
+        log->record_bytes += length;
+
+        i = end;
+    }
+
+    return true;
+}
+
+fat_error_t fat_intent_commit(fat_volume_t *volume){
+
+    // parameter validation
+    if(!volume || !volume->intent){
+        return FAT_ERR_INVALID_PARAM;
+    }
+
+    struct fat_intent_log *log = volume->intent;
+    if(log->record_bytes == 0){
+        return FAT_OK;
+    }
+
+    // records first, the header sector makes them count
+    uint32_t record_sectors = (log->record_bytes + volume->bytes_per_sector - 1) /
+                              volume->bytes_per_sector;
+    fat_error_t err = fat_intent_io(volume, log, 1, record_sectors,
+                                    log->records, true);
+    if(err != FAT_OK){
+        return err;
+    }
+
+    log->sequence++;
+    return fat_intent_write_header(volume, log, log->record_bytes,
+                        fat_intent_checksum(log->records, log->record_bytes));
+}
+
+fat_error_t fat_intent_checkpoint(fat_volume_t *volume){
+
+    // parameter validation
+    if(!volume || !volume->intent){
+        return FAT_ERR_INVALID_PARAM;
+    }
+
+    if(volume->intent->record_bytes == 0){
+        return FAT_OK;
+    }
+
+    volume->intent->record_bytes = 0;
+    return fat_intent_write_header(volume, volume->intent, 0, 0);
+}
+
+void fat_intent_release(fat_volume_t *volume){
+
+    // parameter validation
+    if(!volume || !volume->intent){
+        return;
+    }
+
+    fat_intent_close(volume->intent);
+    volume->intent = NULL;
+}
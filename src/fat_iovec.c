@@ -0,0 +1,120 @@
+#include "fat_iovec.h"
+#include <string.h>
+
+bool fat_iov_total(const fat_iovec_t *iov, int count, size_t *total){
+
+    // parameter validation
+    if(!iov || count <= 0 || !total){
+        return false;
+    }
+
+    size_t sum = 0;
+    for(int i = 0; i < count; i++){
+        if(!iov[i].base && iov[i].length > 0){
+            return false;
+        }
+        if(iov[i].length > SIZE_MAX - sum){
+            return false;
+        }
+        sum += iov[i].length;
+    }
+
+    *total = sum;
+    return true;
+}
+
+// step over used up and empty buffers
+static void fat_iov_normalize(fat_iov_cursor_t *cursor){
+    while(cursor->count > 0 && cursor->offset >= cursor->iov[0].length){
+        cursor->iov++;
+        cursor->count--;
+        cursor->offset = 0;
+    }
+}
+
+void fat_iov_init(fat_iov_cursor_t *cursor, const fat_iovec_t *iov, int count){
+    cursor->iov = iov;
+    cursor->count = count;
+    cursor->offset = 0;
+    fat_iov_normalize(cursor);
+}
+
+void fat_iov_advance(fat_iov_cursor_t *cursor, size_t length){
+    while(length > 0 && cursor->count > 0){
+        size_t span = fat_iov_span(cursor);
+        size_t step = (length < span) ? length : span;
+        cursor->offset += step;
+        length -= step;
+        fat_iov_normalize(cursor);
+    }
+}
+
+void fat_iov_copy_out(fat_iov_cursor_t *cursor, const void *data, size_t length){
+    const uint8_t *source = (const uint8_t *)data;
+    while(length > 0 && cursor->count > 0){
+        size_t span = fat_iov_span(cursor);
+        size_t step = (length < span) ? length : span;
+        memcpy(fat_iov_base(cursor), source, step);
+        source += step;
+        length -= step;
+        fat_iov_advance(cursor, step);
+    }
+}
+
+void fat_iov_copy_in(fat_iov_cursor_t *cursor, void *data, size_t length){
+    uint8_t *target = (uint8_t *)data;
+    while(length > 0 && cursor->count > 0){
+        size_t span = fat_iov_span(cursor);
+        size_t step = (length < span) ? length : span;
+        memcpy(target, fat_iov_base(cursor), step);
+        target += step;
+        length -= step;
+        fat_iov_advance(cursor, step);
+    }
+}
+
+fat_error_t fat_iov_slice(const fat_iov_cursor_t *cursor,
+                          size_t length,
+                          fat_iovec_t **slice,
+                          int *count){
+
+    // parameter validation
+    if(!cursor || !slice || !count || length == 0){
+        return FAT_ERR_INVALID_PARAM;
+    }
+
+    // count the pieces first
+    fat_iov_cursor_t walk = *cursor;
+    int pieces = 0;
+    for(size_t left = length; left > 0 && walk.count > 0; pieces++){
+        size_t span = fat_iov_span(&walk);
+        size_t step = (left < span) ? left : span;
+        left -= step;
+        fat_iov_advance(&walk, step);
+    }
+
+    fat_iovec_t *list = malloc((size_t)pieces * sizeof(fat_iovec_t));
+    if(!list){
+        return FAT_ERR_NO_MEMORY;
+    }
+
+    walk = *cursor;
+    size_t left = length;
+    for(int i = 0; i < pieces; i++){
+        size_t span = fat_iov_span(&walk);
+        list[i].base = fat_iov_base(&walk);
+        list[i].length = (left < span) ? left : span;
+        left -= list[i].length;
+        fat_iov_advance(&walk, list[i].length);
+    }
+
+    if(left > 0){
+        // buffers shorter than length
+        free(list);
+        return FAT_ERR_INVALID_PARAM;
+    }
+
+    *slice = list;
+    *count = pieces;
+    return FAT_OK;
+}
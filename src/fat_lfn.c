@@ -77,6 +77,124 @@ uint8_t fat_calculate_lfn_checksum(const uint8_t *short_name){
     return checksum;
 }
 
+// UTF-8 bytes of one code point
+static size_t fat_utf8_bytes(uint32_t code){
+    return (code < 0x80) ? 1 : (code < 0x800) ? 2 : (code < 0x10000) ? 3 : 4;
+}
+
+size_t fat_utf16_to_utf8(const uint16_t *utf16, 
+                         size_t length, 
+                         char *output, 
+                         size_t output_size){
+
+    // parameter validation
+    if(!output || output_size == 0){
+        return 0;
+    }
+
+    size_t out_pos = 0;
+    for(size_t i = 0; utf16 && i < length; i++){
+        uint32_t code = utf16[i];
+
+        // surrogate pair - one code point above 0xFFFF
+        if(code >= 0xD800 && code <= 0xDBFF && i + 1 < length &&
+           utf16[i + 1] >= 0xDC00 && utf16[i + 1] <= 0xDFFF){
+            code = 0x10000 + ((code - 0xD800) << 10) + (utf16[i + 1] - 0xDC00);
+            i++;
+        } else if(code >= 0xD800 && code <= 0xDFFF){
+            code = '?';
+        }
+
+        size_t bytes = fat_utf8_bytes(code);
+        if(out_pos + bytes >= output_size){
+            break;
+        }
+
+        switch(bytes){
+        case 1:
+            output[out_pos++] = (char)code;
+            break;
+        case 2:
+            output[out_pos++] = (char)(0xC0 | (code >> 6));
+            output[out_pos++] = (char)(0x80 | (code & 0x3F));
+            break;
+        case 3:
+            output[out_pos++] = (char)(0xE0 | (code >> 12));
+            output[out_pos++] = (char)(0x80 | ((code >> 6) & 0x3F));
+            output[out_pos++] = (char)(0x80 | (code & 0x3F));
+            break;
+        default:
+            output[out_pos++] = (char)(0xF0 | (code >> 18));
+            output[out_pos++] = (char)(0x80 | ((code >> 12) & 0x3F));
+            output[out_pos++] = (char)(0x80 | ((code >> 6) & 0x3F));
+            output[out_pos++] = (char)(0x80 | (code & 0x3F));
+            break;
+        }
+    }
+
+    output[out_pos] = '\0';
+    return out_pos;
+}
+
+fat_error_t fat_utf8_to_utf16(const char *utf8, 
+                              uint16_t *output, 
+                              size_t capacity, 
+                              size_t *length){
+
+    // parameter validation
+    if(!utf8 || !length){
+        return FAT_ERR_INVALID_PARAM;
+    }
+
+    const uint8_t *in = (const uint8_t*)utf8;
+    size_t out_pos = 0;
+
+    while(*in){
+        uint32_t code = *in;
+        size_t bytes = (code < 0x80) ? 1 : ((code & 0xE0) == 0xC0) ? 2 :
+                       ((code & 0xF0) == 0xE0) ? 3 : ((code & 0xF8) == 0xF0) ? 4 : 0;
+        if(bytes == 0){
+            return FAT_ERR_INVALID_PARAM; // continuation or invalid lead byte
+        }
+
+        if(bytes > 1){
+            code &= 0x3F >> (bytes - 1);
+            for(size_t i = 1; i < bytes; i++){
+                if((in[i] & 0xC0) != 0x80){
+                    return FAT_ERR_INVALID_PARAM; // truncated sequence
+                }
+                code = (code << 6) | (in[i] & 0x3F);
+            }
+
+            // overlong forms, surrogates and values beyond Unicode
+            if(fat_utf8_bytes(code) != bytes || code > 0x10FFFF ||
+               (code >= 0xD800 && code <= 0xDFFF)){
+                return FAT_ERR_INVALID_PARAM;
+            }
+        }
+        in += bytes;
+
+        size_t units = (code >= 0x10000) ? 2 : 1;
+        if(out_pos + units > capacity){
+            return FAT_ERR_INVALID_PARAM;
+        }
+
+        if(output){
+            if(units == 2){
+                code -= 0x10000;
+                output[out_pos] = (uint16_t)(0xD800 + (code >> 10));
+                output[out_pos + 1] = (uint16_t)(0xDC00 + (code & 0x3FF));
+            } else {
+                output[out_pos] = (uint16_t)code;
+            }
+        }
+        out_pos += units;
+    }
+
+    *length = out_pos;
+    return FAT_OK;
+}
+
 fat_error_t fat_read_lfn_sequence(fat_volume_t *volume, 
                                   uint32_t dir_cluster,
                                   uint32_t *entry_index, 
@@ -89,56 +207,53 @@ fat_error_t fat_read_lfn_sequence(fat_volume_t *volume,
         return FAT_ERR_INVALID_PARAM;
     }
 
-    uint16_t utf16_buffer[256];
+    fat_dir_loc_t loc;
+    fat_error_t err = fat_dir_loc_from_index(volume, dir_cluster, *entry_index, 
+                                             &loc);
+    if(err != FAT_OK){
+        return FAT_ERR_CORRUPTED;
+    }
+
+    err = fat_read_lfn_sequence_at(volume, dir_cluster, &loc, filename_buffer, 
+                                   buffer_size, expected_checksum);
+    if(err != FAT_OK){
+        return err;
+    }
+
+    *entry_index = loc.index;
+    return FAT_OK;
+}
+
+fat_error_t fat_read_lfn_sequence_at(fat_volume_t *volume, 
+                                     uint32_t dir_cluster,
+                                     fat_dir_loc_t *loc, 
+                                     char *filename_buffer,
+                                     size_t buffer_size, 
+                                     uint8_t expected_checksum){
+    
+    // parameter validation
+    if (!volume || !loc || loc->sector == 0 || !filename_buffer || 
+        buffer_size == 0){
+        return FAT_ERR_INVALID_PARAM;
+    }
+
+    uint16_t utf16_buffer[260];
     int utf16_length = 0;
 
-    uint32_t current_index = *entry_index;
+    fat_dir_loc_t current = *loc;
     uint8_t expected_order = 1;
     bool found_first = false;
 
-    bool is_root_fat1216 = (dir_cluster == 0 && volume->type != FAT_TYPE_FAT32);
-    uint32_t entries_per_cluster = volume->bytes_per_cluster / 32;
-
     // read backwards through directory entries
-    while(current_index > 0){
-        current_index--;
-
-        uint32_t sector;
-        uint32_t entry_offset;
-
-        if(is_root_fat1216){
-            // FAT12/16 root directory (fixed region)
-            uint32_t entries_per_sector = volume->bytes_per_sector / 32;
-            uint32_t root_start = volume->reserved_sector_count +
-                                    (volume->num_fats * volume->fat_size_sectors);
-            sector = root_start + (current_index / entries_per_sector);
-            entry_offset = (current_index  % entries_per_sector);
-        } else {
-            // FAT32 root directory / subdirectory
-            uint32_t cluster_index = current_index / entries_per_cluster;
-            entry_offset = (current_index % entries_per_cluster);
-        
-            // walk cluster chain
-            uint32_t target_cluster = dir_cluster;
-            for(uint32_t i=0; i<cluster_index; i++){
-                fat_error_t err = fat_get_next_cluster(volume, 
-                                                       target_cluster, 
-                                                       &target_cluster);
-                if(err != FAT_OK || fat_is_eoc(volume, target_cluster)){
-                    return FAT_ERR_CORRUPTED;
-                }
-            }
-
-            // convert cluster to sector
-            sector = volume->data_begin_sector + 
-                        ((target_cluster -2) * volume->sectors_per_cluster);
-            sector += entry_offset / volume->bytes_per_sector;
-            entry_offset = entry_offset % volume->bytes_per_sector;
+    while(current.index > 0){
+        fat_error_t err = fat_dir_loc_prev(volume, dir_cluster, &current);
+        if(err != FAT_OK){
+            return FAT_ERR_CORRUPTED;
         }
 
         // read directory entry
         fat_lfn_entry_t lfn_entry;        
-        fat_error_t err = fat_read_dir_entry(volume, sector, entry_offset, 
+        err = fat_read_dir_entry(volume, current.sector, current.offset, 
                                             (fat_dir_entry_t*)&lfn_entry);
 
         if(err != FAT_OK){
@@ -155,14 +270,9 @@ fat_error_t fat_read_lfn_sequence(fat_volume_t *volume,
             return FAT_ERR_CORRUPTED;
         }
         
-        // check if this is the first LFN entry
-        if(lfn_entry.order & 0x40){
-            found_first = true;
-            expected_order = lfn_entry.order & 0x3F; // remove bit 0x40
-        }
-
-        // validate sequence order
-        if((lfn_entry.order & 0x3F) != expected_order){
+        // validate sequence order - entries in front of the short name 
+        // count up from 1 to the last entry (0x40 bit set)
+        if((lfn_entry.order & 0x3F) != expected_order || expected_order > 20){
             return FAT_ERR_CORRUPTED;
         }
 
@@ -173,38 +283,27 @@ fat_error_t fat_read_lfn_sequence(fat_volume_t *volume,
             return err;
         }
 
-        // prepend characters to buffer - shift existing characters to the right
-        memmove(&utf16_buffer[chars_read], utf16_buffer, 
-                utf16_length * sizeof(uint16_t));
-        memcpy(utf16_buffer, entry_chars, chars_read * sizeof(uint16_t));
+        // append characters - walking backwards yields the name front to back
+        memcpy(&utf16_buffer[utf16_length], entry_chars, 
+               chars_read * sizeof(uint16_t));
         utf16_length += chars_read;
-        
-        expected_order--;
 
-        if(expected_order == 0){
+        // check if this is the last LFN entry of the sequence
+        if(lfn_entry.order & 0x40){
+            found_first = true;
             break;
         }
+
+        expected_order++;
     }
 
     if (!found_first){
         return FAT_ERR_CORRUPTED;
     }
 
-    // convert UTF-16LE to UTF-8/ASCII
-    size_t out_pos = 0;
-    for(int i = 0; i < utf16_length && out_pos < buffer_size - 1; i++){
-        if(utf16_buffer[i] < 0x80){
-            // ASCI range - direct conversion
-            filename_buffer[out_pos++] = (char)utf16_buffer[i];
-        } else {
-            // TODO proper UTF16 to UTF-8 conversion
-            filename_buffer[out_pos++] = '?';
-        }
-    }
-
-    filename_buffer[out_pos] = '\0';
+    fat_utf16_to_utf8(utf16_buffer, utf16_length, filename_buffer, buffer_size);
 
-    *entry_index = current_index;
+    *loc = current;
     return FAT_OK;
 }
 
@@ -218,17 +317,12 @@ fat_error_t fat_create_lfn_entries (const char *long_name,
         return FAT_ERR_INVALID_PARAM;
     }
 
-    // convert UTF-8/ASCII to UTF-16LE
-    uint16_t utf16_name[256];
-    size_t name_len = strlen(long_name);
-
-    if(name_len > 255){
-        return FAT_ERR_INVALID_PARAM;
-    }
-
-    // simple ASCII to UTF-16LE conversion
-    for(size_t i = 0; i < name_len; i++){
-        utf16_name[i] = (uint16_t)(unsigned char)long_name[i];
+    // convert UTF-8 to UTF-16, at most 255 units
+    uint16_t utf16_name[255];
+    size_t name_len;
+    fat_error_t err = fat_utf8_to_utf16(long_name, utf16_name, 255, &name_len);
+    if(err != FAT_OK){
+        return err;
     }
 
     uint8_t checksum = fat_calculate_lfn_checksum(short_name);
@@ -255,8 +349,9 @@ fat_error_t fat_create_lfn_entries (const char *long_name,
         entry->checksum = checksum;
         entry->first_cluster_low = 0;
 
-        // calculate character range
-        size_t start_char = entry_num * 13;
+        // calculate character range - the entry with order n holds 
+        // characters (n-1)*13 onwards
+        size_t start_char = (size_t)(order & 0x3F) * 13 - 13;
         bool terminated = false;
 
         // fill name1
@@ -0,0 +1,221 @@
+#ifdef FAT_THREAD_SAFE
+#define _XOPEN_SOURCE 700           // reader-writer locks
+#endif
+
+#include "fat_lock.h"
+#include <stdlib.h>
+
+#ifdef FAT_THREAD_SAFE
+
+#include <pthread.h>
+#include <stdint.h>
+
+struct fat_volume_lock {
+    pthread_rwlock_t rwlock;
+    pthread_key_t depth;            // nesting of the calling thread
+};
+
+struct fat_file_lock {
+    pthread_mutex_t mutex;
+    pthread_mutex_t extents;        // extent map, shared by positional calls
+};
+
+fat_error_t fat_lock_init(fat_volume_t *volume){
+
+    // parameter validation
+    if(!volume){
+        return FAT_ERR_INVALID_PARAM;
+    }
+
+    struct fat_volume_lock *lock = malloc(sizeof(struct fat_volume_lock));
+    if(!lock){
+        return FAT_ERR_NO_MEMORY;
+    }
+
+    if(pthread_rwlock_init(&lock->rwlock, NULL) != 0){
+        free(lock);
+        return FAT_ERR_NO_MEMORY;
+    }
+
+    // public calls nest (close -> sync -> flush), the depth makes them reentrant
+    if(pthread_key_create(&lock->depth, NULL) != 0){
+        pthread_rwlock_destroy(&lock->rwlock);
+        free(lock);
+        return FAT_ERR_NO_MEMORY;
+    }
+
+    volume->lock = lock;
+    return FAT_OK;
+}
+
+void fat_lock_destroy(fat_volume_t *volume){
+
+    // parameter validation
+    if(!volume || !volume->lock){
+        return;
+    }
+
+    pthread_key_delete(volume->lock->depth);
+    pthread_rwlock_destroy(&volume->lock->rwlock);
+    free(volume->lock);
+    volume->lock = NULL;
+}
+
+static uintptr_t fat_lock_depth(struct fat_volume_lock *lock){
+    return (uintptr_t)pthread_getspecific(lock->depth);
+}
+
+void fat_lock_volume(fat_volume_t *volume){
+    if(volume && volume->lock){
+        uintptr_t depth = fat_lock_depth(volume->lock);
+        if(depth == 0){
+            pthread_rwlock_wrlock(&volume->lock->rwlock);
+        }
+        pthread_setspecific(volume->lock->depth, (void*)(depth + 1));
+    }
+}
+
+void fat_lock_volume_shared(fat_volume_t *volume){
+    if(volume && volume->lock){
+        uintptr_t depth = fat_lock_depth(volume->lock);
+        if(depth == 0){
+            pthread_rwlock_rdlock(&volume->lock->rwlock);
+        }
+        pthread_setspecific(volume->lock->depth, (void*)(depth + 1));
+    }
+}
+
+void fat_unlock_volume(fat_volume_t *volume){
+    if(volume && volume->lock){
+        uintptr_t depth = fat_lock_depth(volume->lock);
+        pthread_setspecific(volume->lock->depth, (void*)(depth - 1));
+        if(depth == 1){
+            pthread_rwlock_unlock(&volume->lock->rwlock);
+        }
+    }
+}
+
+fat_error_t fat_lock_file_init(fat_file_t *file){
+
+    // parameter validation
+    if(!file){
+        return FAT_ERR_INVALID_PARAM;
+    }
+
+    struct fat_file_lock *lock = malloc(sizeof(struct fat_file_lock));
+    if(!lock){
+        return FAT_ERR_NO_MEMORY;
+    }
+
+    if(pthread_mutex_init(&lock->mutex, NULL) != 0){
+        free(lock);
+        return FAT_ERR_NO_MEMORY;
+    }
+
+    if(pthread_mutex_init(&lock->extents, NULL) != 0){
+        pthread_mutex_destroy(&lock->mutex);
+        free(lock);
+        return FAT_ERR_NO_MEMORY;
+    }
+
+    file->lock = lock;
+    return FAT_OK;
+}
+
+void fat_lock_file_destroy(fat_file_t *file){
+
+    // parameter validation
+    if(!file || !file->lock){
+        return;
+    }
+
+    pthread_mutex_destroy(&file->lock->extents);
+    pthread_mutex_destroy(&file->lock->mutex);
+    free(file->lock);
+    file->lock = NULL;
+}
+
+void fat_lock_file(fat_file_t *file){
+    if(file && file->lock){
+        pthread_mutex_lock(&file->lock->mutex);
+    }
+}
+
+void fat_unlock_file(fat_file_t *file){
+    if(file && file->lock){
+        pthread_mutex_unlock(&file->lock->mutex);
+    }
+}
+
+bool fat_trylock_file(fat_file_t *file){
+    if(file && file->lock){
+        return pthread_mutex_trylock(&file->lock->mutex) == 0;
+    }
+    return file != NULL;
+}
+
+void fat_lock_extents(fat_file_t *file){
+    if(file && file->lock){
+        pthread_mutex_lock(&file->lock->extents);
+    }
+}
+
+void fat_unlock_extents(fat_file_t *file){
+    if(file && file->lock){
+        pthread_mutex_unlock(&file->lock->extents);
+    }
+}
+
+#else
+
+// single threaded build
+
+fat_error_t fat_lock_init(fat_volume_t *volume){
+    return volume ? FAT_OK : FAT_ERR_INVALID_PARAM;
+}
+
+void fat_lock_destroy(fat_volume_t *volume){
+    (void)volume;
+}
+
+void fat_lock_volume(fat_volume_t *volume){
+    (void)volume;
+}
+
+void fat_lock_volume_shared(fat_volume_t *volume){
+    (void)volume;
+}
+
+void fat_unlock_volume(fat_volume_t *volume){
+    (void)volume;
+}
+
+fat_error_t fat_lock_file_init(fat_file_t *file){
+    return file ? FAT_OK : FAT_ERR_INVALID_PARAM;
+}
+
+void fat_lock_file_destroy(fat_file_t *file){
+    (void)file;
+}
+
+void fat_lock_file(fat_file_t *file){
+    (void)file;
+}
+
+void fat_unlock_file(fat_file_t *file){
+    (void)file;
+}
+
+bool fat_trylock_file(fat_file_t *file){
+    return file != NULL;
+}
+
+void fat_lock_extents(fat_file_t *file){
+    (void)file;
+}
+
+void fat_unlock_extents(fat_file_t *file){
+    (void)file;
+}
+
+#endif
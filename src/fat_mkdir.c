@@ -6,6 +6,8 @@
 #include "fat_lfn.h"
 #include "fat_file_create.h"
 #include "fat_root.h"
+#include "fat_commit.h"
+#include "fat_lock.h"
 #include <string.h>
 #include <stdlib.h>
 #include <time.h>
@@ -155,7 +157,7 @@ fat_error_t fat_create_directory_entry(fat_volume_t *volume,
 
     return fat_create_directory_entries(volume, parent_cluster, entry_index, 
                                         dir_name, short_name, dir_cluster, 
-                                        FAT_ATTR_DIRECTORY);
+                                        FAT_ATTR_DIRECTORY, NULL);
 }
 
 fat_error_t fat_check_directory_space(fat_volume_t *volume, 
@@ -174,7 +176,7 @@ fat_error_t fat_check_directory_space(fat_volume_t *volume,
                                &entry_index);
 }
 
-fat_error_t fat_mkdir(fat_volume_t *volume, const char *path){
+static fat_error_t fat_mkdir_locked(fat_volume_t *volume, const char *path){
 
     // parameter validation
     if(!volume || !path){
@@ -256,7 +258,8 @@ fat_error_t fat_mkdir(fat_volume_t *volume, const char *path){
     }
 
     cluster_t dir_cluster;
-    err = fat_allocate_cluster(volume, &dir_cluster);
+    fat_alloc_hint_t hint = { 0, parent_dir_cluster, 1 };
+    err = fat_allocate_cluster_hint(volume, &hint, &dir_cluster);
     if(err != FAT_OK){
         // drive full
         free(path_copy);
@@ -307,7 +310,7 @@ fat_error_t fat_mkdir(fat_volume_t *volume, const char *path){
     }
 
     // flush changes
-    err = fat_flush(volume);
+    err = fat_commit(volume);
     if(err != FAT_OK){
         // directory created, but changes might not be persistent
         free(path_copy);
@@ -316,4 +319,17 @@ fat_error_t fat_mkdir(fat_volume_t *volume, const char *path){
 
     free(path_copy);
     return FAT_OK;
-}
\ No newline at end of file
+}
+
+fat_error_t fat_mkdir(fat_volume_t *volume, const char *path){
+
+    // parameter validation
+    if(!volume || !path){
+        return FAT_ERR_INVALID_PARAM;
+    }
+
+    fat_lock_volume(volume);
+    fat_error_t err = fat_mkdir_locked(volume, path);
+    fat_unlock_volume(volume);
+    return err;
+}
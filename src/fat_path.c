@@ -1,5 +1,6 @@
 #include "fat_path.h"
 #include "fat_dir_search.h"
+#include "fat_lfn.h"
 #include "fat_root.h"
 #include <string.h>
 #include <stdlib.h>
@@ -13,8 +14,9 @@ bool fat_validate_component(const char *component){
     }
 
 
-    // 255 characters is max length for LFN
-    if(strlen(component) > 255){
+    // 255 UTF-16 units is max length for LFN
+    size_t units;
+    if(fat_utf8_to_utf16(component, NULL, 255, &units) != FAT_OK){
         return false;
     }
 
@@ -26,9 +28,9 @@ bool fat_validate_component(const char *component){
     // check for invalid characters
     const char *invalid_chars = "<>:\"|?*";
     for(size_t i = 0; i<strlen(component); i++){
-        char c = component[i];
+        unsigned char c = component[i];
 
-        // control characters (0-31)
+        // control characters (0-31), bytes of UTF-8 sequences pass
         if(c<32){
             return false;
         }
@@ -149,7 +151,7 @@ fat_error_t fat_find_in_directory(fat_volume_t *volume,
                                   cluster_t dir_cluster, 
                                   const char *component, 
                                   fat_dir_entry_t *entry, 
-                                  uint32_t *entry_index){
+                                  fat_dir_loc_t *loc){
 
     // parameter validation
     if(!volume || !component || !entry){
@@ -164,8 +166,9 @@ fat_error_t fat_find_in_directory(fat_volume_t *volume,
         entry->attr = FAT_ATTR_DIRECTORY;
         fat_set_entry_cluster(volume, entry, dir_cluster);
 
-        if(entry_index){
-            *entry_index = 0;   // "." is the first entry
+        if(loc){
+            memset(loc, 0, sizeof(fat_dir_loc_t));
+            loc->index = 0;     // "." is the first entry
         }
         return FAT_OK;
     }
@@ -179,7 +182,7 @@ fat_error_t fat_find_in_directory(fat_volume_t *volume,
         } else {
             // TODO full implementation - must track parent directories 
             // or search for ".." in current directory
-            return fat_find_entry(volume, dir_cluster, "..", entry, entry_index);
+            return fat_find_entry_loc(volume, dir_cluster, "..", entry, loc);
         }
 
         // create entry for parent directory
@@ -188,14 +191,15 @@ fat_error_t fat_find_in_directory(fat_volume_t *volume,
         entry->attr = FAT_ATTR_DIRECTORY;
         fat_set_entry_cluster(volume, entry, parent_cluster);
 
-        if(entry_index){
-            *entry_index = 1;   // ".." is the second entry
+        if(loc){
+            memset(loc, 0, sizeof(fat_dir_loc_t));
+            loc->index = 1;     // ".." is the second entry
         }
         return FAT_OK;
     }
 
     // regular component
-    return fat_find_entry(volume, dir_cluster, component, entry, entry_index);
+    return fat_find_entry_loc(volume, dir_cluster, component, entry, loc);
 }
 
 fat_error_t fat_resolve_path(fat_volume_t *volume, 
@@ -204,6 +208,21 @@ fat_error_t fat_resolve_path(fat_volume_t *volume,
                              cluster_t *parent_cluster, 
                              uint32_t *entry_index){
 
+    fat_dir_loc_t loc;
+    fat_error_t err = fat_resolve_path_loc(volume, path, entry, parent_cluster, 
+                                           &loc);
+    if(err == FAT_OK && entry_index){
+        *entry_index = loc.index;
+    }
+    return err;
+}
+
+fat_error_t fat_resolve_path_loc(fat_volume_t *volume, 
+                                 const char *path, 
+                                 fat_dir_entry_t *entry, 
+                                 cluster_t *parent_cluster, 
+                                 fat_dir_loc_t *loc){
+
     // parameter validation
     if(!volume || !path || !entry){
         return FAT_ERR_INVALID_PARAM;
@@ -227,8 +246,8 @@ fat_error_t fat_resolve_path(fat_volume_t *volume,
             *parent_cluster = fat_get_root_dir_cluster(volume);
         }
 
-        if(entry_index){
-            *entry_index = 0;
+        if(loc){
+            memset(loc, 0, sizeof(fat_dir_loc_t));
         }
         
         fat_free_path_components(components, num_components);
@@ -239,7 +258,7 @@ fat_error_t fat_resolve_path(fat_volume_t *volume,
     cluster_t current_cluster = fat_get_root_dir_cluster(volume);
     cluster_t prev_cluster = current_cluster;
     fat_dir_entry_t current_entry;
-    uint32_t current_index = 0;
+    fat_dir_loc_t current_loc;
 
     // navigate through each component
     for(uint32_t i = 0; i<num_components; i++){
@@ -247,7 +266,7 @@ fat_error_t fat_resolve_path(fat_volume_t *volume,
 
         // find component in current directory
         err = fat_find_in_directory(volume, current_cluster, component, 
-                                    &current_entry, &current_index);
+                                    &current_entry, &current_loc);
         
         if(err != FAT_OK){
             fat_free_path_components(components, num_components);
@@ -274,8 +293,8 @@ fat_error_t fat_resolve_path(fat_volume_t *volume,
         *parent_cluster = prev_cluster;
     }
 
-    if(entry_index){
-        *entry_index = current_index;
+    if(loc){
+        *loc = current_loc;
     }
 
     fat_free_path_components(components, num_components);
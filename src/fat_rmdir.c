@@ -6,6 +6,9 @@
 #include "fat_lfn.h"
 #include "fat_root.h"
 #include "fat_file_delete.h"
+#include "fat_dir_slots.h"
+#include "fat_commit.h"
+#include "fat_lock.h"
 #include <string.h>
 #include <stdlib.h>
 
@@ -78,13 +81,12 @@ fat_error_t fat_count_directory_entries(fat_volume_t *volume,
     while(current_cluster >= 2 && !fat_is_eoc(volume, current_cluster)){
 
         uint32_t first_sector = fat_cluster_to_sector(volume, current_cluster);
-        int result = volume->device->read_sectors(volume->device->device_data, 
-                                                  first_sector, 
-                                                  volume->sectors_per_cluster, 
-                                                  cluster_buffer);
-        if(result != 0){
+        fat_error_t err = fat_meta_read(volume, first_sector, 
+                                        volume->sectors_per_cluster, 
+                                        cluster_buffer);
+        if(err != FAT_OK){
             free(cluster_buffer);
-            return FAT_ERR_DEVICE_ERROR;
+            return err;
         }
 
         for(uint32_t i=0; i<entries_per_cluster; i++){
@@ -99,7 +101,7 @@ fat_error_t fat_count_directory_entries(fat_volume_t *volume,
             }
         }
 
-        fat_error_t err = fat_get_next_cluster(volume, current_cluster, 
+        err = fat_get_next_cluster(volume, current_cluster, 
                                                &current_cluster);
         if(err != FAT_OK){
             free(cluster_buffer);
@@ -185,7 +187,7 @@ fat_error_t fat_delete_directory_clusters(fat_volume_t *volume,
     return FAT_OK;
 }
 
-fat_error_t fat_rmdir(fat_volume_t *volume, const char *path){
+static fat_error_t fat_rmdir_locked(fat_volume_t *volume, const char *path){
 
     // parameter validation
     if(!volume || !path){
@@ -198,13 +200,13 @@ fat_error_t fat_rmdir(fat_volume_t *volume, const char *path){
 
     fat_dir_entry_t dir_entry;
     cluster_t parent_cluster;
-    uint32_t entry_index;
+    fat_dir_loc_t entry_loc;
 
-    fat_error_t err = fat_resolve_path(volume, 
-                                       path, 
-                                       &dir_entry, 
-                                       &parent_cluster, 
-                                       &entry_index);
+    fat_error_t err = fat_resolve_path_loc(volume, 
+                                           path, 
+                                           &dir_entry, 
+                                           &parent_cluster, 
+                                           &entry_loc);
     if(err != FAT_OK){
         return err;
     }
@@ -220,6 +222,9 @@ fat_error_t fat_rmdir(fat_volume_t *volume, const char *path){
         return err;
     }
 
+    // clusters may be reused by a new directory
+    fat_dir_slots_invalidate(volume, dir_cluster);
+
     if(dir_cluster >= 2){
         err = fat_delete_directory_clusters(volume, dir_cluster);
         if(err != FAT_OK){
@@ -231,17 +236,30 @@ fat_error_t fat_rmdir(fat_volume_t *volume, const char *path){
 
     err = fat_delete_directory_entries(volume, 
                                        parent_cluster, 
-                                       entry_index, 
+                                       &entry_loc, 
                                        has_lfn);
     if(err != FAT_OK){
         return err;
     }
 
-    err = fat_flush(volume);
+    err = fat_commit(volume);
     if(err != FAT_OK){
         // directory deleted but change might not be persistent
         return err;
     }
 
     return FAT_OK;
-}
\ No newline at end of file
+}
+
+fat_error_t fat_rmdir(fat_volume_t *volume, const char *path){
+
+    // parameter validation
+    if(!volume || !path){
+        return FAT_ERR_INVALID_PARAM;
+    }
+
+    fat_lock_volume(volume);
+    fat_error_t err = fat_rmdir_locked(volume, path);
+    fat_unlock_volume(volume);
+    return err;
+}
@@ -1,5 +1,6 @@
 #include "fat_root.h"
 #include "fat_cluster.h"
+#include "fat_commit.h"
 #include <stdlib.h>
 #include <string.h>
 
@@ -64,15 +65,14 @@ fat_error_t fat_read_root_dir_fat12(fat_volume_t *volume,
         }
 
         // read sector
-        int result = volume->device->read_sectors(volume->device->device_data, 
-                                                  root_dir_start_sector + sector, 
-                                                  1, sector_buffer);
+        fat_error_t err = fat_meta_read(volume, root_dir_start_sector + sector, 
+                                        1, sector_buffer);
         
-        if(result != 0){
+        if(err != FAT_OK){
             free(sector_buffer);
             free(*entries);
             *entries = NULL;
-            return FAT_ERR_DEVICE_ERROR;
+            return err;
         }
 
         for (uint32_t i=0; i < entries_per_sector && 
@@ -167,16 +167,15 @@ fat_error_t fat_read_root_dir_fat32(fat_volume_t *volume,
 
         uint32_t first_sector = fat_cluster_to_sector(volume, current_cluster);
 
-        int result = volume->device->read_sectors(volume->device->device_data,
-                                                  first_sector,
-                                                  volume->sectors_per_cluster,
-                                                  cluster_buffer);
+        fat_error_t read_err = fat_meta_read(volume, first_sector,
+                                             volume->sectors_per_cluster,
+                                             cluster_buffer);
         
-        if(result != 0){
+        if(read_err != FAT_OK){
             free(cluster_buffer);
             free(*entries);
             *entries = NULL;
-            return FAT_ERR_DEVICE_ERROR;
+            return read_err;
         }
 
         for(uint32_t j = 0; j < entries_per_cluster && 
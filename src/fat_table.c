@@ -1,6 +1,8 @@
 // ASSUMPTION: LITTLE ENDIAN ARCHITECTURE - see notes
 
 #include "fat_table.h"
+#include "fat_commit.h"
+#include "fat_alloc_group.h"
 #include <string.h>
 
 // validate cluster number
@@ -9,6 +11,24 @@ static inline bool is_valid_cluster(fat_volume_t *volume, cluster_t cluster){
             cluster < (FAT_FIRST_VALID_CLUSTER + volume->total_clusters));
 }
 
+// mark FAT sectors holding [byte_offset, byte_offset + length) for the flush
+static void fat_mark_dirty(fat_volume_t *volume, 
+                           uint32_t byte_offset, 
+                           uint32_t length){
+
+    uint32_t first = byte_offset / volume->bytes_per_sector;
+    uint32_t last = (byte_offset + length - 1) / volume->bytes_per_sector;
+
+    for(uint32_t sector = first; sector <= last; sector++){
+        uint8_t bit = (uint8_t)(1 << (sector % 8));
+        if(!(volume->fat_dirty_map[sector / 8] & bit)){
+            volume->fat_dirty_map[sector / 8] |= bit;
+            volume->fat_dirty_sectors++;
+        }
+    }
+    volume->fat_dirty = true;
+}
+
 
 fat_error_t fat_read_entry(fat_volume_t *volume, 
                            cluster_t cluster, 
@@ -75,6 +95,23 @@ fat_error_t fat_write_entry(fat_volume_t *volume,
         return FAT_ERR_INVALID_CLUSTER;
     }
 
+    // group commit: frees reach the disk after the references are gone
+    if(value == FAT_FREE){
+        bool deferred;
+        fat_error_t err = fat_commit_defer_free(volume, cluster, &deferred);
+        if(err != FAT_OK){
+            return err;
+        }
+        if(deferred){
+            return FAT_OK;
+        }
+    }
+
+    uint32_t old_value = FAT_FREE;
+    if(volume->alloc_groups){
+        fat_read_entry(volume, cluster, &old_value);
+    }
+
     // write FAT entry
     switch(volume->type){
         case FAT_TYPE_FAT12: {
@@ -87,13 +124,14 @@ fat_error_t fat_write_entry(fat_volume_t *volume,
 
             if(cluster & 1) {
                 // odd cluster: update upper 12 bits
-                entry = (entry & 0x0FFF)|(value << 4);
+                entry = (entry & 0x000F)|(value << 4);
             } else {
                 // even cluster: update lower 12 bits
                 entry = (entry & 0xF000)|value;
             }
 
             *(uint16_t*)(&volume->fat_cache[byte_offset]) = entry;
+            fat_mark_dirty(volume, byte_offset, 2);
 
             break;
         }
@@ -102,6 +140,7 @@ fat_error_t fat_write_entry(fat_volume_t *volume,
             uint32_t byte_offset = cluster*2;
             value &= 0xFFFF;
             *(uint16_t*)(&volume->fat_cache[byte_offset]) = (uint16_t)value;
+            fat_mark_dirty(volume, byte_offset, 2);
 
             break;
         }
@@ -110,8 +149,10 @@ fat_error_t fat_write_entry(fat_volume_t *volume,
             uint32_t byte_offset = cluster*4;
             uint32_t current_entry = *(uint32_t*)(&volume->fat_cache[byte_offset]);
             value &= 0x0FFFFFFF;
-            uint32_t new_entry = (current_entry & 0x0FFFFFFF)|value;
+            // upper 4 bits are reserved and kept
+            uint32_t new_entry = (current_entry & 0xF0000000)|value;
             *(uint32_t*)(&volume->fat_cache[byte_offset]) = new_entry;
+            fat_mark_dirty(volume, byte_offset, 4);
 
             break;
         }
@@ -120,7 +161,29 @@ fat_error_t fat_write_entry(fat_volume_t *volume,
 
     }
 
-    volume->fat_dirty = true;
+    fat_alloc_groups_update(volume, cluster, old_value, value);
+    return FAT_OK;
+}
+
+fat_error_t fat_write_table_bytes(fat_volume_t *volume, 
+                                  uint32_t byte_offset, 
+                                  const void *data, 
+                                  uint32_t length){
 
+    // parameter validation
+    if(!volume || !data || length == 0){
+        return FAT_ERR_INVALID_PARAM;
+    }
+
+    if(byte_offset >= volume->fat_cache_size || 
+       length > volume->fat_cache_size - byte_offset){
+        return FAT_ERR_INVALID_PARAM;
+    }
+
+    memcpy(&volume->fat_cache[byte_offset], data, length);
+    fat_mark_dirty(volume, byte_offset, length);
+
+    // free counts are rebuilt on the next allocation
+    fat_alloc_groups_free(volume);
     return FAT_OK;
-}
\ No newline at end of file
+}
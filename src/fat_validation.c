@@ -291,14 +291,11 @@ fat_error_t fat_validate_api_parameters_open(fat_volume_t *volume,
         return FAT_ERR_INVALID_PARAM;
     }
 
-    int access_mode = flags & (FAT_O_RDONLY | FAT_O_WRONLY | FAT_O_RDWR);
+    // FAT_O_RDWR is both bits
+    int access_mode = flags & FAT_O_RDWR;
     if(access_mode == 0){
         return FAT_ERR_INVALID_PARAM;
     }
-
-    if((flags & FAT_O_RDONLY) && (flags & FAT_O_WRONLY)){
-        return FAT_ERR_INVALID_PARAM;
-    }
     
     return FAT_OK;
 }
@@ -320,7 +317,7 @@ fat_error_t fat_validate_api_parameters_read(fat_file_t *file,
         return FAT_OK;
     }
 
-    if(!(file->flags & (FAT_O_RDONLY | FAT_O_RDWR))){
+    if(!(file->flags & FAT_O_RDONLY)){
         return FAT_ERR_INVALID_PARAM;
     }
 
@@ -345,10 +342,15 @@ fat_error_t fat_validate_api_parameters_write(fat_file_t *file,
         return FAT_OK;
     }
 
-    if(!(file->flags & (FAT_O_WRONLY | FAT_O_RDWR))){
+    if(!(file->flags & FAT_O_WRONLY)){
         return FAT_ERR_INVALID_PARAM;
     }
 
-    uint32_t new_size = file->position + size;
+    // the sum below must not wrap
+    if(size > FAT_MAX_FILE_SIZE - file->position){
+        return FAT_ERR_FILE_TOO_LARGE;
+    }
+
+    uint32_t new_size = file->position + (uint32_t)size;
     return fat_validate_file_size_limits(file->volume, new_size);
 }
\ No newline at end of file
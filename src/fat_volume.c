@@ -1,4 +1,10 @@
 #include "fat_volume.h"
+#include "fat_dir_slots.h"
+#include "fat_commit.h"
+#include "fat_lock.h"
+#include "fat_flusher.h"
+#include "fat_intent.h"
+#include "fat_alloc_group.h"
 #include <stdlib.h>
 #include <string.h>
 
@@ -90,43 +96,115 @@ fat_error_t fat_mount(fat_block_device_t *device, fat_volume_t *volume){
 
     volume->fat_dirty = false;
 
-    return FAT_OK;
-}
+    // dirty sector tracking - flushes write only what changed
+    volume->fat_dirty_map = calloc((volume->fat_size_sectors + 7) / 8, 1);
+    if(!volume->fat_dirty_map){
+        free(volume->fat_cache);
+        volume->fat_cache = NULL;
+        return FAT_ERR_NO_MEMORY;
+    }
+    volume->fat_dirty_sectors = 0;
 
-fat_error_t fat_flush(fat_volume_t *volume){
+    err = fat_lock_init(volume);
+    if(err != FAT_OK){
+        free(volume->fat_dirty_map);
+        free(volume->fat_cache);
+        volume->fat_dirty_map = NULL;
+        volume->fat_cache = NULL;
+        return err;
+    }
 
-    // parameter validation
-    if(!volume){
-        return FAT_ERR_INVALID_PARAM;
+    // finish the metadata writes of a sync interrupted by a crash
+    err = fat_replay_intent_log(volume);
+    if(err != FAT_OK){
+        fat_lock_destroy(volume);
+        free(volume->fat_dirty_map);
+        free(volume->fat_cache);
+        volume->fat_dirty_map = NULL;
+        volume->fat_cache = NULL;
+        return err;
     }
 
+    return FAT_OK;
+}
+
+static fat_error_t fat_flush_locked(fat_volume_t *volume){
+
     // check if the FAT is dirty
     if(!volume->fat_dirty){
         return FAT_OK;
     }
 
-    // FAT is dirty, write FAT to all copies
+    // FAT is dirty, write runs of dirty sectors to all copies
     for(uint8_t i = 0; i < volume->num_fats; i++){
         
         // calculate start sector for current FAT copy
         uint32_t fat_sector = volume->fat_begin_sector + 
                                 (i * volume->fat_size_sectors);
         
-        // write FAT cache to current copy
-        int result = volume->device->write_sectors(volume->device->device_data,
-                                                   fat_sector,
-                                                   volume->fat_size_sectors,
-                                                   volume->fat_cache);
+        uint32_t sector = 0;
+        while(sector < volume->fat_size_sectors){
+            if(!fat_sector_dirty(volume, sector)){
+                sector++;
+                continue;
+            }
+
+            uint32_t run_start = sector;
+            while(sector < volume->fat_size_sectors && 
+                  fat_sector_dirty(volume, sector)){
+                sector++;
+            }
+
+            // write dirty run of the FAT cache to current copy
+            int result = volume->device->write_sectors(
+                                volume->device->device_data,
+                                fat_sector + run_start,
+                                sector - run_start,
+                                &volume->fat_cache[run_start * 
+                                                   volume->bytes_per_sector]);
     
-        if(result != 0){
-            return FAT_ERR_DEVICE_ERROR;
+            if(result != 0){
+                return FAT_ERR_DEVICE_ERROR;
+            }
         }
     }
 
+    memset(volume->fat_dirty_map, 0, (volume->fat_size_sectors + 7) / 8);
+    volume->fat_dirty_sectors = 0;
     volume->fat_dirty = false;
     return FAT_OK;
 }
 
+fat_error_t fat_flush(fat_volume_t *volume){
+
+    // parameter validation
+    if(!volume){
+        return FAT_ERR_INVALID_PARAM;
+    }
+
+    fat_lock_volume(volume);
+    fat_error_t err = fat_flush_locked(volume);
+    fat_unlock_volume(volume);
+    return err;
+}
+
+fat_error_t fat_set_discard(fat_volume_t *volume, bool enable){
+
+    // parameter validation
+    if(!volume || !volume->device){
+        return FAT_ERR_INVALID_PARAM;
+    }
+
+    if(enable && !volume->device->discard_sectors){
+        return FAT_ERR_NOT_SUPPORTED;
+    }
+
+    fat_lock_volume(volume);
+    volume->discard = enable;
+    fat_unlock_volume(volume);
+    return FAT_OK;
+}
+
 fat_error_t fat_unmount(fat_volume_t *volume){
 
     // parameter validation
@@ -134,18 +212,31 @@ fat_error_t fat_unmount(fat_volume_t *volume){
         return FAT_ERR_INVALID_PARAM;
     }
 
+    // background writer must be gone before the volume goes away
+    fat_stop_flusher(volume);
+
     // flush pending changes
-    fat_error_t err = fat_flush(volume);
+    fat_error_t err = fat_sync(volume);
     if(err != FAT_OK){
         // flush failed, continue and return err below
     }
 
+    fat_intent_release(volume);
+    fat_commit_release(volume);
+    fat_dir_slots_free_all(volume);
+    fat_alloc_groups_free(volume);
+
     // free FAT cache memory
-    if(!volume->fat_cache){
+    if(volume->fat_cache){
         free(volume->fat_cache);
         volume->fat_cache = NULL;
     }
 
+    free(volume->fat_dirty_map);
+    volume->fat_dirty_map = NULL;
+
+    fat_lock_destroy(volume);
+
     // clear volume structure
     memset(volume, 0, sizeof(fat_volume_t));
 